@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Usage: ./misc/test/selbench.sh ./nnn 1000 10000 50000 ...
+#
+# Measure the latency of toggling the selection of a file against the
+# number of files selected. For each count, all files of a dir with that
+# many files are selected and the last one is toggled TOGGLES times.
+# The key to frame latency histogram of each run is printed.
+#
+# Don't forget to build nnn with the debug log: make O_DEBUG=1
+
+LANG=C
+
+TOGGLES=${TOGGLES:-50}
+DELAY=${DELAY:-50}
+
+EXE=$(realpath "$1")
+RUNNER="$(dirname "$0")/nnn_runner.sh"
+TMPDIR=$(mktemp -d)
+
+trap 'rm -rf "$TMPDIR"' EXIT
+
+shift
+
+for count in "$@" ; do
+    dir="$TMPDIR/files"
+    rm -rf "$dir" "$TMPDIR/cfg"
+    mkdir -p "$dir" "$TMPDIR/cfg"
+    # Long names as in real selections
+    (cd "$dir" && seq -f "selection-benchmark-file-%06g" 1 "$count" | xargs touch)
+
+    input="$TMPDIR/input"
+    {
+        echo "a"
+        echo "@sleep 1000"
+        echo "G"
+        i=$TOGGLES
+        while [ "$i" -gt 0 ] ; do
+            echo "Space"
+            i=$((i - 1))
+        done
+        echo "q"
+    } > "$input"
+
+    # The runner stops after the first snapshot if it isn't verbose
+    XDG_CONFIG_HOME="$TMPDIR/cfg" "$RUNNER" -v -e "$EXE" -d "$dir" -o "$TMPDIR/out" \
+        -t "$DELAY" "$input" >/dev/null 2>&1
+
+    printf "%s selected, %s toggles\n" "$count" "$TOGGLES"
+    grep "frame latency" /tmp/nnndbg | awk '$NF != 0'
+    printf "\n"
+done
@@ -0,0 +1,271 @@
+#ifndef INCLUDE_ICONS_GENERATED
+#define INCLUDE_ICONS_GENERATED
+
+/*
+ * NOTE: This file is automatically generated.
+ * DO NOT EDIT THIS FILE DIRECTLY.
+ * Use `icons.h` to customize icons
+ */
+
+#define hash_start  UINT32_C(1987721472)
+#define hash_mul    UINT32_C(889476662)
+
+#define ICONS_PROBE_MAX 3u
+#define ICONS_MATCH_MAX 11u
+
+#define ICONS_STR_MAX 4u
+
+#define name_seed   UINT32_C(756718670)
+#define ICONS_NAME_TABLE_SIZE 4u
+
+struct icon_pair { const char match[ICONS_MATCH_MAX]; const char icon[ICONS_STR_MAX]; unsigned char color; };
+
+static const char icons_ext_uniq[52][ICONS_STR_MAX] = {
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"",
+};
+
+static const struct {
+	const char match[ICONS_MATCH_MAX];
+	unsigned char idx;
+	unsigned char color;
+} icons_ext[256] = {
+	[  1] = {"yaml", 16, 15 },
+	[  2] = {"fsscript", 28, 31 },
+	[  5] = {"flac", 3, 205 },
+	[  6] = {"gif", 8, 82 },
+	[  7] = {"avi", 4, 45 },
+	[ 10] = {"patch", 39, 0 },
+	[ 11] = {"lua", 34, 19 },
+	[ 12] = {"bat", 5, 0 },
+	[ 13] = {"epub", 25, 202 },
+	[ 14] = {"cc", 10, 81 },
+	[ 15] = {"cts", 18, 47 },
+	[ 16] = {"h", 9, 81 },
+	[ 17] = {"c", 9, 81 },
+	[ 18] = {"opus", 3, 220 },
+	[ 19] = {"xhtml", 11, 0 },
+	[ 20] = {"rc", 16, 0 },
+	[ 21] = {"mts", 18, 47 },
+	[ 23] = {"fs", 28, 31 },
+	[ 24] = {"rar", 1, 209 },
+	[ 25] = {"mpg", 4, 45 },
+	[ 28] = {"yml", 16, 15 },
+	[ 29] = {"rpm", 1, 209 },
+	[ 34] = {"css", 17, 199 },
+	[ 36] = {"wav", 3, 220 },
+	[ 38] = {"cbr", 1, 209 },
+	[ 39] = {"ejs", 11, 47 },
+	[ 40] = {"cljs", 13, 0 },
+	[ 41] = {"fsi", 28, 31 },
+	[ 42] = {"mp3", 3, 220 },
+	[ 43] = {"pyo", 43, 227 },
+	[ 44] = {"o", 0, 0 },
+	[ 45] = {"db", 19, 0 },
+	[ 46] = {"deb", 20, 209 },
+	[ 47] = {"1", 0, 202 },
+	[ 48] = {"rtf", 25, 0 },
+	[ 49] = {"doc", 23, 15 },
+	[ 51] = {"srt", 49, 0 },
+	[ 52] = {"mkv", 4, 45 },
+	[ 53] = {"clj", 13, 0 },
+	[ 54] = {"cls", 6, 0 },
+	[ 61] = {"java", 12, 32 },
+	[ 63] = {"jl", 16, 0 },
+	[ 64] = {"ppt", 41, 0 },
+	[ 65] = {"xcf", 8, 82 },
+	[ 66] = {"elf", 24, 0 },
+	[ 67] = {"f#", 28, 31 },
+	[ 70] = {"pyc", 43, 227 },
+	[ 73] = {"vid", 4, 45 },
+	[ 74] = {"psd", 42, 0 },
+	[ 75] = {"exe", 26, 0 },
+	[ 76] = {"vim", 50, 28 },
+	[ 77] = {"php", 40, 0 },
+	[ 78] = {"exs", 27, 104 },
+	[ 80] = {"conf", 16, 0 },
+	[ 82] = {"apk", 1, 209 },
+	[ 83] = {"xml", 11, 0 },
+	[ 86] = {"iso", 31, 209 },
+	[ 87] = {"lz", 1, 209 },
+	[ 90] = {"pptx", 41, 0 },
+	[ 91] = {"vtt", 49, 0 },
+	[ 96] = {"lzma", 1, 209 },
+	[ 99] = {"heex", 27, 104 },
+	[101] = {"gzip", 1, 209 },
+	[102] = {"class", 12, 32 },
+	[103] = {"cpio", 1, 209 },
+	[104] = {"rom", 44, 0 },
+	[107] = {"go", 30, 81 },
+	[108] = {"cjs", 11, 47 },
+	[112] = {"bz2", 1, 209 },
+	[113] = {"ico", 8, 82 },
+	[115] = {"mjs", 11, 47 },
+	[116] = {"webm", 4, 45 },
+	[117] = {"txt", 33, 15 },
+	[118] = {"flv", 4, 45 },
+	[119] = {"slim", 5, 15 },
+	[121] = {"htpasswd", 16, 0 },
+	[122] = {"jpeg", 8, 82 },
+	[123] = {"py", 43, 227 },
+	[124] = {"asm", 2, 0 },
+	[125] = {"ini", 16, 0 },
+	[126] = {"xbps", 1, 209 },
+	[127] = {"mp4", 4, 226 },
+	[128] = {"fsx", 28, 31 },
+	[129] = {"img", 31, 209 },
+	[130] = {"vimrc", 50, 28 },
+	[131] = {"rs", 45, 202 },
+	[132] = {"bmp", 8, 82 },
+	[133] = {"gz", 1, 209 },
+	[138] = {"md", 35, 202 },
+	[140] = {"sql", 19, 0 },
+	[144] = {"cmake", 14, 0 },
+	[145] = {"htaccess", 16, 0 },
+	[146] = {"js", 11, 47 },
+	[147] = {"tex", 6, 0 },
+	[148] = {"scala", 47, 196 },
+	[149] = {"zst", 1, 209 },
+	[150] = {"jpg", 8, 82 },
+	[151] = {"cxx", 10, 81 },
+	[152] = {"cljc", 13, 0 },
+	[153] = {"m4a", 3, 220 },
+	[154] = {"log", 33, 0 },
+	[155] = {"m4v", 4, 45 },
+	[156] = {"pyd", 43, 227 },
+	[157] = {"coffee", 15, 0 },
+	[158] = {"a", 0, 0 },
+	[160] = {"7z", 1, 209 },
+	[161] = {"docx", 23, 15 },
+	[164] = {"jxl", 8, 82 },
+	[165] = {"markdown", 35, 202 },
+	[167] = {"jsx", 32, 39 },
+	[168] = {"part", 37, 0 },
+	[173] = {"hxx", 10, 81 },
+	[174] = {"tsx", 32, 39 },
+	[175] = {"txz", 1, 209 },
+	[176] = {"zsh", 5, 47 },
+	[177] = {"c++", 10, 81 },
+	[179] = {"dll", 5, 0 },
+	[180] = {"ex", 27, 104 },
+	[181] = {"out", 24, 0 },
+	[182] = {"cab", 1, 209 },
+	[183] = {"wma", 4, 220 },
+	[184] = {"aup", 3, 220 },
+	[185] = {"json", 11, 47 },
+	[186] = {"wmv", 4, 45 },
+	[187] = {"ts", 18, 47 },
+	[188] = {"mov", 4, 45 },
+	[189] = {"sub", 49, 0 },
+	[190] = {"psb", 42, 0 },
+	[192] = {"cpp", 10, 81 },
+	[193] = {"xz", 1, 209 },
+	[194] = {"eex", 27, 104 },
+	[195] = {"ogg", 3, 220 },
+	[202] = {"cvs", 16, 0 },
+	[203] = {"jar", 12, 32 },
+	[204] = {"html", 11, 0 },
+	[206] = {"lha", 1, 209 },
+	[210] = {"msi", 36, 0 },
+	[211] = {"tar", 1, 209 },
+	[212] = {"otf", 38, 0 },
+	[214] = {"so", 0, 0 },
+	[215] = {"hpp", 10, 81 },
+	[219] = {"rb", 29, 160 },
+	[220] = {"diff", 21, 0 },
+	[221] = {"xlsx", 51, 0 },
+	[222] = {"tgz", 1, 209 },
+	[223] = {"bin", 7, 0 },
+	[224] = {"hh", 10, 81 },
+	[225] = {"pdf", 25, 202 },
+	[226] = {"ksh", 5, 47 },
+	[227] = {"png", 8, 82 },
+	[228] = {"sty", 6, 0 },
+	[229] = {"zip", 1, 209 },
+	[231] = {"webp", 8, 82 },
+	[232] = {"xls", 51, 0 },
+	[233] = {"cue", 3, 220 },
+	[234] = {"htm", 11, 0 },
+	[235] = {"mpeg", 4, 45 },
+	[236] = {"ttf", 38, 0 },
+	[237] = {"sln", 48, 0 },
+	[238] = {"cbz", 1, 209 },
+	[240] = {"svg", 8, 82 },
+	[242] = {"rss", 46, 0 },
+	[243] = {"gem", 29, 160 },
+	[244] = {"sh", 5, 47 },
+	[250] = {"bib", 6, 0 },
+	[251] = {"opdownload", 37, 0 },
+	[253] = {"djvu", 22, 202 },
+	[254] = {"mk", 14, 0 },
+	[255] = {"lzh", 1, 209 },
+};
+
+/* 1 + index in icons_name, 0 if no name hashes to the slot */
+static const unsigned char icons_name_idx[16] = {
+	[  0] = 5,
+	[  3] = 13,
+	[  4] = 1,
+	[  5] = 9,
+	[  7] = 3,
+	[  8] = 7,
+	[  9] = 8,
+	[ 10] = 6,
+	[ 11] = 12,
+	[ 12] = 2,
+	[ 13] = 11,
+	[ 14] = 10,
+	[ 15] = 4,
+};
+
+#endif /* INCLUDE_ICONS_GENERATED */
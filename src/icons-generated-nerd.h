@@ -0,0 +1,289 @@
+#ifndef INCLUDE_ICONS_GENERATED
+#define INCLUDE_ICONS_GENERATED
+
+/*
+ * NOTE: This file is automatically generated.
+ * DO NOT EDIT THIS FILE DIRECTLY.
+ * Use `icons.h` to customize icons
+ */
+
+#define hash_start  UINT32_C(740531691)
+#define hash_mul    UINT32_C(3442452713)
+
+#define ICONS_PROBE_MAX 3u
+#define ICONS_MATCH_MAX 11u
+
+#define ICONS_STR_MAX 5u
+
+#define name_seed   UINT32_C(1355060505)
+#define ICONS_NAME_TABLE_SIZE 4u
+
+struct icon_pair { const char match[ICONS_MATCH_MAX]; const char icon[ICONS_STR_MAX]; unsigned char color; };
+
+static const char icons_ext_uniq[60][ICONS_STR_MAX] = {
+	"󱓷",
+	"󰀼",
+	"󰎈",
+	"󰈫",
+	"",
+	"󰙩",
+	"",
+	"󰈟",
+	"",
+	"",
+	"",
+	"󰌞",
+	"",
+	"",
+	"󰆍",
+	"",
+	"",
+	"",
+	"",
+	"󱍙",
+	"󰆼",
+	"",
+	"",
+	"",
+	"󰈬",
+	"󰌽",
+	"󰈦",
+	"",
+	"",
+	"",
+	"󰄺",
+	"",
+	"󰟓",
+	"󰌆",
+	"󰌝",
+	"",
+	"",
+	"",
+	"󰈙",
+	"",
+	"󰠞",
+	"",
+	"",
+	"󰍲",
+	"",
+	"󰃘",
+	"",
+	"",
+	"󰈧",
+	"",
+	"",
+	"󰊖",
+	"",
+	"",
+	"",
+	"",
+	"",
+	"󰅺",
+	"",
+	"󰈛",
+};
+
+static const struct {
+	const char match[ICONS_MATCH_MAX];
+	unsigned char idx;
+	unsigned char color;
+} icons_ext[256] = {
+	[  0] = {"epub", 26, 202 },
+	[  1] = {"json", 36, 47 },
+	[  2] = {"lzh", 1, 209 },
+	[  3] = {"elf", 25, 0 },
+	[  4] = {"lua", 39, 19 },
+	[  5] = {"svg", 7, 82 },
+	[  7] = {"tex", 5, 0 },
+	[  8] = {"lz", 1, 209 },
+	[  9] = {"scala", 55, 196 },
+	[ 10] = {"vtt", 57, 0 },
+	[ 11] = {"bin", 6, 0 },
+	[ 13] = {"m", 40, 81 },
+	[ 14] = {"slim", 4, 15 },
+	[ 15] = {"jxl", 7, 82 },
+	[ 16] = {"yml", 16, 15 },
+	[ 17] = {"md", 41, 202 },
+	[ 18] = {"py", 50, 227 },
+	[ 19] = {"doc", 24, 15 },
+	[ 20] = {"xlsx", 59, 0 },
+	[ 21] = {"cpp", 9, 81 },
+	[ 22] = {"deb", 21, 209 },
+	[ 23] = {"html", 34, 0 },
+	[ 24] = {"rss", 53, 0 },
+	[ 25] = {"cvs", 16, 0 },
+	[ 27] = {"mts", 18, 47 },
+	[ 29] = {"cbz", 1, 209 },
+	[ 30] = {"jpg", 7, 82 },
+	[ 31] = {"cljc", 13, 0 },
+	[ 32] = {"nix", 44, 31 },
+	[ 33] = {"vim", 58, 28 },
+	[ 34] = {"vid", 3, 45 },
+	[ 36] = {"htaccess", 16, 0 },
+	[ 37] = {"mkv", 3, 45 },
+	[ 38] = {"rs", 52, 202 },
+	[ 39] = {"rar", 1, 209 },
+	[ 40] = {"hxx", 9, 81 },
+	[ 41] = {"jpeg", 7, 82 },
+	[ 42] = {"aup", 2, 220 },
+	[ 43] = {"so", 0, 0 },
+	[ 44] = {"psb", 49, 0 },
+	[ 45] = {"msi", 43, 0 },
+	[ 46] = {"jsx", 37, 39 },
+	[ 48] = {"gif", 7, 82 },
+	[ 49] = {"markdown", 41, 202 },
+	[ 50] = {"ejs", 11, 47 },
+	[ 51] = {"cab", 1, 209 },
+	[ 52] = {"sty", 5, 0 },
+	[ 55] = {"zsh", 4, 47 },
+	[ 56] = {"c++", 9, 81 },
+	[ 57] = {"sub", 57, 0 },
+	[ 58] = {"otf", 46, 0 },
+	[ 60] = {"webm", 3, 45 },
+	[ 63] = {"cxx", 9, 81 },
+	[ 64] = {"jar", 12, 32 },
+	[ 65] = {"sln", 56, 0 },
+	[ 72] = {"cpio", 1, 209 },
+	[ 73] = {"sh", 4, 47 },
+	[ 74] = {"png", 7, 82 },
+	[ 75] = {"diff", 22, 0 },
+	[ 77] = {"js", 11, 47 },
+	[ 78] = {"pdf", 26, 202 },
+	[ 79] = {"pyd", 50, 227 },
+	[ 80] = {"fsscript", 29, 31 },
+	[ 81] = {"yaml", 16, 15 },
+	[ 82] = {"gem", 31, 160 },
+	[ 84] = {"db", 20, 0 },
+	[ 88] = {"ttf", 46, 0 },
+	[ 89] = {"xhtml", 34, 0 },
+	[ 91] = {"sql", 20, 0 },
+	[ 92] = {"zip", 1, 209 },
+	[ 93] = {"mpeg", 3, 45 },
+	[ 94] = {"iso", 35, 209 },
+	[ 96] = {"a", 0, 0 },
+	[ 97] = {"apk", 1, 209 },
+	[100] = {"bz2", 1, 209 },
+	[101] = {"cmake", 14, 0 },
+	[102] = {"xls", 59, 0 },
+	[104] = {"docx", 24, 15 },
+	[105] = {"lha", 1, 209 },
+	[106] = {"wav", 2, 220 },
+	[107] = {"jl", 16, 0 },
+	[108] = {"lhs", 10, 28 },
+	[109] = {"heex", 28, 104 },
+	[113] = {"sass", 54, 199 },
+	[116] = {"xz", 1, 209 },
+	[117] = {"m4a", 2, 220 },
+	[118] = {"zst", 1, 209 },
+	[119] = {"img", 35, 209 },
+	[120] = {"ico", 7, 82 },
+	[121] = {"webp", 7, 82 },
+	[122] = {"ini", 16, 0 },
+	[123] = {"out", 25, 0 },
+	[124] = {"mat", 42, 81 },
+	[125] = {"rb", 31, 160 },
+	[127] = {"o", 0, 0 },
+	[129] = {"ogg", 2, 220 },
+	[132] = {"pptx", 48, 0 },
+	[136] = {"7z", 1, 209 },
+	[137] = {"opdownload", 45, 0 },
+	[141] = {"opus", 2, 220 },
+	[143] = {"ex", 28, 104 },
+	[144] = {"cabal", 10, 45 },
+	[145] = {"dll", 4, 0 },
+	[146] = {"hs", 10, 104 },
+	[147] = {"hh", 9, 81 },
+	[148] = {"bmp", 7, 82 },
+	[149] = {"m4v", 3, 45 },
+	[151] = {"part", 45, 0 },
+	[155] = {"vimrc", 58, 28 },
+	[158] = {"gzip", 1, 209 },
+	[159] = {"psd", 49, 0 },
+	[160] = {"cjs", 11, 47 },
+	[161] = {"fsx", 29, 31 },
+	[162] = {"pyc", 50, 227 },
+	[163] = {"eex", 28, 104 },
+	[164] = {"mp4", 3, 226 },
+	[167] = {"coffee", 15, 0 },
+	[168] = {"tsx", 37, 39 },
+	[169] = {"txz", 1, 209 },
+	[170] = {"class", 12, 32 },
+	[171] = {"log", 38, 0 },
+	[172] = {"mov", 3, 45 },
+	[173] = {"xbps", 1, 209 },
+	[174] = {"1", 0, 202 },
+	[175] = {"cljs", 13, 0 },
+	[176] = {"f#", 29, 31 },
+	[179] = {"css", 17, 199 },
+	[181] = {"exe", 27, 0 },
+	[182] = {"rc", 16, 0 },
+	[185] = {"avi", 3, 45 },
+	[186] = {"fs", 29, 31 },
+	[187] = {"tar", 1, 209 },
+	[189] = {"pyo", 50, 227 },
+	[190] = {"tgz", 1, 209 },
+	[191] = {"go", 32, 81 },
+	[194] = {"clj", 13, 0 },
+	[195] = {"wma", 3, 220 },
+	[196] = {"rom", 51, 0 },
+	[197] = {"rtf", 26, 0 },
+	[198] = {"fen", 30, 0 },
+	[200] = {"gpg", 33, 209 },
+	[201] = {"ppt", 48, 0 },
+	[202] = {"rpm", 1, 209 },
+	[205] = {"flac", 2, 205 },
+	[210] = {"c", 8, 81 },
+	[211] = {"exs", 28, 104 },
+	[212] = {"ksh", 4, 47 },
+	[213] = {"cts", 18, 47 },
+	[214] = {"htm", 34, 0 },
+	[215] = {"srt", 57, 0 },
+	[216] = {"cue", 19, 220 },
+	[217] = {"fsi", 29, 31 },
+	[218] = {"gz", 1, 209 },
+	[219] = {"xml", 34, 0 },
+	[221] = {"scss", 54, 199 },
+	[222] = {"xcf", 7, 82 },
+	[224] = {"htpasswd", 16, 0 },
+	[225] = {"ts", 18, 47 },
+	[226] = {"cls", 5, 0 },
+	[227] = {"txt", 38, 15 },
+	[228] = {"wmv", 3, 45 },
+	[229] = {"cbr", 1, 209 },
+	[230] = {"conf", 16, 0 },
+	[231] = {"mjs", 11, 47 },
+	[232] = {"lzma", 1, 209 },
+	[233] = {"mpg", 3, 45 },
+	[234] = {"patch", 22, 0 },
+	[235] = {"pgn", 30, 0 },
+	[238] = {"java", 12, 32 },
+	[239] = {"bib", 5, 0 },
+	[240] = {"flv", 3, 45 },
+	[241] = {"h", 8, 81 },
+	[242] = {"cc", 9, 81 },
+	[243] = {"php", 47, 0 },
+	[244] = {"djvu", 23, 202 },
+	[245] = {"mk", 14, 0 },
+	[249] = {"mp3", 2, 220 },
+	[254] = {"hpp", 9, 81 },
+	[255] = {"bat", 4, 0 },
+};
+
+/* 1 + index in icons_name, 0 if no name hashes to the slot */
+static const unsigned char icons_name_idx[16] = {
+	[  0] = 7,
+	[  1] = 11,
+	[  2] = 4,
+	[  3] = 8,
+	[  5] = 13,
+	[  8] = 12,
+	[  9] = 6,
+	[ 10] = 2,
+	[ 11] = 3,
+	[ 12] = 5,
+	[ 13] = 10,
+	[ 14] = 9,
+	[ 15] = 1,
+};
+
+#endif /* INCLUDE_ICONS_GENERATED */
@@ -1,5 +1,6 @@
 /*
- * simple program which outputs a hash-table of `icons_ext` with low collusion.
+ * simple program which outputs a hash-table of `icons_ext` with low collusion
+ * and a perfect (collision free) hash-table of `icons_name`.
  * the hash function is case-insensitive, it also doesn't hash beyond the
  * length of the longest extension.
  */
@@ -40,6 +41,7 @@
 #define HGEN_ITERARATION (1ul << 13)
 #define ICONS_PROBE_MAX_ALLOWED 6
 #define ICONS_MATCH_MAX (512)
+#define ICONS_NAME_TABLE_MAX 10 /* size in bits of the largest name table tried */
 
 #if 0 /* for logging some interesting info to stderr */
 	#define log(...)  fprintf(stderr, "[INFO]: " __VA_ARGS__)
@@ -47,6 +49,7 @@
 	#define log(...) ((void)0)
 #endif
 
+static uint32_t icon_hash(const char *str, uint32_t hash, uint32_t bits);
 static uint32_t icon_ext_hash(const char *s);
 
 /* change ICONS_TABLE_SIZE to increase the size of the table */
@@ -104,6 +107,51 @@ table_populate(unsigned int p[static PROBE_CNT])
 	return p;
 }
 
+/*
+ * find the smallest table and a seed for which no two names collide,
+ * fills `name_idx` with 1 + index of the name in `icons_name`
+ */
+static uint32_t name_idx_bits, name_seed;
+static unsigned char name_idx[1u << ICONS_NAME_TABLE_MAX];
+
+static uint32_t pcg(uint64_t *state);
+
+static int
+name_table_populate(uint32_t bits, uint32_t seed)
+{
+	memset(name_idx, 0x0, sizeof name_idx);
+	for (size_t i = 0; i < ARRLEN(icons_name); ++i) {
+		uint32_t h = icon_hash(icons_name[i].match, seed, bits);
+		if (name_idx[h])
+			return 0;
+		name_idx[h] = (unsigned char)(i + 1);
+	}
+	return 1;
+}
+
+static void
+name_table_generate(void)
+{
+	ENSURE(ARRLEN(icons_name) < (unsigned char)-1);
+
+	for (uint32_t bits = 1; bits <= ICONS_NAME_TABLE_MAX; ++bits) {
+		uint64_t rng = hash_start;
+
+		if ((1u << bits) < ARRLEN(icons_name))
+			continue;
+		for (size_t i = 0; i < HGEN_ITERARATION; ++i) {
+			uint32_t seed = pcg(&rng);
+
+			if (name_table_populate(bits, seed)) {
+				name_idx_bits = bits;
+				name_seed = seed;
+				return;
+			}
+		}
+	}
+	ENSURE(0 && "no collision free name table found");
+}
+
 /* permuted congruential generator */
 static uint32_t
 pcg(uint64_t *state)
@@ -176,6 +224,12 @@ main(void)
 	}
 	ENSURE(total_probe == best_total_probe);
 
+	name_table_generate();
+	for (size_t i = 0; i < ARRLEN(icons_name); ++i) {
+		uint32_t h = icon_hash(icons_name[i].match, name_seed, name_idx_bits);
+		ENSURE(name_idx[h] == i + 1);
+	}
+
 	size_t match_max = 0, icon_max = 0;
 	for (size_t i = 0; i < ARRLEN(icons_name); ++i) {
 		match_max = MAX(match_max, strlen(icons_name[i].match) + 1);
@@ -218,6 +272,7 @@ main(void)
 	log("compaction : %6zu bytes\n", uniq_head * icon_max + ARRLEN(table));
 	log("hash_start : %6" PRIu32 "\n", hash_start);
 	log("hash_mul   : %6" PRIu32 "\n", hash_mul);
+	log("name table : %6u slots\n", 1u << name_idx_bits);
 
 	printf("#ifndef INCLUDE_ICONS_GENERATED\n");
 	printf("#define INCLUDE_ICONS_GENERATED\n\n");
@@ -231,6 +286,8 @@ main(void)
 	printf("#define ICONS_PROBE_MAX %uu\n", max_probe);
 	printf("#define ICONS_MATCH_MAX %zuu\n\n", match_max);
 	printf("#define ICONS_STR_MAX %zuu\n\n", icon_max);
+	printf("#define name_seed   UINT32_C(%" PRIu32 ")\n", name_seed);
+	printf("#define ICONS_NAME_TABLE_SIZE %" PRIu32 "u\n\n", name_idx_bits);
 
 	printf("struct icon_pair { const char match[ICONS_MATCH_MAX]; "
 	       "const char icon[ICONS_STR_MAX]; unsigned char color; };\n\n");
@@ -257,6 +314,13 @@ main(void)
 	}
 	printf("};\n\n");
 
+	printf("/* 1 + index in icons_name, 0 if no name hashes to the slot */\n");
+	printf("static const unsigned char icons_name_idx[%u] = {\n", 1u << name_idx_bits);
+	for (size_t i = 0; i < (1u << name_idx_bits); ++i)
+		if (name_idx[i])
+			printf("\t[%3zu] = %u,\n", i, name_idx[i]);
+	printf("};\n\n");
+
 	printf("#endif /* INCLUDE_ICONS_GENERATED */\n");
 }
 
@@ -266,10 +330,11 @@ main(void)
 
 #if defined(ICONS_GENERATE) || defined(ICONS_ENABLED)
 static uint32_t
-icon_ext_hash(const char *str)
+icon_hash(const char *str, uint32_t hash, uint32_t bits)
 {
-	uint32_t i, hash = hash_start;
-	enum { wsz = sizeof hash * CHAR_BIT, z = wsz - ICONS_TABLE_SIZE, r = 5 };
+	uint32_t i;
+	enum { wsz = sizeof hash * CHAR_BIT, r = 5 };
+	const uint32_t z = wsz - bits;
 
 	/* just an xor-rotate hash. in general, this is a horrible hash
 	 * function but for our specific input it works fine while being
@@ -284,9 +349,23 @@ icon_ext_hash(const char *str)
 	hash ^= (hash >> z);
 	hash *= GOLDEN_RATIO_32;
 
-	hash >>= z;
-	ENSURE(hash < ARRLEN(table));
+	return hash >> z;
+}
 
+static uint32_t
+icon_ext_hash(const char *str)
+{
+	uint32_t hash = icon_hash(str, hash_start, ICONS_TABLE_SIZE);
+
+	ENSURE(hash < ARRLEN(table));
 	return hash;
 }
+
+#ifdef ICONS_ENABLED
+static uint32_t
+icon_name_hash(const char *str)
+{
+	return icon_hash(str, name_seed, ICONS_NAME_TABLE_SIZE);
+}
+#endif
 #endif
@@ -37,13 +37,24 @@
 #endif
 #ifdef __linux__
 #include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 #define LINUX_INOTIFY
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+/* The seccomp filter of older Android may block copy_file_range() */
+#if defined(SYS_copy_file_range) && !defined(__ANDROID__)
+#define LINUX_CPFR
+#endif
 #endif
 #ifndef __GLIBC__
 #include <sys/types.h>
 #endif
 #endif
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__APPLE__) || defined(__DragonFly__)
@@ -81,6 +92,7 @@
 #ifndef NOLC
 #include <locale.h>
 #endif
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #ifndef NORL
@@ -93,6 +105,9 @@
 #else
 #include <regex.h>
 #endif
+#ifdef MAGIC
+#include <magic.h>
+#endif
 #include <signal.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -143,13 +158,23 @@
  */
 #define macos_icons_hack() do { clrtoeol(); refresh(); } while(0)
 #else
-#define macos_icons_hack()
+#define macos_icons_hack() ((void)0)
 #endif
 
 #ifdef TOURBIN_QSORT
 #include "qsort.h"
 #endif
 
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(NOSIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+#endif
+
 /* Macro definitions */
 #define VERSION      "5.3"
 #define GENERAL_INFO "BSD 2-Clause\nhttps://github.com/jarun/nnn"
@@ -204,6 +229,12 @@
 #define ENTRY_INCR      64 /* Number of dir 'entry' structures to allocate per shot */
 #define ENTRY_INCR_DU   1024 /* Larger increment in du mode to reduce realloc and wait-for-threads */
 #define TASK_CAP_DU     256  /* Initial number of tasks for disk usage */
+#define COPY_CHUNK      (1 << 23) /* Bytes copied by the kernel between progress updates */
+#define COPY_SLICE      (1 << 26) /* Bytes of a file copied by a task, the rest is requeued */
+#define COPY_BUF        (1 << 16) /* Buffer to copy with read() and write() */
+#define JOBS_MAX        8    /* Background file operations at once */
+#define NAMEIDX_MIN     1024 /* Smaller listings are filtered fast enough */
+#define NAMEIDX_MAX     (1 << 22) /* Name suffixes indexed at most */
 #define NAMEBUF_INCR    0x800 /* 64 dir entries at once, avg. 32 chars per file name = 64*32B = 2KB */
 #define DESCRIPTOR_LEN  32
 #define _ALIGNMENT      0x10 /* 16-byte alignment */
@@ -225,6 +256,11 @@
 /* Time intervals */
 #define DBLCLK_INTERVAL_NS (400000000)
 #define XDELAY_INTERVAL_MS (350000) /* 350 ms delay */
+#define FPS_DEF            60 /* Max frames drawn per second while moving */
+#define FPS_MAX            1000
+#ifdef DEBUG
+#define LATENCY_BUCKETS    12 /* Key to frame latency histogram, <1ms to >=1024ms */
+#endif
 
 /* Use 8 contexts */
 #define CTX_MAX 8
@@ -251,6 +287,11 @@
 #define HASH_BITS   (0xFFFFFF)
 #define HASH_OCTETS (HASH_BITS >> 6) /* 2^6 = 64 */
 
+#define SELIDX_INIT 1024 /* Initial slots of the selection index, power of 2 */
+#define SELHASH_INIT 2166136261U /* FNV-1a offset basis */
+#define SELBUF_KEEP (PATH_MAX << 4) /* Selection buffer kept allocated when cleared */
+#define SELOUT_BUF  (PATH_MAX << 4) /* Paths written at once */
+
 /* Entry flags */
 #define DIR_OR_DIRLNK 0x01
 #define HARD_LINK     0x02
@@ -295,6 +336,11 @@
 #define MAX_HISTORY 0x10
 #define INVALID_POS 0xFF
 
+/* User and group names */
+#define IDNAME_TTL 300 /* Seconds before a name is looked up again on dir load */
+#define IDHASH(id) ((id) * 2654435761U)
+#define OWNER_MAX  16  /* Max width of the owner column */
+
 /* Volume info */
 #define VFS_AVAIL 0
 #define VFS_USED  1
@@ -308,7 +354,10 @@ typedef unsigned long long ullong_t;
 
 /* STRUCTURES */
 
-/* Directory entry */
+/*
+ * Directory entry, 56 bytes on 64-bit systems. The id takes it from 48 as
+ * there are no spare bits, the saved filter results are keyed by it.
+ */
 typedef struct entry {
 	char *name;  /* 8 bytes */
 	time_t sec;  /* 8 bytes */
@@ -320,17 +369,22 @@ typedef struct entry {
 		ullong_t nlen   : 16; /* 2 bytes (length of file name) */
 		ullong_t flags  : 8;  /* 1 byte (flags specific to the file) */
 	};
+	uint_t id;   /* 4 bytes (position in directory read order) */
 #ifndef NOUG
 	uid_t uid; /* 4 bytes */
 	gid_t gid; /* 4 bytes */
 #endif
+#ifdef ICONS_ENABLED
+	ushort_t icon; /* 2 bytes (name or extension icon match, 0 if none) */
+#endif
 } *pEntry;
 
-/* Selection marker */
+/* Selection index slot, offsets + 1 in the selection buffer */
 typedef struct {
-	char *startpos;
-	size_t len;
-} selmark;
+	uint_t name;
+	uint_t dir; /* 0 for a path stored whole */
+	uint_t file; /* Offset + 1 of the path in the selection file, 0 if unknown */
+} selslot;
 
 /* Key-value pairs from env */
 typedef struct {
@@ -345,8 +399,100 @@ typedef struct {
 	const regex_t *regex;
 #endif
 	const char *str;
+	size_t len;     /* Length of the filter string */
+	bool ascii;     /* Filter string is plain ASCII */
+	bool icase;     /* Case-insensitive match */
+	uchar_t poslen; /* Match columns per entry */
+	uchar_t *pos;   /* Match columns of all entries, NULL if not needed */
 } fltrexp_t;
 
+/* Filter results of a directory listing, entries are identified by id */
+typedef struct {
+	ullong_t stamp;       /* Last use, to evict the oldest slot */
+	ullong_t digest;      /* Hash of the listed names in read order */
+	int nents;            /* Number of listed entries */
+	int cap;              /* Entries allocated */
+	int *score;           /* Fuzzy score per entry, valid for matches only */
+	uint_t *mark;         /* Entries matched when set to gen */
+	uint_t gen;           /* Filter run the results are from */
+	uchar_t *pos;         /* Match columns of all entries, for dimming */
+	size_t poscap;
+	uchar_t poslen;       /* Match columns per entry, 0 if not saved */
+	uint_t regex : 1;     /* Filter mode */
+	uint_t fuzzy : 1;
+	uint_t icase : 1;
+	char fltr[REGEX_MAX]; /* Filter string, empty if there are no results */
+} fltrcache_t;
+
+/* Suffix of a listed name, by offset in the name buffer */
+typedef struct {
+	uint_t off;
+	uint_t id;
+} nameidx_t;
+
+#ifndef NOUG
+/* Name of a user or group id */
+typedef struct {
+	uint_t id;
+	bool used;
+	time_t stamp; /* Time of the lookup, 0 if not looked up */
+	char *name;   /* NULL if the id has no name */
+} idname_t;
+
+typedef struct {
+	idname_t *tbl;
+	uint_t cap;   /* Power of 2 */
+	uint_t len;
+	bool group;
+} idmap_t;
+#endif
+
+/* Details of an entry formatted for display, kept while the source fields match */
+typedef struct {
+	time_t sec;
+	off_t size;      /* Size shown, apparent or allocated */
+	mode_t mode;
+	uchar_t flags;
+	uchar_t key;     /* Display settings, 0 if not formatted */
+	uchar_t color;   /* Color pair */
+	char ind;        /* Indicator after the name */
+	int attrs;
+	uchar_t szoff;   /* Offset of the size in info, 0 if there's no size */
+	char time[20];
+	char info[16];   /* Permissions and size columns */
+} entdtl_t;
+
+#ifndef NOLC
+/* Decoded name of an entry with control chars replaced, valid for one listing */
+typedef struct {
+	wchar_t *name;
+	ushort_t *cols;  /* cols[i] is the display width of the first i wide chars */
+	uint_t gen;      /* Listing generation */
+	ushort_t len;    /* Wide chars in name */
+	ushort_t cap;
+} wname_t;
+#endif
+
+/* What a listing row showed when it was last drawn */
+typedef struct {
+	uint_t id;   /* Entry id, UINT_MAX for a blank row */
+	uchar_t flags;
+	bool hover;
+} rowstate_t;
+
+/* Screen contents for incremental redraw */
+typedef struct {
+	rowstate_t *rows;     /* From line 2 downwards */
+	int nrows;            /* Valid rows, 0 forces a full redraw */
+	int rowcap;
+	int ncols;            /* Columns of the listing */
+	int preview;          /* Entry id in the preview pane, -1 if empty */
+	ushort_t lines, cols;
+#ifdef DIM_FILTERED
+	char fltr[REGEX_MAX]; /* Filter the names were dimmed for */
+#endif
+} screen_t;
+
 /*
  * Settings
  */
@@ -363,14 +509,14 @@ typedef struct {
 	uint_t ctxactive  : 1;  /* Context active or not */
 	uint_t reverse    : 1;  /* Reverse sort */
 	uint_t version    : 1;  /* Version sort */
-	uint_t reserved1  : 1;
+	uint_t ownerorder : 1;  /* Order by owner */
 	/* The following settings are global */
 	uint_t curctx     : 3;  /* Current context number */
 	uint_t prefersel  : 1;  /* Prefer selection over current, if exists */
 	uint_t fileinfo   : 1;  /* Show file information on hover */
 	uint_t nonavopen  : 1;  /* Open file on right arrow or `l` */
 	uint_t autoenter  : 1;  /* auto-enter dir in type-to-nav mode */
-	uint_t reserved2  : 1;
+	uint_t prevtail   : 1;  /* Preview the end of text files */
 	uint_t useeditor  : 1;  /* Use VISUAL to open text files */
 	uint_t reserved3  : 2;
 	uint_t fuzzy      : 1;  /* Use fuzzy filters */
@@ -393,7 +539,7 @@ typedef struct {
 	uint_t forcequit  : 1;  /* Do not prompt on quit */
 	uint_t initfile   : 1;  /* Positional arg is a file */
 	uint_t interrupt  : 1;  /* Program received an interrupt */
-	uint_t move       : 1;  /* Move operation */
+	uint_t move       : 1;  /* Only the listing changed since last redraw */
 	uint_t oldcolor   : 1;  /* Use older colorscheme */
 	uint_t picked     : 1;  /* Plugin has picked files */
 	uint_t picker     : 1;  /* Write selection to user-specified file */
@@ -447,12 +593,30 @@ alignas(max_align_t) static context g_ctx[CTX_MAX];
 
 static int ndents, cur, last, curscroll, last_curscroll, total_dents = ENTRY_INCR, scroll_lines = 1;
 static int nselected;
+static screen_t scr;
+static entdtl_t *pdtls; /* Indexed by entry id */
+static int dtlcap;
+#ifndef NOLC
+static wname_t *pwnames; /* Indexed by entry id */
+static int wnamecap;
+#endif
+static uint_t dentgen; /* Bumped on each directory load */
+#ifndef NOUG
+static idmap_t uidmap, gidmap = { .group = TRUE };
+static int ownerw = 1; /* Width of the owner column */
+#endif
 #ifndef NOFIFO
 static int fifofd = -1;
 #endif
 static int devnullfd = -1;
 static time_t gtimesecs;
 static uint_t idletimeout, selbufpos, selbuflen;
+static uint_t frame_ns = 1000000000 / FPS_DEF; /* Min interval between frames, 0 to draw each move */
+static ullong_t lastframe; /* Time the last frame was drawn */
+#ifdef DEBUG
+static ullong_t keyns; /* Time the first key of a frame was read */
+static uint_t latency[LATENCY_BUCKETS];
+#endif
 static ushort_t xlines, xcols;
 static ushort_t idle;
 static uchar_t maxbm, maxplug, maxorder;
@@ -475,6 +639,14 @@ static char *listpath;
 static char *listroot;
 static char *plgpath;
 static char *pnamebuf, *pselbuf, *findselpos;
+static selslot *pselidx; /* Hash index of the paths in pselbuf */
+static uint_t selidxcap, selidxcnt, selidxend, selidxdir; /* Slots, paths, pselbuf indexed up to, its dir */
+static uint_t selbufdir;      /* The last dir in pselbuf, offset + 1 */
+static uint_t selsynced;      /* The selection file has pselbuf up to here, 0 to rewrite it */
+static uint_t selsyncdir;     /* The dir in effect at selsynced */
+static uint_t seldead;        /* Bytes of deselected paths in pselbuf, blanked with NULs */
+static uint_t selfiledead;    /* Bytes of deselected paths blanked in the selection file */
+static struct stat selfilesb; /* The selection file as written last */
 static char *mark;
 static char *trashcmd;
 static char *previewer = NULL;
@@ -526,25 +698,91 @@ static ullong_t *core_files;
 static blkcnt_t *core_blocks;
 static ullong_t num_files;
 
+/* A copied dir, its mode and times are set after its entries are in */
+typedef struct {
+	char *path;
+	struct stat sb;
+} copy_dir;
+
+/* A file operation running in the background, listed with 'i' */
 typedef struct {
+	/* Progress, guarded by du_count_mutex */
+	off_t total;     /* Bytes of the files found so far */
+	off_t done;      /* Bytes copied, entries removed */
+	uint_t errors;
+	int err;         /* errno of the first error */
+	char errname[NAME_MAX + 1]; /* Entry of the first error */
+	copy_dir *dirs;
+	size_t ndirs;
+	size_t dircap;
+
+	size_t pending;  /* Tasks in the pool, guarded by running_mutex */
+	struct du_task *held; /* Tasks taken up while paused, guarded by running_mutex */
+	size_t nheld;
+	size_t heldcap;
+	char *srcs;      /* Sources of a move, removed once copied */
+	off_t srclen;
+	char *list;      /* Copy of the selection the command reads */
+	ullong_t start;
+	ullong_t paused_ns; /* Time spent paused */
+	ullong_t paused_at;
+	pid_t pid;       /* Command run by the job, 0 if the pool runs it */
+	int status;      /* Exit status of the command */
+	volatile bool cancel;
+	volatile bool paused;
+	bool overwrite;  /* Replace existing files, skip them otherwise */
+	char op;         /* 'c'opy, 'r'emove or e'x'ecute */
+	const char *name;
+	char to[NAME_MAX + 1]; /* Target shown in the list */
+} op_job;
+
+typedef struct du_group {
 	blkcnt_t blocks;
 	ullong_t files;
 	size_t pending;
 	int entnum;
 	bool mntpoint;
 	bool no_aggregate;
+	bool fidx;     /* Walk to build the file name index */
+	bool bg;       /* Walk of a new dir, not waited for */
+	char *cpdst;   /* Walk to copy the tree here */
+	size_t cpsrclen; /* Length of the path of the copied tree */
+	char *rmname; /* Walk to remove the dir, removed when the group is done */
+	int rmfd;     /* The dir once walked, its subdirs are relative to it */
+	int rmpfd;    /* The dir rmname is in */
+	struct du_group *parent; /* Group of the dir above rmname */
+	char *rmlist;  /* Remove these NUL-separated paths */
+	off_t rmlistlen;
+	bool cpattrs;  /* Give the copied dirs of the job their modes and times */
+	op_job *job;   /* Job of a copy or remove walk */
 } du_group;
 
+/* The rest of a file being copied */
 typedef struct {
+	struct stat sb;
+	char *dst;
+	int sfd;
+	int dfd;
+	int kernel;    /* The way to copy, see copy_data() */
+} copy_part;
+
+typedef struct du_task {
 	char *path;
 	du_group *group;
+	copy_part *part; /* A file copy to go on with */
 	bool count_root;
+	uint_t fidxent; /* Index entry of the dir */
 } du_task;
 
-static du_task *du_tasks;
+static du_task *du_tasks; /* Walks, taken first */
 static size_t du_task_len;
 static size_t du_task_cap;
 static size_t du_tasks_pending;
+static size_t du_bg_pending; /* Tasks of the walks in the background */
+static du_task *job_tasks; /* Tasks of the jobs, room for the held ones too */
+static size_t job_task_len;
+static size_t job_task_cap;
+static size_t job_held; /* Tasks held by paused jobs */
 
 typedef struct {
 	char path[PATH_MAX];
@@ -556,6 +794,174 @@ typedef struct {
 
 static thread_data *core_data;
 
+static op_job *jobs[JOBS_MAX];
+static int njobs;
+static char jobnote[NAME_MAX + 64]; /* How the last job ended */
+
+#ifndef NOFIND
+/*
+ * File name index of a subtree. Entries refer to the entry of their
+ * parent dir, full paths are put together only for the results.
+ */
+#define FIDX_NONE UINT_MAX /* No entry, also the parent of the entries in the root */
+#define FIDX_NOWD (FIDX_NONE - 1) /* Unused watch descriptor */
+#define FIDX_BATCH 256     /* Names appended at once by a walker */
+#define FIDX_EVENTS_MAX 1024 /* Changes applied at once, more trigger a rebuild */
+
+typedef struct {
+	uint_t parent;
+	uint_t name;       /* Offset of the name in fidxnames */
+	ushort_t nlen;     /* Length of the name including '\0' */
+	bool gone;         /* Removed or moved away */
+} fidx_ent;
+
+static char fidxroot[PATH_MAX];
+static fidx_ent *fidxents;
+static uint_t fidxcnt, fidxcap;
+static char *fidxnames;
+static size_t fidxnameslen, fidxnamescap;
+static uint_t *fidxhash;   /* Entries by parent and name, open addressing */
+static uint_t fidxhashcap; /* Power of 2, twice the entries at least */
+static bool fidxstale;     /* Can't be kept up to date, rebuild on next use */
+static pthread_mutex_t fidx_mutex = PTHREAD_MUTEX_INITIALIZER;
+#ifdef LINUX_INOTIFY
+static int fidxfd = -1;
+static uint_t *fidxwds;    /* Dir entry of each inotify watch descriptor */
+static int fidxwdcap;
+#endif
+#endif
+
+#define ASYNC_POLL_MS     10 /* Input poll interval while waiting for a background result */
+#define FSINFO_CACHE      8  /* Filesystems with cached stats */
+#define FSINFO_TTL        2  /* Seconds before filesystem stats are fetched again */
+#define FSINFO_TIMEOUT_NS 1000000000 /* Show the mount as unresponsive after 1s */
+
+/* Filesystem stats fetched in the background */
+typedef struct {
+	dev_t dev;
+	time_t stamp;      /* Time of the last result */
+	ullong_t started;  /* Time the running query was started */
+	ullong_t used;     /* Time of the last lookup, 0 if the slot is free */
+	size_t avail;
+	bool valid;        /* stamp and avail are set */
+	bool busy;         /* A query is running */
+	char path[PATH_MAX];
+} fsinfo_t;
+
+static fsinfo_t fsinfos[FSINFO_CACHE];
+static fsinfo_t *fswait;           /* Query the status bar waits for */
+static dev_t dirdev;               /* Device of the current dir in du mode */
+static pthread_mutex_t fsinfo_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Preview pane contents rendered by the preview thread */
+typedef struct {
+	char *buf;      /* Rows, each NUL-terminated */
+	size_t len;
+	size_t cap;
+	off_t binsize;  /* Size of a binary file, -1 for others */
+	int rows;
+	struct entry *ents; /* Entries of the rows after the first in a dir, for colors */
+	int nents;
+	int entcap;
+	char *names;    /* Names of ents */
+	size_t namescap;
+} preview_t;
+
+/* Settings a dir preview is sorted with, taken with the request */
+typedef struct {
+	settings cfg;
+	int (*namecmp)(const char * const s1, const char * const s2);
+	bool list;      /* In list mode */
+} prevsort_t;
+
+#define PREVIEW_CACHE    16 /* Rendered previews remembered */
+#define PREVIEW_MAX_LINE 4096
+
+/* Options a preview is rendered with, part of the cache key */
+#define PREVIEW_TAIL   0x01 /* Show the end of text files */
+#define PREVIEW_HIDDEN 0x02 /* Show hidden files in dirs */
+/* The sort order of dirs follows */
+
+/* Rendered preview of a file version in a pane size */
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+	ullong_t used;     /* Least recently used goes first */
+	int width;
+	int height;
+	uint_t opts;
+	preview_t pv;
+	char path[PATH_MAX];
+} prevcache_t;
+
+static prevcache_t prevcache[PREVIEW_CACHE];
+static ullong_t prevclock;         /* Use counter of the cache */
+static preview_t prevwork;         /* Result being rendered */
+static pthread_t preview_tid;
+static pthread_mutex_t preview_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t preview_cond = PTHREAD_COND_INITIALIZER;
+static char prevreq[PATH_MAX];     /* Path to preview next */
+static int prevreqw, prevreqh;     /* Pane geometry of the request */
+static uint_t prevreqopts;          /* Options of the request */
+static prevsort_t prevreqsort;
+static int prevslot;               /* Cache slot of the last result */
+static uint_t prevgen;             /* Generation of the latest request */
+static uint_t prevdone = UINT_MAX; /* Generation of the last result */
+static int previnit;               /* 1 running, -1 thread unavailable */
+static bool prevpending, prevwait, prevquit;
+
+#define PREVIEW_PREFETCH 2    /* Neighbours on each side previewed ahead */
+#define PREVIEW_WARM_MAX 4096 /* Entries of a hovered dir stat'ed ahead */
+
+/* Work for the preview thread while it's idle */
+typedef struct {
+	bool warm;        /* Stat the entries of the dir instead */
+	char path[PATH_MAX];
+} prefetch_t;
+
+static prefetch_t prefetches[PREVIEW_PREFETCH * 2 + 1];
+static int prefcount, prefidx;     /* Queued, taken */
+static uint_t prefgen;             /* Generation the queue is for, 0 if dropped */
+static bool prefetching;           /* The preview thread works ahead */
+static bool prefqueued;            /* Set by the UI thread only */
+
+/* Previewer co-process, used by the preview thread only */
+static char prevsrvbuf[PREVIEW_MAX_LINE]; /* Output not parsed yet */
+static size_t prevsrvlen;
+static pid_t prevsrvpid;
+static int prevsrvfd = -1;
+static int prevsrv;                /* 1 running, -1 previewer doesn't support it */
+static char *prevfbuf;             /* Part of the file shown in the pane */
+static size_t prevfcap;
+static char *prevdnames;           /* Names of the entries kept for a dir while listing it */
+static int prevdncap;
+
+#ifdef MAGIC
+#define MAGIC_CACHE    256 /* File types remembered, power of 2 */
+#define MAGIC_DESC_MAX 256
+
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	char *desc;
+} magic_ent;
+
+static magic_t magiccookie;        /* Used by the detector thread only */
+static magic_ent magiccache[MAGIC_CACHE];
+static pthread_t magic_tid;
+static pthread_mutex_t magic_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t magic_cond = PTHREAD_COND_INITIALIZER;
+static char magicreq[PATH_MAX];    /* Path to detect next */
+static char magicpath[PATH_MAX];   /* Path of the last result */
+static char magicdesc[MAGIC_DESC_MAX];
+static int magicshown;             /* Length of the file type on screen */
+static int magicinit;              /* 1 running, -1 libmagic unavailable */
+static bool magicpending, magicdone, magicnew, magicwait, magicquit;
+#endif
+
 /* Retain old signal handlers */
 static struct sigaction oldsighup;
 static struct sigaction oldsigtstp;
@@ -696,6 +1102,14 @@ static char * const utils[] = {
 #define MSG_NOCHANGE     41
 #define MSG_DIR_CHANGED  42
 #define MSG_BM_NAME      43
+#define MSG_0_JOBS       44
+#define MSG_JOB_NUM      45
+#define MSG_JOB_OPTS     46
+#define MSG_QUIT_JOBS    47
+#ifndef NOFIND
+#define MSG_FIND         48
+#define MSG_INDEXING     49
+#endif
 
 static const char * const messages[] = {
 	"",
@@ -734,7 +1148,11 @@ static const char * const messages[] = {
 	"['l's]/'o'pen/e'x'tract/'m'nt?",
 	"keys:",
 	"invalid regex",
+#ifndef NOUG
+	"'a'u/'d'u/'e'xt/'o'wn/'r'ev/'s'z/'t'm/'v'er/'c'lr/'^T'?",
+#else
 	"'a'u/'d'u/'e'xt/'r'ev/'s'z/'t'm/'v'er/'c'lr/'^T'?",
+#endif
 	"unmount failed! try lazy?",
 	"first file (\')/char?",
 	"remove tmp file?",
@@ -742,6 +1160,14 @@ static const char * const messages[] = {
 	"unchanged",
 	"dir changed, range sel off",
 	"name: ",
+	"0 jobs",
+	"job number?",
+	"'c'ancel/'p'ause-resume?",
+	"jobs running! quit?",
+#ifndef NOFIND
+	"find: ",
+	"indexing [^C aborts]",
+#endif
 };
 
 /* Supported configuration environment variables */
@@ -759,6 +1185,7 @@ static const char * const messages[] = {
 #define NNN_ORDER   11
 #define NNN_HELP    12
 #define NNN_TRASH   13
+#define NNN_FPS     14
 
 static const char * const env_cfg[] = {
 	"NNN_OPTS",
@@ -775,6 +1202,7 @@ static const char * const env_cfg[] = {
 	"NNN_ORDER",
 	"NNN_HELP",
 	"NNN_TRASH",
+	"NNN_FPS",
 };
 
 /* Required environment variables */
@@ -922,12 +1350,37 @@ static void move_cursor(int target, int ignore_scrolloff);
 static char *load_input(int fd, const char *path);
 static int set_sort_flags(int r);
 static void statusbar(char *path);
+static char *coolsize(off_t size);
+static bool preview_show(void);
+static void prefetch_cancel(void);
 static bool get_output(char *command, char *arg1, char *arg2, int fdout, bool page);
 #ifndef NOFIFO
 static void notify_fifo(bool force);
 #endif
 static inline bool selforparent(const char *path);
+static bool selidxupdate(void);
+static selslot *selidxat(uint_t dir, uint_t name);
 static void dirwalk(char *path, int entnum, bool mountpoint, bool no_aggregate);
+static bool prep_threads(void);
+static void showjobs(void);
+static bool jobs_room(void);
+static void job_free(op_job *job);
+static char *job_list(void);
+static void job_unlist(char *list);
+static bool job_spawn(const char *name, const char *to, char *list, char *cmd, char *arg1, char *arg2);
+static bool copy_selection(const char *path, bool move);
+static bool rm_job(char *buf, off_t len, const char *to);
+static bool rm_selection(void);
+static bool jobs_poll(void);
+static bool jobs_manage(void);
+static void rm_paths(op_job *job, char *buf, off_t len);
+static void copy_finish(op_job *job, copy_part *part, bool ok);
+#ifndef NOFIND
+static char *make_tmp_tree(char **paths, ssize_t entries, const char *prefix);
+#ifdef LINUX_INOTIFY
+static void fidx_update(void);
+#endif
+#endif
 
 /* Functions */
 
@@ -1182,39 +1635,155 @@ static inline char *xextension(const char *fname, size_t len)
 }
 
 #ifndef NOUG
-/*
- * One-shot cache for getpwuid/getgrgid. Returns the cached name if the
- * provided uid is the same as the previous uid. Returns xitoa(guid) if
- * the guid is not found in the password database.
- */
-static char *getpwname(uid_t uid)
+/* Open addressing map of user or group ids to names */
+static idname_t *idmap_get(idmap_t *map, uint_t id)
+{
+	idname_t *slot;
+	uint_t i;
+
+	/* Keep the load under 3/4 */
+	if (map->len >= (map->cap >> 1) + (map->cap >> 2)) {
+		idmap_t newmap = { .cap = map->cap ? map->cap << 1 : 64, .group = map->group };
+
+		newmap.tbl = calloc(newmap.cap, sizeof(idname_t));
+		if (!newmap.tbl)
+			return NULL;
+
+		for (i = 0; i < map->cap; ++i) {
+			if (!map->tbl[i].used)
+				continue;
+
+			for (uint_t j = IDHASH(map->tbl[i].id) & (newmap.cap - 1);;
+			     j = (j + 1) & (newmap.cap - 1))
+				if (!newmap.tbl[j].used) {
+					newmap.tbl[j] = map->tbl[i];
+					break;
+				}
+		}
+
+		newmap.len = map->len;
+		free(map->tbl);
+		*map = newmap;
+	}
+
+	for (i = IDHASH(id) & (map->cap - 1);; i = (i + 1) & (map->cap - 1)) {
+		slot = &map->tbl[i];
+		if (!slot->used)
+			break;
+		if (slot->id == id)
+			return slot;
+	}
+
+	/* Not looked up yet */
+	slot->used = TRUE;
+	slot->id = id;
+	++map->len;
+	return slot;
+}
+
+static void idmap_resolve(const idmap_t *map, idname_t *slot, time_t now)
 {
-	static uint_t uidcache = UINT_MAX;
-	static char *namecache;
+	const char *name;
+
+	if (map->group) {
+		struct group *gr = getgrgid(slot->id);
+
+		name = gr ? gr->gr_name : NULL;
+	} else {
+		struct passwd *pw = getpwuid(slot->id);
 
-	if (uidcache != uid) {
-		struct passwd *pw = getpwuid(uid);
+		name = pw ? pw->pw_name : NULL;
+	}
 
-		uidcache = uid;
-		namecache = pw ? pw->pw_name : NULL;
+	if (!name || !slot->name || strcmp(name, slot->name)) {
+		free(slot->name);
+		slot->name = name ? xstrdup(name) : NULL;
 	}
 
-	return namecache ? namecache : xitoa(uid);
+	slot->stamp = now;
 }
 
-static char *getgrname(gid_t gid)
+/* Returns NULL if the id is not found in the password or group database */
+static const char *idmap_name(idmap_t *map, uint_t id)
+{
+	idname_t *slot = idmap_get(map, id);
+
+	if (!slot)
+		return NULL;
+
+	if (!slot->stamp)
+		idmap_resolve(map, slot, time(NULL));
+
+	return slot->name;
+}
+
+/* Look up the owners of all entries, names older than IDNAME_TTL are refreshed */
+static void idmap_warm(void)
 {
-	static uint_t gidcache = UINT_MAX;
-	static char *grpcache;
+	const time_t now = time(NULL);
+	const char *name;
+	idname_t *slot;
+	uid_t uid = (uid_t)-1;
+	gid_t gid = (gid_t)-1;
+	int len;
+
+	ownerw = 1;
+
+	for (int i = 0; i < ndents; ++i) {
+		if (pdents[i].uid != uid) {
+			uid = pdents[i].uid;
+			slot = idmap_get(&uidmap, uid);
+			if (slot && (now - slot->stamp >= IDNAME_TTL))
+				idmap_resolve(&uidmap, slot, now);
 
-	if (gidcache != gid) {
-		struct group *gr = getgrgid(gid);
+			name = (slot && slot->name) ? slot->name : xitoa(uid);
+			len = (int)xstrlen(name);
+			if (len > ownerw)
+				ownerw = MIN(len, OWNER_MAX);
+		}
 
-		gidcache = gid;
-		grpcache = gr ? gr->gr_name : NULL;
+		if (pdents[i].gid != gid) {
+			gid = pdents[i].gid;
+			slot = idmap_get(&gidmap, gid);
+			if (slot && (now - slot->stamp >= IDNAME_TTL))
+				idmap_resolve(&gidmap, slot, now);
+		}
 	}
+}
+
+/* Returns xitoa(guid) if the guid is not found in the password database */
+static char *getpwname(uid_t uid)
+{
+	const char *name = idmap_name(&uidmap, uid);
+
+	return name ? (char *)name : xitoa(uid);
+}
+
+static char *getgrname(gid_t gid)
+{
+	const char *name = idmap_name(&gidmap, gid);
+
+	return name ? (char *)name : xitoa(gid);
+}
+
+/* Order by owner name, owners without a name last */
+static int ownercmp(uid_t a, uid_t b)
+{
+	if (a == b)
+		return 0;
+
+	const char *na = idmap_name(&uidmap, a);
+	const char *nb = idmap_name(&uidmap, b);
+
+	if (na && nb) {
+		int ret = strcmp(na, nb);
+
+		if (ret)
+			return ret;
+	} else if (na || nb)
+		return na ? -1 : 1;
 
-	return grpcache ? grpcache : xitoa(gid);
+	return (a < b) ? -1 : 1;
 }
 #endif
 
@@ -1778,145 +2347,577 @@ static char confirm_force(bool selection, bool use_trash)
 	return (use_trash ? '\0' : 'i'); /* interactive for rm */
 }
 
-/* Writes buflen char(s) from buf to a file */
-static void writesel(const char *buf, const size_t buflen)
+/* The selection file wasn't written to by someone else since nnn wrote it */
+static bool selfilecurrent(const struct stat *sb)
 {
-	if (!selpath)
-		return;
+	return sb->st_dev == selfilesb.st_dev && sb->st_ino == selfilesb.st_ino
+		&& sb->st_size == selfilesb.st_size && sb->st_mtime == selfilesb.st_mtime
+		&& NSEC_MTIME(*sb) == NSEC_MTIME(selfilesb);
+}
 
-	int fd = open(selpath, O_CREAT | O_WRONLY | O_TRUNC, S_IWUSR | S_IRUSR);
+/* Buffer len bytes of str, at most PATH_MAX, to write to fd, FALSE on error */
+static bool bufwrite(int fd, char *buf, size_t *off, const char *str, size_t len)
+{
+	if (*off + len > SELOUT_BUF) {
+		if (write(fd, buf, *off) != (ssize_t)*off)
+			return FALSE;
+		*off = 0;
+	}
 
-	if (fd != -1) {
-		if (write(fd, buf, buflen) != (ssize_t)buflen)
-			printwarn(NULL);
-		close(fd);
-	} else
-		printwarn(NULL);
+	memcpy(buf + *off, str, len);
+	*off += len;
+	return TRUE;
 }
 
-static void appendfpath(const char *path, const size_t len)
+/* Put the path stored as the name at name under dir in buf, return its length */
+static size_t selfullpath(char *buf, uint_t dir, const char *name)
 {
-	if ((selbufpos >= selbuflen) || ((len + 3) > (selbuflen - selbufpos))) {
-		selbuflen += PATH_MAX;
-		pselbuf = xrealloc(pselbuf, selbuflen);
-		if (!pselbuf)
-			errexit();
-	}
+	size_t len = dir ? xstrsncpy(buf, pselbuf + dir - 1, PATH_MAX) - 1 : 0;
 
-	selbufpos += xstrsncpy(pselbuf + selbufpos, path, len);
+	return len + xstrsncpy(buf + len, name, PATH_MAX - len) - 1;
 }
 
-static void selbufrealloc(const size_t alloclen)
+/* The name of the next path in the selection buffer from *pos, its dir in *dir */
+static char *selnext(size_t *pos, uint_t *dir)
 {
-	if ((selbufpos + alloclen) > selbuflen) {
-		selbuflen = ALIGN_UP(selbufpos + alloclen, PATH_MAX);
-		pselbuf = xrealloc(pselbuf, selbuflen);
-		if (!pselbuf)
-			errexit();
+	char *entry;
+
+	while (*pos < selbufpos) {
+		entry = pselbuf + *pos;
+		*pos += xstrlen(entry) + 1;
+		if (*entry == '/')
+			*dir = entry - pselbuf + 1;
+		else if (*entry)
+			return entry;
 	}
+
+	return NULL;
 }
 
-/* Write selected file paths to fd, linefeed separated */
-static size_t seltofile(int fd, uint_t *pcount, const char *separator)
+/* The file name of the first selected path */
+static char *selfirstname(void)
 {
-	uint_t lastpos, count = 0;
-	char *pbuf = pselbuf;
 	size_t pos = 0;
-	ssize_t len, prefixlen = 0, initlen = 0;
+	uint_t dir = 0;
+	char *name = selnext(&pos, &dir);
 
-	if (pcount)
-		*pcount = 0;
+	return name ? xbasename(name) : NULL;
+}
 
-	if (!selbufpos)
-		return 0;
+/*
+ * Write the paths in the selection buffer from pos on, the dir in effect
+ * there at dir, separated by sep. lead: fd has paths before. list: show
+ * the paths in the listing dir under the listing root. fpos: the offset
+ * in the selection file to note for each path in the index.
+ */
+static bool selwrite(int fd, size_t pos, uint_t dir, bool lead, char sep, bool list, uint_t *pcount, off_t *fpos)
+{
+	char buf[SELOUT_BUF];
+	char path[PATH_MAX];
+	size_t off = 0, len, plen, listlen = (list && listpath) ? xstrlen(listpath) : 0;
+	uint_t count = 0;
+	selslot *slot;
 
-	lastpos = selbufpos - 1;
+	for (; pos < selbufpos; pos += len + 1) {
+		len = xstrlen(pselbuf + pos);
+		if (pselbuf[pos] == '/') {
+			dir = pos + 1;
+			continue;
+		}
+		if (!len) /* Deselected */
+			continue;
 
-	if (listpath) {
-		prefixlen = (ssize_t)xstrlen(listroot);
-		initlen = (ssize_t)xstrlen(listpath);
+		if (lead && !bufwrite(fd, buf, &off, &sep, 1))
+			return FALSE;
+
+		if (fpos) {
+			*fpos += lead;
+			slot = selidxat(dir, pos + 1);
+			if (slot)
+				slot->file = (*fpos < UINT_MAX) ? *fpos + 1 : 0;
+			*fpos += (dir ? xstrlen(pselbuf + dir - 1) : 0) + len;
+		}
+		lead = TRUE;
+
+		if (listlen) {
+			plen = selfullpath(path, dir, pselbuf + pos);
+			if (is_prefix(path, listpath, listlen)
+			    ? (!bufwrite(fd, buf, &off, listroot, xstrlen(listroot))
+			       || !bufwrite(fd, buf, &off, path + listlen, plen - listlen))
+			    : !bufwrite(fd, buf, &off, path, plen))
+				return FALSE;
+		} else if ((dir && !bufwrite(fd, buf, &off, pselbuf + dir - 1, xstrlen(pselbuf + dir - 1)))
+			   || !bufwrite(fd, buf, &off, pselbuf + pos, len))
+			return FALSE;
+		++count;
 	}
 
-	while (pos <= lastpos) {
-		DPRINTF_S(pbuf);
-		len = (ssize_t)xstrlen(pbuf);
+	if (off && write(fd, buf, off) != (ssize_t)off)
+		return FALSE;
 
-		if (!listpath || !is_prefix(pbuf, listpath, initlen)) {
-			if (write(fd, pbuf, len) != len)
-				return pos;
-		} else {
-			if (write(fd, listroot, prefixlen) != prefixlen)
-				return pos;
-			if (write(fd, pbuf + initlen, len - initlen) != (len - initlen))
-				return pos;
+	if (pcount)
+		*pcount = count;
+	return TRUE;
+}
+
+/*
+ * Write the selection buffer to the selection file. Paths appended since
+ * the last write are added in place if the file is as nnn left it, and
+ * deselected ones are blanked in place by selbufblank(). The file is
+ * written anew when the buffer is squeezed, before a command reads it or
+ * if someone else wrote to it. It's replaced at once then so that readers
+ * never see it half written.
+ */
+static void writesel(void)
+{
+	char tmp[PATH_MAX];
+	struct stat sb;
+	off_t fpos;
+	bool ok = FALSE;
+	int fd;
+
+	if (!selpath)
+		return;
+
+	/* The file offsets of the paths go in their index slots */
+	selidxupdate();
+
+	if (selsynced && selsynced <= selbufpos) {
+		fd = open(selpath, O_WRONLY | O_APPEND);
+		if (fd != -1) {
+			fpos = 0;
+			if (fstat(fd, &sb) == 0 && selfilecurrent(&sb)) {
+				fpos = sb.st_size;
+				ok = selwrite(fd, selsynced, selsyncdir, sb.st_size != 0, '\0', FALSE, NULL, &fpos)
+				     && fstat(fd, &selfilesb) == 0;
+			}
+			close(fd);
 		}
 
-		pos += len;
-		if (pos <= lastpos) {
-			if (write(fd, separator, 1) != 1)
-				return pos;
-			pbuf += len + 1;
+		if (ok) {
+			selsynced = selbufpos;
+			selsyncdir = selbufdir;
+			return;
 		}
-		++pos;
-		++count;
 	}
 
-	if (pcount)
-		*pcount = count;
+	selsynced = 0;
+	fd = -1;
 
-	return pos;
-}
+	/* Links and special files are written in place */
+	if ((lstat(selpath, &sb) == -1 || S_ISREG(sb.st_mode))
+	    && snprintf(tmp, sizeof(tmp), "%s.XXXXXX", selpath) < (int)sizeof(tmp))
+		fd = mkstemp(tmp);
 
-/* List selection from selection file (another instance) */
-static bool listselfile(void)
-{
-	if (isselfileempty())
-		return FALSE;
+	if (fd != -1) {
+		fpos = 0;
+		ok = selwrite(fd, 0, 0, FALSE, '\0', FALSE, NULL, &fpos) && (fstat(fd, &selfilesb) == 0);
+		if (close(fd) || !ok || rename(tmp, selpath)) {
+			unlink(tmp);
+			ok = FALSE;
+		}
+	}
 
-	snprintf(g_buf, CMD_LEN_MAX, "tr \'\\0\' \'\\n\' < '%s'", selpath);
-	spawn(utils[UTIL_SH_EXEC], g_buf, NULL, NULL, F_CLI | F_CONFIRM);
+	if (!ok) {
+		fd = open(selpath, O_CREAT | O_WRONLY | O_TRUNC, S_IWUSR | S_IRUSR);
+		if (fd != -1) {
+			fpos = 0;
+			ok = selwrite(fd, 0, 0, FALSE, '\0', FALSE, NULL, &fpos) && (fstat(fd, &selfilesb) == 0);
+			close(fd);
+		}
+	}
 
-	return TRUE;
+	if (ok) {
+		selsynced = selbufpos;
+		selsyncdir = selbufdir;
+		selfiledead = 0;
+	} else
+		printwarn(NULL);
 }
 
-/* Reset selection indicators */
-static void resetselind(void)
+/* Blank len bytes of a deselected path at pos in the selection file, FALSE if it isn't as nnn left it */
+static bool selfileblank(uint_t pos, size_t len)
 {
-	for (int r = 0; r < ndents; ++r)
-		if (pdents[r].flags & FILE_SELECTED)
-			pdents[r].flags &= ~FILE_SELECTED;
+	static const char blank[PATH_MAX];
+	struct stat sb;
+	bool ok;
+	int fd = open(selpath, O_WRONLY);
+
+	if (fd == -1)
+		return FALSE;
+
+	ok = fstat(fd, &sb) == 0 && selfilecurrent(&sb) && pos + len <= (size_t)sb.st_size
+	     && pwrite(fd, blank, len, pos) == (ssize_t)len && fstat(fd, &selfilesb) == 0;
+	close(fd);
+	return ok;
 }
 
-static void startselection(void)
+/* Squeeze the blanks out of the selection file before a command reads it */
+static void selfilepack(void)
 {
-	if (!g_state.selmode) {
-		g_state.selmode = 1;
-		nselected = 0;
-
-		if (selbufpos) {
-			resetselind();
-			writesel(NULL, 0);
-			selbufpos = 0;
-		}
+	if (selfiledead) {
+		selsynced = 0;
+		writesel();
 	}
 }
 
-static void clearselection(void)
+/*
+ * Add a path to the selection buffer. Its dir is stored once for the paths
+ * selected in a row from it, ahead of their names. Relative paths are
+ * stored whole, they only come before any dir.
+ */
+static void appendfpath(const char *path, const size_t len)
+{
+	const char *name = path;
+	size_t dirlen = 0;
+	bool newdir;
+
+	if (*path == '/') {
+		name = xbasename((char *)path);
+		if (!*name && name - path > 1) /* Keep a trailing slash with the name */
+			name = (char *)xmemrchr((uchar_t *)path, '/', name - path - 1) + 1;
+		dirlen = name - path;
+	}
+
+	newdir = dirlen && !(selbufdir && selbufdir <= selbufpos
+			     && !strncmp(pselbuf + selbufdir - 1, path, dirlen)
+			     && !pselbuf[selbufdir - 1 + dirlen]);
+
+	if ((selbufpos >= selbuflen) || ((len + 4) > (selbuflen - selbufpos))) {
+		/* Grow by half to append in amortized constant time */
+		selbuflen = ALIGN_UP(MAX(selbuflen + (selbuflen >> 1), selbufpos + len + 4), PATH_MAX);
+		pselbuf = xrealloc(pselbuf, selbuflen);
+		if (!pselbuf)
+			errexit();
+	}
+
+	if (newdir) {
+		memcpy(pselbuf + selbufpos, path, dirlen);
+		pselbuf[selbufpos + dirlen] = '\0';
+		selbufdir = selbufpos + 1;
+		selbufpos += dirlen + 1;
+	}
+
+	selbufpos += xstrsncpy(pselbuf + selbufpos, name, len - dirlen);
+}
+
+static void selbufrealloc(const size_t alloclen)
+{
+	if ((selbufpos + alloclen) > selbuflen) {
+		selbuflen = ALIGN_UP(selbufpos + alloclen, PATH_MAX);
+		pselbuf = xrealloc(pselbuf, selbuflen);
+		if (!pselbuf)
+			errexit();
+	}
+}
+
+/* Write selected file paths to fd, separator separated, FALSE on error */
+static bool seltofile(int fd, uint_t *pcount, const char *separator)
+{
+	if (pcount)
+		*pcount = 0;
+
+	return !selbufpos || selwrite(fd, 0, 0, FALSE, *separator, TRUE, pcount, NULL);
+}
+
+/* List selection from selection file (another instance) */
+static bool listselfile(void)
+{
+	if (isselfileempty())
+		return FALSE;
+
+	snprintf(g_buf, CMD_LEN_MAX, "tr \'\\0\' \'\\n\' < '%s'", selpath);
+	spawn(utils[UTIL_SH_EXEC], g_buf, NULL, NULL, F_CLI | F_CONFIRM);
+
+	return TRUE;
+}
+
+static uint_t selhash(uint_t hash, const char *str)
+{
+	while (*str) /* FNV-1a */
+		hash = (hash ^ (uchar_t)*str++) * 16777619U;
+
+	return hash;
+}
+
+/* Hash of the path stored as the name at name under dir */
+static uint_t selnamehash(uint_t dir, uint_t name)
+{
+	return selhash(dir ? selhash(SELHASH_INIT, pselbuf + dir - 1) : SELHASH_INIT,
+		       pselbuf + name - 1);
+}
+
+/* The path stored as the name at name under dir is path */
+static bool selnameis(uint_t dir, uint_t name, const char *path)
+{
+	const char *str = dir ? pselbuf + dir - 1 : "";
+
+	while (*str)
+		if (*str++ != *path++)
+			return FALSE;
+
+	return !strcmp(pselbuf + name - 1, path);
+}
+
+/* Slot of a path in the selection index, or the free slot to add it in */
+static uint_t selidxslot(const char *path)
+{
+	uint_t i = selhash(SELHASH_INIT, path) & (selidxcap - 1);
+
+	while (pselidx[i].name && !selnameis(pselidx[i].dir, pselidx[i].name, path))
+		i = (i + 1) & (selidxcap - 1);
+
+	return i;
+}
+
+/* Add a path to the selection index, duplicates after the first are found later */
+static selslot *selidxput(uint_t dir, uint_t name)
+{
+	uint_t i = selnamehash(dir, name) & (selidxcap - 1);
+
+	while (pselidx[i].name)
+		i = (i + 1) & (selidxcap - 1);
+
+	pselidx[i].name = name;
+	pselidx[i].dir = dir;
+	pselidx[i].file = 0;
+	return &pselidx[i];
+}
+
+/* The index slot of the name at name under dir, NULL if it isn't indexed */
+static selslot *selidxat(uint_t dir, uint_t name)
+{
+	const uint_t mask = selidxcap - 1;
+
+	if (name > selidxend || !selidxcnt)
+		return NULL;
+
+	for (uint_t i = selnamehash(dir, name) & mask; pselidx[i].name; i = (i + 1) & mask)
+		if (pselidx[i].name == name)
+			return &pselidx[i];
+
+	return NULL;
+}
+
+static bool selidxgrow(void)
+{
+	uint_t cap = selidxcap ? selidxcap << 1 : SELIDX_INIT;
+	uint_t oldcap = selidxcap;
+	selslot *old = pselidx;
+
+	pselidx = calloc(cap, sizeof(selslot));
+	if (!pselidx) {
+		pselidx = old;
+		return FALSE;
+	}
+	selidxcap = cap;
+
+	/* Keep the order of duplicates */
+	for (uint_t i = 0; i < oldcap; ++i)
+		if (old[i].name && !old[(i - 1) & (oldcap - 1)].name)
+			for (uint_t j = i; old[j].name; j = (j + 1) & (oldcap - 1))
+				selidxput(old[j].dir, old[j].name)->file = old[j].file;
+
+	free(old);
+	return TRUE;
+}
+
+/* The selection buffer changed other than by appending, index it again when needed */
+static void selidxdrop(void)
+{
+	if (selidxcnt)
+		memset(pselidx, 0, selidxcap * sizeof(selslot));
+	selidxcnt = selidxend = selidxdir = 0;
+}
+
+/* The selection buffer was written anew or squeezed */
+static void selbufchanged(void)
+{
+	selidxdrop();
+	selsynced = 0;
+	seldead = 0;
+	selbufdir = 0;
+}
+
+/* Squeeze the deselected paths and the dirs left without any out of the selection buffer */
+static void selbufcompact(void)
+{
+	size_t pos, len, to = 0;
+	uint_t dir = 0, lastdir = 0;
+
+	for (pos = 0; pos < selbufpos; pos += len + 1) {
+		len = xstrlen(pselbuf + pos);
+		if (pselbuf[pos] == '/') {
+			dir = pos + 1;
+			continue;
+		}
+		if (!len)
+			continue;
+
+		/* The dir goes ahead of its first name, once for names in a row */
+		if (dir) {
+			if (!lastdir || strcmp(pselbuf + lastdir - 1, pselbuf + dir - 1)) {
+				memmove(pselbuf + to, pselbuf + dir - 1, xstrlen(pselbuf + dir - 1) + 1);
+				lastdir = to + 1;
+				to += xstrlen(pselbuf + to) + 1;
+			}
+			dir = 0;
+		}
+
+		memmove(pselbuf + to, pselbuf + pos, len + 1);
+		to += len + 1;
+	}
+
+	selbufpos = to;
+	selbufchanged();
+	selbufdir = lastdir;
+	if (findselpos)
+		findselpos = pselbuf;
+}
+
+/* Index the paths appended to the selection buffer, FALSE if out of memory */
+static bool selidxupdate(void)
+{
+	uint_t len;
+
+	if (selidxend > selbufpos)
+		selidxdrop();
+
+	for (; selidxend < selbufpos; selidxend += len + 1) {
+		len = xstrlen(pselbuf + selidxend);
+		if (pselbuf[selidxend] == '/') {
+			selidxdir = selidxend + 1;
+			continue;
+		}
+		if (!len) /* Deselected */
+			continue;
+
+		/* Keep the load under 1/2 */
+		if (((selidxcnt + 1) << 1) > selidxcap && !selidxgrow())
+			return FALSE;
+
+		selidxput(selidxdir, selidxend + 1);
+		++selidxcnt;
+	}
+
+	return TRUE;
+}
+
+/* Reset selection indicators */
+static void resetselind(void)
+{
+	for (int r = 0; r < ndents; ++r)
+		if (pdents[r].flags & FILE_SELECTED)
+			pdents[r].flags &= ~FILE_SELECTED;
+}
+
+static void startselection(void)
+{
+	if (!g_state.selmode) {
+		g_state.selmode = 1;
+		nselected = 0;
+
+		if (selbufpos) {
+			resetselind();
+			selbufpos = 0;
+			selbufchanged();
+			writesel();
+		}
+	}
+}
+
+static void clearselection(void)
 {
 	nselected = 0;
 	selbufpos = 0;
+	selbufchanged();
 	g_state.selmode = 0;
-	writesel(NULL, 0);
+	writesel();
+
+	/* Give back the memory of a large selection */
+	if (selbuflen > SELBUF_KEEP) {
+		free(pselbuf);
+		pselbuf = NULL;
+		selbuflen = 0;
+		free(pselidx);
+		pselidx = NULL;
+		selidxcap = 0;
+	}
+}
+
+/*
+ * Drop the name at off of path from the index before it's blanked, nothing
+ * moves. Return the offset + 1 of path in the selection file, 0 if unknown.
+ */
+static uint_t selidxremove(uint_t off, const char *path)
+{
+	const uint_t mask = selidxcap - 1;
+	uint_t i, j, ideal, file;
+
+	if (off >= selidxend || !selidxcnt)
+		return 0;
+
+	for (i = selhash(SELHASH_INIT, path) & mask; pselidx[i].name != off + 1; i = (i + 1) & mask)
+		if (!pselidx[i].name)
+			return 0;
+	file = pselidx[i].file;
+
+	/* Move back the paths after the hole in the probe sequence */
+	for (j = (i + 1) & mask; pselidx[j].name; j = (j + 1) & mask) {
+		ideal = selnamehash(pselidx[j].dir, pselidx[j].name) & mask;
+		if (((j - ideal) & mask) >= ((j - i) & mask)) {
+			pselidx[i] = pselidx[j];
+			i = j;
+		}
+	}
+	pselidx[i].name = pselidx[i].dir = pselidx[i].file = 0;
+	--selidxcnt;
+	return file;
+}
+
+/* A path is left under the dir at pos */
+static bool seldirlive(size_t pos)
+{
+	for (pos += xstrlen(pselbuf + pos) + 1; pos < selbufpos && pselbuf[pos] != '/'; ++pos)
+		if (pselbuf[pos])
+			return TRUE;
+
+	return FALSE;
 }
 
+/*
+ * Find g_sel of length len in the selection buffer from startpos.
+ * A len including the terminating NUL finds the name of a path,
+ * one without finds the first dir with the prefix that has paths.
+ */
 static char *findinsel(char *startpos, int len)
 {
 	if (!selbufpos)
-		return FALSE;
+		return NULL;
 
 	if (!startpos)
 		startpos = pselbuf;
 
+	if (len && !g_sel[len - 1]) {
+		size_t pos = startpos - pselbuf;
+		uint_t dir = 0;
+
+		if (selidxupdate()) {
+			uint_t off = selidxcnt ? pselidx[selidxslot(g_sel)].name : 0;
+
+			return (off && pselbuf + off - 1 >= startpos) ? pselbuf + off - 1 : NULL;
+		}
+
+		/* No memory for the index, startpos is a dir */
+		for (; pos < selbufpos; pos += xstrlen(pselbuf + pos) + 1) {
+			if (pselbuf[pos] == '/')
+				dir = pos + 1;
+			else if (pselbuf[pos] && selnameis(dir, pos + 1, g_sel))
+				return pselbuf + pos;
+		}
+		return NULL;
+	}
+
 	char *found = startpos;
 	size_t buflen = selbufpos - (startpos - pselbuf);
 
@@ -1925,20 +2926,35 @@ static char *findinsel(char *startpos, int len)
 		found = memmem(found, buflen - (found - startpos), g_sel, len);
 		if (!found)
 			return NULL;
-		if (found == startpos || *(found - 1) == '\0')
+		if ((found == startpos || *(found - 1) == '\0') && seldirlive(found - pselbuf))
 			return found;
-		found += len; /* We found g_sel as a substring of a path, move forward */
+		found += len; /* We found g_sel in a name or a dir left empty, move forward */
 		if (found >= startpos + buflen)
 			return NULL;
 	}
 }
 
-static int markcmp(const void *va, const void *vb)
+/*
+ * Deselect the path g_sel stored as name. It's blanked in the selection
+ * file too if it's there, the buffer and the file are squeezed once half
+ * of the buffer is blank.
+ */
+static void selbufblank(char *name)
 {
-	const selmark *ma = (selmark*)va;
-	const selmark *mb = (selmark*)vb;
+	const size_t len = xstrlen(name);
+	const uint_t file = selidxremove(name - pselbuf, g_sel);
 
-	return ma->startpos - mb->startpos;
+	if (selsynced > name - pselbuf && selpath) {
+		if (file && selfileblank(file - 1, xstrlen(g_sel)))
+			selfiledead += xstrlen(g_sel);
+		else
+			selsynced = 0;
+	}
+
+	memset(name, 0, len);
+	seldead += len;
+	if (seldead > selbufpos >> 1)
+		selbufcompact();
 }
 
 /* scanselforpath() must be called before calling this */
@@ -1957,20 +2973,13 @@ static inline void findmarkentry(size_t len, struct entry *dentp)
  */
 static void invertselbuf(const int pathlen)
 {
-	size_t len, endpos, shrinklen = 0, alloclen = 0;
+	size_t len, alloclen = 0;
 	char * const pbuf = g_sel + pathlen;
 	char *found;
-	int i, nmarked = 0, prev = 0;
 	struct entry *dentp;
-	selmark *marked = malloc(nselected * sizeof(selmark));
-
-	if (!marked) {
-		printwarn(NULL);
-		return;
-	}
 
 	/* First pass: inversion */
-	for (i = 0; i < ndents; ++i) {
+	for (int i = 0; i < ndents; ++i) {
 		dentp = &pdents[i];
 
 		/* Ensure off-screen entries are reconciled with selbuf before inversion. */
@@ -1981,20 +2990,8 @@ static void invertselbuf(const int pathlen)
 			len = pathlen + xstrsncpy(pbuf, dentp->name, NAME_MAX);
 			found = findinsel(findselpos, len);
 			if (found) {
-				if (findselpos == found)
-					findselpos += len;
-
-				if (nmarked && (found
-				    == (marked[nmarked - 1].startpos + marked[nmarked - 1].len)))
-					marked[nmarked - 1].len += len;
-				else {
-					marked[nmarked].startpos = found;
-					marked[nmarked].len = len;
-					++nmarked;
-				}
-
+				selbufblank(found);
 				--nselected;
-				shrinklen += len; /* buffer size adjustment */
 			} else {
 				dentp->flags |= FILE_SELECTED;
 				alloclen += pathlen + dentp->nlen;
@@ -2005,57 +3002,10 @@ static void invertselbuf(const int pathlen)
 		}
 	}
 
-	/*
-	 * Files marked for deselection could be found in arbitrary order.
-	 * Sort by appearance in selection buffer.
-	 * With entries sorted we can merge adjacent ones allowing us to
-	 * move them in a single go.
-	 */
-	qsort(marked, nmarked, sizeof(selmark), &markcmp);
-
-	/* Some files might be adjacent. Merge them into a single entry */
-	for (i = 1; i < nmarked; ++i) {
-		if (marked[i].startpos == marked[prev].startpos + marked[prev].len)
-			marked[prev].len += marked[i].len;
-		else
-			marked[++prev] = marked[i];
-	}
-
-	/*
-	 * Number of entries is increased by encountering a non-adjacent entry
-	 * After we finish the loop we should increment it once more.
-	 */
-
-	if (nmarked) /* Make sure there is something to deselect */
-		nmarked = prev + 1;
-
-	/* Using merged entries remove unselected chunks from selection buffer */
-	for (i = 0; i < nmarked; ++i) {
-		/*
-		 * found: points to where the current block starts
-		 *        variable is recycled from previous for readability
-		 * endpos: points to where the the next block starts
-		 *         area between the end of current block (found + len)
-		 *         and endpos is selected entries. This is what we are
-		 *         moving back.
-		 */
-		found = marked[i].startpos;
-		endpos = (i + 1 == nmarked ? selbufpos : marked[i + 1].startpos - pselbuf);
-		len = marked[i].len;
-
-		/* Move back only selected entries. No selected memory is moved twice */
-		memmove(found, found + len, endpos - (found + len - pselbuf));
-	}
-
-	free(marked);
-
-	/* Buffer size adjustment */
-	selbufpos -= shrinklen;
-
 	selbufrealloc(alloclen);
 
 	/* Second pass: append newly selected to buffer */
-	for (i = 0; i < ndents; ++i) {
+	for (int i = 0; i < ndents; ++i) {
 		if (pdents[i].flags & FILE_SELECTED) {
 			len = pathlen + xstrsncpy(pbuf, pdents[i].name, NAME_MAX);
 			appendfpath(g_sel, len);
@@ -2063,7 +3013,7 @@ static void invertselbuf(const int pathlen)
 		}
 	}
 
-	nselected ? writesel(pselbuf, selbufpos - 1) : clearselection();
+	nselected ? writesel() : clearselection();
 }
 
 /*
@@ -2075,7 +3025,6 @@ static void addtoselbuf(const int pathlen, int startid, int endid)
 	int i;
 	size_t len, alloclen = 0;
 	struct entry *dentp;
-	char *found;
 	char * const pbuf = g_sel + pathlen;
 
 	/* Remember current selection buffer position */
@@ -2084,15 +3033,9 @@ static void addtoselbuf(const int pathlen, int startid, int endid)
 
 		if (findselpos) {
 			len = pathlen + xstrsncpy(pbuf, dentp->name, NAME_MAX);
-			found = findinsel(findselpos, len);
-			if (found) {
+			if (findinsel(findselpos, len))
 				dentp->flags |= (FILE_SCANNED | FILE_SELECTED);
-				if (found == findselpos) {
-					findselpos += len;
-					if (findselpos == (pselbuf + selbufpos))
-						findselpos = NULL;
-				}
-			} else
+			else
 				alloclen += pathlen + dentp->nlen;
 		} else
 			alloclen += pathlen + dentp->nlen;
@@ -2109,7 +3052,7 @@ static void addtoselbuf(const int pathlen, int startid, int endid)
 		}
 	}
 
-	writesel(pselbuf, selbufpos - 1); /* Truncate NULL from end */
+	writesel();
 }
 
 /* Removes g_sel from selbuf */
@@ -2119,10 +3062,8 @@ static void rmfromselbuf(size_t len)
 	if (!found)
 		return;
 
-	memmove(found, found + len, selbufpos - (found + len - pselbuf));
-	selbufpos -= len;
-
-	nselected ? writesel(pselbuf, selbufpos - 1) : clearselection();
+	selbufblank(found);
+	nselected ? writesel() : clearselection();
 }
 
 static int scanselforpath(const char *path, bool getsize)
@@ -2147,6 +3088,59 @@ static int scanselforpath(const char *path, bool getsize)
 	return (findselpos ? off : 0);
 }
 
+/* Read the file at path whole, NUL-terminated */
+static char *readfile(const char *path, off_t *len)
+{
+	struct stat sb;
+	char *buf = NULL;
+	ssize_t n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd == -1 || fstat(fd, &sb) == -1 || !(buf = malloc(sb.st_size + 1))) {
+		printwarn(NULL);
+		if (fd != -1)
+			close(fd);
+		return NULL;
+	}
+
+	*len = 0;
+	while (*len < sb.st_size && (n = read(fd, buf + *len, sb.st_size - *len)) > 0)
+		*len += n;
+	close(fd);
+	buf[*len] = '\0';
+
+	return buf;
+}
+
+/*
+ * Replace the selection buffer with the paths in buf of count bytes, one
+ * per line, NUL-terminated. Lines not starting with '/' continue the path
+ * before them. Returns the number of paths.
+ */
+static int selbufload(char *buf, off_t count)
+{
+	int lines = 0;
+	off_t pos, start = 0;
+
+	selbufpos = 0;
+	selbufchanged();
+	if (count && buf[count - 1] == '\n')
+		buf[--count] = '\0';
+
+	for (pos = 0; pos <= count; ++pos) {
+		if (!buf[pos] || (buf[pos] == '\n' && buf[pos + 1] == '/')) {
+			buf[pos] = '\0';
+			if (pos > start) {
+				appendfpath(buf + start, pos - start + 1);
+				++lines;
+			}
+			start = pos + 1;
+		}
+	}
+
+	return lines;
+}
+
 /* Finish selection procedure before an operation */
 static void rmtmpfile(void)
 {
@@ -2159,7 +3153,8 @@ static void rmtmpfile(void)
 static void endselection(bool endselmode)
 {
 	int fd;
-	ssize_t count;
+	off_t count;
+	char *paths;
 	char buf[sizeof(patterns[P_REPLACE]) + PATH_MAX + (TMP_LEN_MAX << 1)];
 
 	if (endselmode && g_state.selmode)
@@ -2185,45 +3180,25 @@ static void endselection(bool endselmode)
 	snprintf(buf, sizeof(buf), patterns[P_REPLACE], listpath, listroot, g_tmpfpath);
 	spawn(utils[UTIL_SH_EXEC], buf, NULL, NULL, F_CLI);
 
-	fd = open(g_tmpfpath, O_RDONLY);
-	if (fd == -1) {
-		DPRINTF_S(strerror(errno));
-		printwarn(NULL);
-		rmtmpfile();
-		return;
-	}
-
-	count = read(fd, pselbuf, selbuflen);
-	if (count < 0) {
-		DPRINTF_S(strerror(errno));
-		printwarn(NULL);
-		if (close(fd) || unlink(g_tmpfpath)) {
-			DPRINTF_S(strerror(errno));
-		}
-		return;
-	}
-
-	if (close(fd) || unlink(g_tmpfpath)) {
-		DPRINTF_S(strerror(errno));
-		printwarn(NULL);
+	paths = readfile(g_tmpfpath, &count);
+	rmtmpfile();
+	if (!paths)
 		return;
-	}
 
-	selbufpos = count;
-	pselbuf[--count] = '\0';
-	for (--count; count > 0; --count)
-		if (pselbuf[count] == '\n' && pselbuf[count+1] == '/')
-			pselbuf[count] = '\0';
+	if (count)
+		selbufload(paths, count);
+	free(paths);
 
-	writesel(pselbuf, selbufpos - 1);
+	writesel();
 }
 
 /* Returns: 1 - success, 0 - none selected, -1 - other failure */
 static int editselection(bool allowemptysel)
 {
 	int ret = -1;
-	int fd, lines = 0;
-	ssize_t count;
+	int fd, lines;
+	off_t count;
+	char *paths;
 	struct stat sb;
 	time_t mtime;
 
@@ -2253,15 +3228,12 @@ static int editselection(bool allowemptysel)
 
 	spawn((cfg.waitedit ? enveditor : editor), g_tmpfpath, NULL, NULL, F_CLI);
 
-	fd = open(g_tmpfpath, O_RDONLY);
-	if (fd == -1) {
+	if (stat(g_tmpfpath, &sb)) {
 		DPRINTF_S(strerror(errno));
 		rmtmpfile();
 		return -1;
 	}
 
-	fstat(fd, &sb);
-
 	if (mtime == sb.st_mtime) {
 		DPRINTF_S("selection is not modified");
 		if (unlink(g_tmpfpath)) {
@@ -2272,48 +3244,28 @@ static int editselection(bool allowemptysel)
 		return 1;
 	}
 
-	if (allowemptysel)
-		selbufrealloc(sb.st_size);
-	else if (sb.st_size > selbufpos) {
-		DPRINTF_S("edited buffer larger than previous");
-		rmtmpfile();
-		goto emptyedit;
-	}
-
-	count = read(fd, pselbuf, selbuflen);
-	if (count < 0) {
-		DPRINTF_S(strerror(errno));
-		printwarn(NULL);
-		close(fd);
+	paths = readfile(g_tmpfpath, &count);
+	if (!paths) {
 		rmtmpfile();
 		goto emptyedit;
 	}
 
-	if (close(fd) || unlink(g_tmpfpath)) {
+	if (unlink(g_tmpfpath)) {
 		DPRINTF_S(strerror(errno));
 		printwarn(NULL);
+		free(paths);
 		goto emptyedit;
 	}
 
 	if (!count) {
 		ret = 1;
+		free(paths);
 		goto emptyedit;
 	}
 
 	resetselind();
-	selbufpos = count;
-	/* The last character should be '\n' */
-	pselbuf[--count] = '\0';
-	for (--count; count > 0; --count) {
-		/* Replace every '\n' that separates two paths */
-		if (pselbuf[count] == '\n' && pselbuf[count + 1] == '/') {
-			++lines;
-			pselbuf[count] = '\0';
-		}
-	}
-
-	/* Add a line for the last file */
-	++lines;
+	lines = selbufload(paths, count);
+	free(paths);
 
 	if (!allowemptysel && (lines > nselected)) {
 		DPRINTF_S("files added to selection");
@@ -2321,7 +3273,7 @@ static int editselection(bool allowemptysel)
 	}
 
 	nselected = lines;
-	writesel(pselbuf, selbufpos - 1);
+	writesel();
 
 	return 1;
 
@@ -2665,6 +3617,9 @@ static int spawn(char *command, char *arg1, char *arg2, char *arg3, ushort_t fla
 	if (arg3)
 		argv[index] = arg3;
 
+	/* The command may read the selection file */
+	selfilepack();
+
 	if (flag & F_NORMAL)
 		exitcurses();
 
@@ -2741,29 +3696,30 @@ static void opstr(char *buf, char *op)
 	snprintf(buf, CMD_LEN_MAX, "xargs -0 sh -c '%s \"$0\" \"$@\" . < /dev/tty' < '%s'", op, selpath);
 }
 
-static bool rmmulstr(char *buf, bool use_trash)
+static void rmmulstr(char *buf, char r, bool use_trash, const char *list)
 {
-	char r = confirm_force(TRUE, use_trash);
-	if (!r)
-		return FALSE;
-
 	if (!use_trash)
 		snprintf(buf, CMD_LEN_MAX, "xargs -0 sh -c 'rm -%cvr -- \"$0\" \"$@\" < /dev/tty' < '%s'",
-			 r, selpath);
+			 r, list);
 	else
 		snprintf(buf, CMD_LEN_MAX, "xargs -0 %s < '%s'",
-			 trashcmd, selpath);
-
-	return TRUE;
+			 trashcmd, list);
 }
 
-/* Returns TRUE if file is removed, else FALSE */
+/* TRUE if the file is removed or a job removes it */
 static bool xrm(char * const fpath, bool use_trash)
 {
 	char r = confirm_force(FALSE, use_trash);
 	if (!r)
 		return FALSE;
 
+	/* In a job unless rm prompts */
+	if (!use_trash && r == 'f' && jobs_room() && rm_job(fpath, xstrlen(fpath) + 1, fpath))
+		return TRUE;
+
+	if (use_trash && job_spawn("trash", fpath, NULL, trashcmd, fpath, NULL))
+		return TRUE;
+
 	if (!use_trash) {
 		char rm_opts[5] = "-vr\0";
 
@@ -2864,6 +3820,8 @@ finish:
 
 static bool cpmvrm_selection(enum action sel, char *path)
 {
+	bool use_trash;
+	char *list;
 	int r;
 
 	if ((sel == SEL_CP || sel == SEL_MV) && isselfileempty())
@@ -2880,11 +3838,18 @@ static bool cpmvrm_selection(enum action sel, char *path)
 		return FALSE;
 
 	switch (sel) {
-	case SEL_CP:
-		opstr(g_buf, cp);
-		break;
+	case SEL_CP: // fallthrough
 	case SEL_MV:
-		opstr(g_buf, mv);
+		/* In a job unless the advcpmv cp and mv are asked for */
+		if (strcmp(sel == SEL_CP ? cp : mv, sel == SEL_CP ? PROGRESS_CP : PROGRESS_MV) && jobs_room()) {
+			if (!copy_selection(path, sel == SEL_MV))
+				return FALSE;
+
+			clearselection();
+			return TRUE;
+		}
+
+		opstr(g_buf, sel == SEL_CP ? cp : mv);
 		break;
 	case SEL_CPMVAS:
 		r = get_input(messages[MSG_CP_MV_AS]);
@@ -2899,10 +3864,32 @@ static bool cpmvrm_selection(enum action sel, char *path)
 		}
 		break;
 	default: /* SEL_TRASH, SEL_RM_RF */
-		if (!rmmulstr(g_buf, trashcmd && (sel == SEL_TRASH))) {
+		use_trash = trashcmd && (sel == SEL_TRASH);
+		r = confirm_force(TRUE, use_trash);
+		if (!r) {
 			printmsg(messages[MSG_CANCEL]);
 			return FALSE;
 		}
+
+		/* In a job unless rm prompts */
+		if (!use_trash && r == 'f' && jobs_room()) {
+			if (!rm_selection())
+				return FALSE;
+
+			clearselection();
+			return TRUE;
+		}
+
+		if (use_trash && (list = job_list())) {
+			rmmulstr(g_buf, r, TRUE, list);
+			if (job_spawn("trash", NULL, list, utils[UTIL_SH_EXEC], g_buf, NULL)) {
+				clearselection();
+				return TRUE;
+			}
+			job_unlist(list);
+		}
+
+		rmmulstr(g_buf, r, use_trash, selpath);
 	}
 
 	if (sel != SEL_CPMVAS && spawn(utils[UTIL_SH_EXEC], g_buf, NULL, NULL, F_CLI | F_CHKRTN)) {
@@ -2913,6 +3900,12 @@ static bool cpmvrm_selection(enum action sel, char *path)
 	/* Clear selection */
 	clearselection();
 
+#ifndef NOX11
+	/* Show notification on operation complete */
+	if (cfg.x11)
+		plugscript(utils[UTIL_NTFY], F_NOWAIT | F_NOTRACE);
+#endif
+
 	return TRUE;
 }
 
@@ -2934,6 +3927,7 @@ static bool batch_rename(void)
 
 	if (i == 'c') { /* Rename entries in current dir */
 		selbufpos = 0;
+		selbufchanged();
 		dir = TRUE;
 	}
 
@@ -2958,8 +3952,10 @@ static bool batch_rename(void)
 	seltofile(fd2, NULL, NEWLINE);
 	close(fd2);
 
-	if (dir) /* Don't retain dir entries in selection */
+	if (dir) { /* Don't retain dir entries in selection */
 		selbufpos = 0;
+		selbufchanged();
+	}
 
 	spawn((cfg.waitedit ? enveditor : editor), g_tmpfpath, NULL, NULL, F_CLI);
 
@@ -3008,17 +4004,20 @@ static char *get_archive_cmd(const char *archive)
 	return archive_cmd[i];
 }
 
-static void archive_selection(const char *cmd, const char *archive)
+/* TRUE if a job makes the archive */
+static bool archive_selection(const char *cmd, const char *archive)
 {
 	size_t archive_esc_size = 0;
 	size_t selpath_esc_size = 0;
 	char *archive_esc = NULL;
 	char *selpath_esc = NULL;
+	char *list = job_list();
+	bool job = FALSE;
 	size_t len;
 	char *buf = NULL;
 
 	if (shell_escape(&archive_esc, &archive_esc_size, archive) < 0
-	    || shell_escape(&selpath_esc, &selpath_esc_size, selpath) < 0) {
+	    || shell_escape(&selpath_esc, &selpath_esc_size, list ? list : selpath) < 0) {
 		DPRINTF_S(strerror(errno));
 		printwarn(NULL);
 		goto cleanup;
@@ -3033,12 +4032,17 @@ static void archive_selection(const char *cmd, const char *archive)
 	}
 
 	snprintf(buf, len, patterns[P_ARCHIVE_CMD], cmd, archive_esc, selpath_esc);
-	spawn(utils[UTIL_SH_EXEC], buf, NULL, NULL, F_CLI | F_CONFIRM);
+	job = list && job_spawn("archive", archive, list, utils[UTIL_SH_EXEC], buf, NULL);
+	if (!job)
+		spawn(utils[UTIL_SH_EXEC], buf, NULL, NULL, F_CLI | F_CONFIRM);
 
 cleanup:
+	if (!job)
+		job_unlist(list);
 	free(buf);
 	free(archive_esc);
 	free(selpath_esc);
+	return job;
 }
 
 static void write_lastdir(const char *curpath, const char *outfile)
@@ -3228,101 +4232,198 @@ static inline wchar_t normalize_char(wchar_t c)
 }
 
 /*
- * Fuzzy match: check if all characters in filter appear in order in fname
- * Case-sensitivity is controlled by fnstrstr function pointer
- * Supports wide characters and Unicode
+ * ASCII fast path for the string and fuzzy filters
+ *
+ * Most file names are plain ASCII. For those, case folding and the
+ * space/underscore/hyphen normalization are single byte operations, so the
+ * filters can skip the wide char conversion and test 16 (SSE2) or 32 (AVX2)
+ * bytes at a time. Vector loads never cross the end of a name, the tail is
+ * checked byte by byte (also the fallback without SIMD support).
  */
-static int fuzzy_match(const char *filter, const char *fname)
+#ifdef SIMD_AVX2
+typedef __m256i vec_t;
+#define VEC_LEN          32
+#define vec_load(p)      _mm256_loadu_si256((const __m256i *)(p))
+#define vec_set1(c)      _mm256_set1_epi8((char)(c))
+#define vec_eq(a, b)     _mm256_cmpeq_epi8((a), (b))
+#define vec_gt(a, b)     _mm256_cmpgt_epi8((a), (b))
+#define vec_and(a, b)    _mm256_and_si256((a), (b))
+#define vec_andnot(a, b) _mm256_andnot_si256((a), (b))
+#define vec_or(a, b)     _mm256_or_si256((a), (b))
+#define vec_mask(a)      ((uint_t)_mm256_movemask_epi8(a))
+#elif defined(SIMD_SSE2)
+typedef __m128i vec_t;
+#define VEC_LEN          16
+#define vec_load(p)      _mm_loadu_si128((const __m128i *)(p))
+#define vec_set1(c)      _mm_set1_epi8((char)(c))
+#define vec_eq(a, b)     _mm_cmpeq_epi8((a), (b))
+#define vec_gt(a, b)     _mm_cmpgt_epi8((a), (b))
+#define vec_and(a, b)    _mm_and_si128((a), (b))
+#define vec_andnot(a, b) _mm_andnot_si128((a), (b))
+#define vec_or(a, b)     _mm_or_si128((a), (b))
+#define vec_mask(a)      ((uint_t)_mm_movemask_epi8(a))
+#endif
+
+#ifdef VEC_LEN
+/* Lowercase A-Z, bytes >= 0x80 are negative and never in range */
+static inline vec_t vec_fold(vec_t v)
 {
-	wchar_t filter_wcs[NAME_MAX], fname_wcs[NAME_MAX];
-	wchar_t *f, *n;
-	size_t filter_len, fname_len;
-	bool case_insensitive = (fnstrstr == &strcasestr);
+	const vec_t upper = vec_and(vec_gt(v, vec_set1('A' - 1)), vec_gt(vec_set1('Z' + 1), v));
 
-	/* Convert multi-byte strings to wide character strings */
-	filter_len = mbstowcs(filter_wcs, filter, NAME_MAX - 1);
-	if (filter_len == (size_t)-1)
-		return 0;
-	filter_wcs[filter_len] = L'\0';
+	return vec_or(v, vec_and(upper, vec_set1(0x20)));
+}
 
-	if (!filter_len)
-		return 1;
+/* Vector version of normalize_char() */
+static inline vec_t vec_norm(vec_t v)
+{
+	const vec_t sep = vec_or(vec_eq(v, vec_set1('_')), vec_eq(v, vec_set1('-')));
 
-	fname_len = mbstowcs(fname_wcs, fname, NAME_MAX - 1);
-	if (fname_len == (size_t)-1)
-		return 0;
-	fname_wcs[fname_len] = L'\0';
+	return vec_or(vec_andnot(sep, v), vec_and(sep, vec_set1(' ')));
+}
+#endif
 
-	/* Convert to lowercase if case-insensitive matching */
-	if (case_insensitive) {
-		for (size_t i = 0; i < filter_len; ++i)
-			filter_wcs[i] = towlower(filter_wcs[i]);
-		for (size_t i = 0; i < fname_len; ++i)
-			fname_wcs[i] = towlower(fname_wcs[i]);
-	}
+static inline uchar_t ascii_fold(uchar_t c, bool icase)
+{
+	return icase ? TOLOWER(c) : c;
+}
 
-	f = filter_wcs;
-	n = fname_wcs;
+static inline uchar_t ascii_norm(uchar_t c, bool icase)
+{
+	c = ascii_fold(c, icase);
+	return (c == '_' || c == '-') ? ' ' : c;
+}
 
-	/* Match characters in order */
-	while (*f && *n) {
-		if (normalize_char(*f) == normalize_char(*n))
-			++f;
-		++n;
-	}
+static bool is_ascii(const char *str, size_t len)
+{
+	size_t i = 0;
+
+#ifdef VEC_LEN
+	for (; i + VEC_LEN <= len; i += VEC_LEN)
+		if (vec_mask(vec_load(str + i)))
+			return FALSE;
+#endif
+	for (; i < len; ++i)
+		if ((uchar_t)str[i] & 0x80)
+			return FALSE;
 
-	return !*f;
+	return TRUE;
 }
 
-static int visible_re(const fltrexp_t *fltrexp, const char *fname)
+static bool ascii_memeq(const char *s1, const char *s2, size_t n, bool icase)
 {
-#ifdef PCRE2
-	int r = 0;
-	pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(fltrexp->pcre2x, NULL);
+	for (size_t i = 0; i < n; ++i)
+		if (ascii_fold(s1[i], icase) != ascii_fold(s2[i], icase))
+			return FALSE;
 
-	if (match_data) {
-		r = pcre2_match(fltrexp->pcre2x, (PCRE2_SPTR)fname, xstrlen(fname), 0, 0, match_data, NULL);
-		pcre2_match_data_free(match_data);
+	return TRUE;
+}
+
+/*
+ * Substring search on ASCII strings of known length
+ * Candidates are located by matching the first and the last byte of the
+ * needle at once across a vector, then verified byte by byte.
+ */
+static const char *ascii_strstr(const char *hay, size_t hlen, const char *needle, size_t nlen, bool icase)
+{
+	size_t i = 0;
+
+	if (!nlen)
+		return hay;
+
+	if (nlen > hlen)
+		return NULL;
+
+#ifdef VEC_LEN
+	const vec_t first = vec_set1(ascii_fold(needle[0], icase));
+	const vec_t tail = vec_set1(ascii_fold(needle[nlen - 1], icase));
+
+	for (; i + nlen - 1 + VEC_LEN <= hlen; i += VEC_LEN) {
+		vec_t vfirst = vec_load(hay + i);
+		vec_t vlast = vec_load(hay + i + nlen - 1);
+
+		if (icase) {
+			vfirst = vec_fold(vfirst);
+			vlast = vec_fold(vlast);
+		}
+
+		for (uint_t m = vec_mask(vec_and(vec_eq(vfirst, first), vec_eq(vlast, tail))); m; m &= m - 1) {
+			const char *pos = hay + i + __builtin_ctz(m);
+
+			if (nlen <= 2 || ascii_memeq(pos + 1, needle + 1, nlen - 2, icase))
+				return pos;
+		}
 	}
+#endif
+	for (; i + nlen <= hlen; ++i)
+		if (ascii_memeq(hay + i, needle, nlen, icase))
+			return hay + i;
 
-	return r > 0;
-#else
-	return regexec(fltrexp->regex, fname, 0, NULL, 0) == 0;
+	return NULL;
+}
+
+/* Return the index of the first normalized c at or after pos, len if not found */
+static size_t ascii_chr(const char *str, size_t pos, size_t len, uchar_t c, bool icase)
+{
+#ifdef VEC_LEN
+	const vec_t vc = vec_set1(c);
+
+	for (; pos + VEC_LEN <= len; pos += VEC_LEN) {
+		vec_t v = vec_load(str + pos);
+
+		if (icase)
+			v = vec_fold(v);
+
+		uint_t m = vec_mask(vec_eq(vec_norm(v), vc));
+
+		if (m)
+			return pos + __builtin_ctz(m);
+	}
 #endif
+	for (; pos < len; ++pos)
+		if (ascii_norm(str[pos], icase) == c)
+			return pos;
+
+	return len;
 }
 
-static int visible_str(const fltrexp_t *fltrexp, const char *fname)
+/* ASCII counterpart of fuzzy_match() */
+static bool ascii_subseq(const char *fname, size_t len, const char *filter, size_t flen, bool icase, uchar_t *pos)
 {
-	return fnstrstr(fname, fltrexp->str) != NULL;
+	for (size_t f = 0, n = 0; f < flen; ++f, ++n) {
+		n = ascii_chr(fname, n, len, ascii_norm(filter[f], icase), icase);
+		if (n == len)
+			return FALSE;
+		if (pos)
+			pos[f] = (uchar_t)n;
+	}
+
+	return TRUE;
 }
 
-#ifdef DIM_FILTERED
 /*
- * Get match positions for fuzzy matching
- * Populates matched array with 1 for matched bytes, 0 otherwise
+ * Fuzzy match: check if all characters in filter appear in order in fname
+ * Case-sensitivity is controlled by fnstrstr function pointer
+ * Supports wide characters and Unicode
+ * The matched wide char positions are saved in pos, if not NULL
  */
-static void fuzzy_match_positions(const char *filter, const char *fname, uchar_t *matched)
+static int fuzzy_match(const char *filter, const char *fname, uchar_t *pos)
 {
 	wchar_t filter_wcs[NAME_MAX], fname_wcs[NAME_MAX];
-	size_t filter_len, fname_len;
+	size_t filter_len, fname_len, f_idx, n_idx;
 	bool case_insensitive = (fnstrstr == &strcasestr);
-	size_t f_idx, n_idx;
-
-	/* Clear matched array */
-	memset(matched, 0, NAME_MAX);
 
 	/* Convert multi-byte strings to wide character strings */
 	filter_len = mbstowcs(filter_wcs, filter, NAME_MAX - 1);
 	if (filter_len == (size_t)-1)
-		return;
+		return 0;
 	filter_wcs[filter_len] = L'\0';
 
 	if (!filter_len)
-		return;
+		return 1;
 
 	fname_len = mbstowcs(fname_wcs, fname, NAME_MAX - 1);
 	if (fname_len == (size_t)-1)
-		return;
+		return 0;
 	fname_wcs[fname_len] = L'\0';
 
 	/* Convert to lowercase if case-insensitive matching */
@@ -3333,74 +4434,120 @@ static void fuzzy_match_positions(const char *filter, const char *fname, uchar_t
 			fname_wcs[i] = towlower(fname_wcs[i]);
 	}
 
-	f_idx = 0;
-	n_idx = 0;
-
-	/* Match characters in order and mark them */
-	while (f_idx < filter_len && n_idx < fname_len) {
+	/* Match characters in order */
+	for (f_idx = 0, n_idx = 0; f_idx < filter_len && n_idx < fname_len; ++n_idx) {
 		if (normalize_char(filter_wcs[f_idx]) == normalize_char(fname_wcs[n_idx])) {
-			/* Mark this wide character position as matched */
-			matched[n_idx] = 1;
+			if (pos)
+				pos[f_idx] = (uchar_t)n_idx;
 			++f_idx;
 		}
-		++n_idx;
 	}
+
+	return f_idx == filter_len;
 }
 
+#define FLTRPOS_NONE 0xFF
+#define FLTR_MATCHED(fc, id) ((fc)->mark[id] == (fc)->gen)
+
 /*
- * Get match positions for string matching (substring)
- * Populates matched array with 1 for matched bytes, 0 otherwise
+ * Filter results of recently seen listings: match set, fuzzy scores and
+ * the columns of the matches (when dimming) of each entry. Indexed by
+ * entry id so the data survives entry swaps and sorting. A listing read
+ * again with the same names in the same order gets the same ids, so the
+ * results are reused when a filtered directory is revisited or a filtered
+ * context is switched to.
  */
-static void string_match_positions(const char *filter, const char *fname, uchar_t *matched)
-{
-	const char *pos;
-	size_t filter_len, i;
+static fltrcache_t fltrcache[CTX_MAX];
+static fltrcache_t *pfc = fltrcache; /* Results of the current listing */
 
-	/* Clear matched array */
-	memset(matched, 0, NAME_MAX);
+/*
+ * Suffixes of the names of the current listing sorted ignoring ASCII case,
+ * sorted in a thread on demand. The names matching an ASCII string filter,
+ * or a literal regex, are a range of it.
+ */
+static nameidx_t *pnameidx;
+static size_t nameidxlen, nameidxcap;
+static int nameidxstate = -1; /* -1: not built, 0: not usable, 1: ready, 2: sorting */
+static bool nameidx_abort;
+static pthread_t nameidx_tid;
+static int *pidslot; /* Where each entry id is in pdents */
+static uint_t *pidseen; /* Matches taken in this run are set to idstamp */
+static uint_t idstamp;
+static int idcap;
 
-	filter_len = strlen(filter);
-	if (!filter_len)
-		return;
+#define FLTRPOS(fltrexp, ent) \
+	((fltrexp)->pos ? (fltrexp)->pos + ((size_t)(ent)->id * (fltrexp)->poslen) : NULL)
 
-	/* Find the substring */
-	pos = fnstrstr(fname, filter);
-	if (pos) {
-		/* Convert string to wide characters to track positions */
-		wchar_t fname_wcs[NAME_MAX];
-		size_t fname_wcs_len = mbstowcs(fname_wcs, fname, NAME_MAX - 1);
-		if (fname_wcs_len == (size_t)-1)
-			return;
+/* Save the columns of a substring match found at byte offset off */
+static void string_match_positions(const fltrexp_t *fltrexp, const char *fname, size_t off, bool ascii, uchar_t *pos)
+{
+	size_t col = off;
 
-		/* Find position in wide character string */
-		size_t matched_pos = 0;
-		const char *name_ptr = fname;
-		while (name_ptr < pos && matched_pos < fname_wcs_len) {
-			int mb_len = mblen(name_ptr, MB_LEN_MAX);
-			if (mb_len <= 0)
-				break;
-			name_ptr += mb_len;
-			++matched_pos;
-		}
+	if (!ascii) {
+		const char *ptr = fname;
 
-		/* Mark matched positions */
-		wchar_t filter_wcs[NAME_MAX];
-		size_t filter_wcs_len = mbstowcs(filter_wcs, filter, NAME_MAX - 1);
-		if (filter_wcs_len == (size_t)-1)
-			return;
+		for (col = 0; ptr < fname + off; ++col) {
+			int mb_len = mblen(ptr, MB_LEN_MAX);
 
-		for (i = 0; i < filter_wcs_len && matched_pos + i < NAME_MAX; ++i)
-			matched[matched_pos + i] = 1;
+			if (mb_len <= 0) {
+				pos[0] = FLTRPOS_NONE;
+				return;
+			}
+			ptr += mb_len;
+		}
 	}
+
+	for (uchar_t i = 0; i < fltrexp->poslen; ++i)
+		pos[i] = (uchar_t)(col + i);
 }
+
+static int visible_re(const fltrexp_t *fltrexp, const struct entry *ent)
+{
+#ifdef PCRE2
+	int r = 0;
+	pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(fltrexp->pcre2x, NULL);
+
+	if (match_data) {
+		r = pcre2_match(fltrexp->pcre2x, (PCRE2_SPTR)ent->name, ent->nlen - 1, 0, 0, match_data, NULL);
+		pcre2_match_data_free(match_data);
+	}
+
+	return r > 0;
+#else
+	return regexec(fltrexp->regex, ent->name, 0, NULL, 0) == 0;
 #endif
+}
+
+static int visible_str(const fltrexp_t *fltrexp, const struct entry *ent)
+{
+	const char *fname = ent->name, *match;
+	const size_t len = ent->nlen - 1;
+	const bool ascii = fltrexp->ascii && is_ascii(fname, len);
+
+	/* A case-sensitive search compares bytes, any encoding will do */
+	if (!fltrexp->icase || ascii)
+		match = ascii_strstr(fname, len, fltrexp->str, fltrexp->len, fltrexp->icase);
+	else
+		match = fnstrstr(fname, fltrexp->str);
+
+	if (match && fltrexp->pos)
+		string_match_positions(fltrexp, fname, match - fname, ascii, FLTRPOS(fltrexp, ent));
+
+	return match != NULL;
+}
 
-static int visible_fuzzy(const fltrexp_t *fltrexp, const char *fname)
+static int visible_fuzzy(const fltrexp_t *fltrexp, const struct entry *ent)
 {
-	return fuzzy_match(fltrexp->str, fname);
+	const size_t len = ent->nlen - 1;
+
+	if (fltrexp->ascii && is_ascii(ent->name, len))
+		return ascii_subseq(ent->name, len, fltrexp->str, fltrexp->len,
+				    fltrexp->icase, FLTRPOS(fltrexp, ent));
+
+	return fuzzy_match(fltrexp->str, ent->name, FLTRPOS(fltrexp, ent));
 }
 
-static int (*filterfn)(const fltrexp_t *fltr, const char *fname) = &visible_str;
+static int (*filterfn)(const fltrexp_t *fltr, const struct entry *ent) = &visible_str;
 static int (*entrycmpfn)(const void *va, const void *vb);
 static const char *fuzzy_sort_fltr;
 
@@ -3470,8 +4617,13 @@ static int fuzzyentrycmp(const void *va, const void *vb)
 	if (IS_DIR_OR_DIRLNK(pb) != IS_DIR_OR_DIRLNK(pa))
 		return IS_DIR_OR_DIRLNK(pb) ? 1 : -1;
 
-	sa = fuzzy_match_score(fuzzy_sort_fltr, pa->name);
-	sb = fuzzy_match_score(fuzzy_sort_fltr, pb->name);
+	if (fuzzy_sort_fltr) {
+		sa = fuzzy_match_score(fuzzy_sort_fltr, pa->name);
+		sb = fuzzy_match_score(fuzzy_sort_fltr, pb->name);
+	} else {
+		sa = pfc->score[pa->id];
+		sb = pfc->score[pb->id];
+	}
 
 	if (sa != sb)
 		return cfg.reverse ? (sa < sb ? 1 : -1) : (sa < sb ? -1 : 1);
@@ -3489,16 +4641,15 @@ static void clearfilter(void)
 	}
 }
 
-static int entrycmp(const void *va, const void *vb)
+/* Order of the entries by the settings in c, the preview thread passes its own */
+static int entrycmp_by(const struct entry *pa, const struct entry *pb, const settings *c,
+		       int (*namecmp)(const char * const s1, const char * const s2))
 {
-	const struct entry *pa = (pEntry)va;
-	const struct entry *pb = (pEntry)vb;
-
 	if (IS_DIR_OR_DIRLNK(pb) != IS_DIR_OR_DIRLNK(pa))
 		return IS_DIR_OR_DIRLNK(pb) ? 1 : -1;
 
 	/* Sort based on specified order */
-	if (cfg.timeorder) {
+	if (c->timeorder) {
 		if (pb->sec > pa->sec)
 			return 1;
 		if (pb->sec < pa->sec)
@@ -3508,17 +4659,17 @@ static int entrycmp(const void *va, const void *vb)
 			return 1;
 		if (pb->nsec < pa->nsec)
 			return -1;
-	} else if (cfg.sizeorder) {
+	} else if (c->sizeorder) {
 		if (pb->size > pa->size)
 			return 1;
 		if (pb->size < pa->size)
 			return -1;
-	} else if (cfg.blkorder) {
+	} else if (c->blkorder) {
 		if (pb->blocks > pa->blocks)
 			return 1;
 		if (pb->blocks < pa->blocks)
 			return -1;
-	} else if (cfg.extnorder && !IS_DIR_OR_DIRLNK(pb)) {
+	} else if (c->extnorder && !IS_DIR_OR_DIRLNK(pb)) {
 		char *extna = xextension(pa->name, pa->nlen - 1);
 		char *extnb = xextension(pb->name, pb->nlen - 1);
 
@@ -3535,8 +4686,21 @@ static int entrycmp(const void *va, const void *vb)
 				return ret;
 		}
 	}
+#ifndef NOUG
+	else if (c->ownerorder) {
+		int ret = ownercmp(pa->uid, pb->uid);
+
+		if (ret)
+			return ret;
+	}
+#endif
 
-	return namecmpfn(pa->name, pb->name);
+	return namecmp(pa->name, pb->name);
+}
+
+static int entrycmp(const void *va, const void *vb)
+{
+	return entrycmp_by((pEntry)va, (pEntry)vb, &cfg, namecmpfn);
 }
 
 static int reventrycmp(const void *va, const void *vb)
@@ -3570,63 +4734,383 @@ static inline int handle_event(void)
 	return CONTROL('L');
 }
 
-/*
- * Returns SEL_* if key is bound and 0 otherwise.
- * Also modifies the run and env pointers (used on SEL_{RUN,RUNARG}).
- * The next keyboard input can be simulated by presel.
- */
-static int nextsel(int presel)
+/* Monotonic time in nanoseconds */
+static ullong_t monotonic_ns(void)
 {
-	wint_t c = presel;
-	int i = 0;
-	bool escaped = FALSE;
-
-	if (c == 0 || c == MSGWAIT) {
-try_quit:
-		i = get_wch(&c);
-		//DPRINTF_D(c);
-		//DPRINTF_S(keyname(c));
+	struct timespec ts;
 
-#ifdef KEY_RESIZE
-		if (c == KEY_RESIZE)
-			handle_key_resize();
+	clock_gettime(
+#ifdef CLOCK_MONOTONIC_RAW
+	    CLOCK_MONOTONIC_RAW,
+#elif defined(CLOCK_MONOTONIC)
+	    CLOCK_MONOTONIC,
+#else
+	    CLOCK_REALTIME,
 #endif
+	    &ts);
 
-		/* Handle Alt+key */
-		if (c == ESC) {
-			timeout(0);
-			i = get_wch(&c);
-			if (i != ERR) {
-				if (c == ESC)
-					c = 'q'; /* Quit context */
-				else {
-					unget_wch(c);
-					c = ';';
-				}
-				settimeout();
-			} else if (escaped) {
-				settimeout();
-				c = CONTROL('Q');
-			} else {
-#ifndef NOFIFO
-				if (!g_state.fifomode)
-					notify_fifo(TRUE); /* Send hovered path to NNN_FIFO */
-#endif
-				escaped = TRUE;
-				settimeout();
-				goto try_quit;
-			}
-		}
+	return (ullong_t)ts.tv_sec * 1000000000 + (ullong_t)ts.tv_nsec;
+}
 
-		if (i == ERR && presel == MSGWAIT)
-			c = (cfg.filtermode || filterset()) ? FILTER : CONTROL('L');
-		else if (c == FILTER || c == CONTROL('L'))
-			/* Clear previous filter when manually starting */
-			clearfilter();
-	}
+static size_t get_fs_size(const struct statvfs *svb, uchar_t type)
+{
+	if (type == VFS_AVAIL)
+		return (size_t)svb->f_bavail << ffs((int)(svb->f_frsize >> 1));
 
-	if (i == ERR) {
-		++idle;
+	if (type == VFS_USED)
+		return ((size_t)svb->f_blocks - (size_t)svb->f_bfree) << ffs((int)(svb->f_frsize >> 1));
+
+	return (size_t)svb->f_blocks << ffs((int)(svb->f_frsize >> 1)); /* VFS_SIZE */
+}
+
+/* Runs detached so a hung mount blocks only its own slot */
+static void *fsinfo_worker(void *arg)
+{
+	fsinfo_t *fs = (fsinfo_t *)arg;
+	struct statvfs svb;
+	const bool ok = (statvfs(fs->path, &svb) == 0);
+
+	pthread_mutex_lock(&fsinfo_mutex);
+	fs->avail = ok ? get_fs_size(&svb, VFS_AVAIL) : 0;
+	fs->stamp = time(NULL);
+	fs->valid = TRUE;
+	fs->busy = FALSE;
+	pthread_mutex_unlock(&fsinfo_mutex);
+
+	return NULL;
+}
+
+/*
+ * Free space on the filesystem of the current dir in du mode without
+ * waiting for it. Shows "?" till the first result and "timeout" while
+ * the mount doesn't respond.
+ */
+static char *fsavail(const char *path)
+{
+	fsinfo_t *fs = NULL;
+	const ullong_t now = monotonic_ns();
+	char *ret = "?";
+	pthread_attr_t attr;
+	pthread_t tid;
+
+	pthread_mutex_lock(&fsinfo_mutex);
+
+	/* Reuse the least recently used slot, a hung mount keeps its own */
+	for (int i = 0; i < FSINFO_CACHE; ++i) {
+		if (fsinfos[i].used && fsinfos[i].dev == dirdev) {
+			fs = &fsinfos[i];
+			break;
+		}
+		if (!fsinfos[i].busy && (!fs || fsinfos[i].used < fs->used))
+			fs = &fsinfos[i];
+	}
+
+	if (fs && (!fs->used || fs->dev != dirdev)) {
+		fs->dev = dirdev;
+		fs->valid = FALSE;
+	}
+
+	if (fs) {
+		fs->used = now;
+
+		if (!fs->busy && (!fs->valid || time(NULL) - fs->stamp >= FSINFO_TTL)) {
+			xstrsncpy(fs->path, path, PATH_MAX);
+			fs->busy = TRUE;
+			fs->started = now;
+
+			pthread_attr_init(&attr);
+			pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+			if (pthread_create(&tid, &attr, fsinfo_worker, fs) == 0)
+				fswait = fs;
+			else
+				fs->busy = FALSE;
+			pthread_attr_destroy(&attr);
+		}
+
+		if (fs->busy && now - fs->started >= FSINFO_TIMEOUT_NS)
+			ret = "timeout";
+		else if (fs->valid)
+			ret = coolsize(fs->avail);
+	}
+
+	pthread_mutex_unlock(&fsinfo_mutex);
+
+	return ret;
+}
+
+/* The query the status bar waits for finished or timed out */
+static bool fsinfo_changed(void)
+{
+	bool ret;
+
+	pthread_mutex_lock(&fsinfo_mutex);
+	ret = !fswait->busy || (monotonic_ns() - fswait->started >= FSINFO_TIMEOUT_NS);
+	pthread_mutex_unlock(&fsinfo_mutex);
+
+	return ret;
+}
+
+#ifdef MAGIC
+static void *magic_worker(void *arg)
+{
+	char fpath[PATH_MAX];
+	struct stat sb;
+	magic_ent *ent;
+	const char *desc;
+
+	(void)arg;
+
+	pthread_mutex_lock(&magic_mutex);
+	while (1) {
+		while (!magicpending && !magicquit)
+			pthread_cond_wait(&magic_cond, &magic_mutex);
+		if (magicquit)
+			break;
+
+		xstrsncpy(fpath, magicreq, PATH_MAX);
+		magicpending = FALSE;
+		pthread_mutex_unlock(&magic_mutex);
+
+		desc = NULL;
+		ent = NULL;
+		if (lstat(fpath, &sb) == 0) {
+			ent = &magiccache[(sb.st_ino ^ ((ullong_t)sb.st_dev * 2654435761U)) & (MAGIC_CACHE - 1)];
+			if (ent->desc && ent->ino == sb.st_ino && ent->dev == sb.st_dev
+			    && ent->mtime == sb.st_mtime)
+				desc = ent->desc;
+		}
+
+		if (!desc) {
+			desc = magic_file(magiccookie, fpath);
+			if (desc && ent) {
+				free(ent->desc);
+				ent->desc = xstrdup(desc);
+				ent->dev = sb.st_dev;
+				ent->ino = sb.st_ino;
+				ent->mtime = sb.st_mtime;
+			} else if (!desc && !(desc = magic_error(magiccookie)))
+				desc = "?";
+		}
+
+		pthread_mutex_lock(&magic_mutex);
+		if (!magicpending) { /* Drop the result if there's a newer request */
+			magicnew = strcmp(magicpath, fpath) || strncmp(magicdesc, desc, MAGIC_DESC_MAX - 1);
+			xstrsncpy(magicpath, fpath, PATH_MAX);
+			xstrsncpy(magicdesc, desc, MAGIC_DESC_MAX);
+			magicdone = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&magic_mutex);
+
+	return NULL;
+}
+
+static bool magic_start(void)
+{
+	if (!magicinit) {
+		magicinit = -1;
+		magiccookie = magic_open(MAGIC_NONE);
+		if (!magiccookie)
+			return FALSE;
+
+		if (magic_load(magiccookie, NULL) == 0
+		    && pthread_create(&magic_tid, NULL, magic_worker, NULL) == 0)
+			magicinit = 1;
+		else {
+			magic_close(magiccookie);
+			magiccookie = NULL;
+		}
+	}
+
+	return magicinit == 1;
+}
+
+static void magic_stop(void)
+{
+	if (magicinit != 1)
+		return;
+
+	pthread_mutex_lock(&magic_mutex);
+	magicquit = TRUE;
+	pthread_cond_signal(&magic_cond);
+	pthread_mutex_unlock(&magic_mutex);
+	pthread_join(magic_tid, NULL);
+
+	magic_close(magiccookie);
+	for (int i = 0; i < MAGIC_CACHE; ++i)
+		free(magiccache[i].desc);
+}
+
+/*
+ * Queue the path for the detector thread. Returns the last file type
+ * of the same path meanwhile, NULL if there's none.
+ */
+static char *magic_get(const char *fpath)
+{
+	char *desc = NULL;
+
+	pthread_mutex_lock(&magic_mutex);
+	if (magicdesc[0] && !strcmp(magicpath, fpath)) {
+		xstrsncpy(g_buf, magicdesc, MAGIC_DESC_MAX);
+		desc = g_buf;
+	}
+	xstrsncpy(magicreq, fpath, PATH_MAX);
+	magicpending = magicwait = TRUE;
+	magicdone = magicnew = FALSE;
+	pthread_cond_signal(&magic_cond);
+	pthread_mutex_unlock(&magic_mutex);
+
+	return desc;
+}
+
+/* Show the file type if the detector is done, returns FALSE till then */
+static bool magic_show(void)
+{
+	bool done;
+
+	pthread_mutex_lock(&magic_mutex);
+	done = magicdone;
+	if (done) {
+		magicwait = FALSE;
+		if (magicnew && xcols > 3) {
+			mvhline(xlines - 2, 2, ' ', magicshown);
+			attron(COLOR_PAIR(cfg.curctx + 1));
+			magicshown = MIN((int)xstrlen(magicdesc), xcols - 3);
+			mvaddnstr(xlines - 2, 2, magicdesc, magicshown);
+			attroff(COLOR_PAIR(cfg.curctx + 1));
+		}
+	}
+	pthread_mutex_unlock(&magic_mutex);
+
+	return done;
+}
+#endif
+
+static inline bool asyncwait(void)
+{
+#ifdef MAGIC
+	if (magicwait)
+		return TRUE;
+#endif
+	return fswait || prevwait;
+}
+
+/* Read a key, shows the background results that come in meanwhile */
+static int getkey(wint_t *pc)
+{
+	int r, ms = 0;
+
+	if (!asyncwait()) {
+		r = get_wch(pc);
+		goto done;
+	}
+
+	timeout(ASYNC_POLL_MS);
+	while ((r = get_wch(pc)) == ERR && (ms += ASYNC_POLL_MS) < 1000) {
+#ifdef MAGIC
+		if (magicwait)
+			magic_show();
+#endif
+		if (fswait && fsinfo_changed()) {
+			fswait = NULL;
+			statusbar(g_ctx[cfg.curctx].c_path);
+		}
+
+		if (prevwait)
+			preview_show();
+
+		if (!asyncwait())
+			break;
+	}
+	settimeout();
+
+	if (r == ERR && ms < 1000)
+		r = get_wch(pc);
+done:
+	if (r != ERR && prefqueued) { /* The user is busy, stop working ahead */
+		prefqueued = FALSE;
+		prefetch_cancel();
+	}
+
+	return r;
+}
+
+/* Type of the hovered file, NULL if it's not known yet */
+static char *getfiletype(void)
+{
+#ifdef MAGIC
+	if (magic_start()) {
+		char fpath[PATH_MAX];
+		char *desc;
+
+		mkpath(g_ctx[cfg.curctx].c_path, pdents[cur].name, fpath);
+		desc = magic_get(fpath);
+		magicshown = desc ? MIN((int)xstrlen(desc), xcols - 3) : 0;
+		if (desc)
+			desc[MAX(magicshown, 0)] = '\0';
+		return desc;
+	}
+#endif
+	return get_output("file", "-b", pdents[cur].name, -1, FALSE) ? g_buf : NULL;
+}
+
+/*
+ * Returns SEL_* if key is bound and 0 otherwise.
+ * Also modifies the run and env pointers (used on SEL_{RUN,RUNARG}).
+ * The next keyboard input can be simulated by presel.
+ */
+static int nextsel(int presel)
+{
+	wint_t c = presel;
+	int i = 0;
+	bool escaped = FALSE;
+
+	if (c == 0 || c == MSGWAIT) {
+try_quit:
+		i = getkey(&c);
+		//DPRINTF_D(c);
+		//DPRINTF_S(keyname(c));
+
+#ifdef KEY_RESIZE
+		if (c == KEY_RESIZE)
+			handle_key_resize();
+#endif
+
+		/* Handle Alt+key */
+		if (c == ESC) {
+			timeout(0);
+			i = get_wch(&c);
+			if (i != ERR) {
+				if (c == ESC)
+					c = 'q'; /* Quit context */
+				else {
+					unget_wch(c);
+					c = ';';
+				}
+				settimeout();
+			} else if (escaped) {
+				settimeout();
+				c = CONTROL('Q');
+			} else {
+#ifndef NOFIFO
+				if (!g_state.fifomode)
+					notify_fifo(TRUE); /* Send hovered path to NNN_FIFO */
+#endif
+				escaped = TRUE;
+				settimeout();
+				goto try_quit;
+			}
+		}
+
+		if (i == ERR && presel == MSGWAIT)
+			c = (cfg.filtermode || filterset()) ? FILTER : CONTROL('L');
+		else if (c == FILTER || c == CONTROL('L'))
+			/* Clear previous filter when manually starting */
+			clearfilter();
+	}
+
+	if (i == ERR) {
+		++idle;
 
 		/*
 		 * Do not check for directory changes in du mode.
@@ -3657,6 +5141,11 @@ try_quit:
 				DPRINTF_S("inotify read done");
 			}
 		}
+#ifndef NOFIND
+		/* Keep the file name index up to date */
+		if (idle & 1)
+			fidx_update();
+#endif
 #elif defined(BSD_KQUEUE)
 		if (!cfg.blkorder && event_fd >= 0 && (idle & 1)) {
 			struct kevent event_data[NUM_EVENT_SLOTS] = {0};
@@ -3669,8 +5158,17 @@ try_quit:
 		if (!cfg.blkorder && haiku_nm_active && (idle & 1) && haiku_is_update_needed(haiku_hnd))
 			c = handle_event();
 #endif
-	} else
+		/* Show the progress of the jobs, reload after one ends */
+		if (njobs) {
+			if (jobs_poll() && !cfg.blkorder)
+				c = CONTROL('L');
+			else
+				showjobs();
+		}
+	} else {
 		idle = 0;
+		jobnote[0] = '\0'; /* Seen */
+	}
 
 	for (i = 0; i < (int)ELEMENTS(bindings); ++i)
 		if (c == bindings[i].sym)
@@ -3692,6 +5190,8 @@ static int getorderstr(char *sort)
 		sort[i++] = 'S';
 	else if (cfg.extnorder)
 		sort[i++] = 'E';
+	else if (cfg.ownerorder)
+		sort[i++] = 'O';
 
 	if (entrycmpfn == &reventrycmp)
 		sort[i++] = 'R';
@@ -3712,7 +5212,7 @@ static void showfilterinfo(void)
 
 	i = getorderstr(info);
 
-	if (cfg.fileinfo && ndents && get_output("file", "-b", pdents[cur].name, -1, FALSE))
+	if (cfg.fileinfo && ndents && getfiletype())
 		mvaddstr(xlines - 2, 2, g_buf);
 	else {
 		const char *mode = cfg.regex ? "reg" : (cfg.fuzzy ? "fzy" : "str");
@@ -3740,92 +5240,515 @@ static inline void swap_ent(int id1, int id2)
 	*pdent2 = *(&_dent);
 }
 
-#ifdef PCRE2
-static int fill(const char *fltr, pcre2_code *pcre2x)
-#else
-static int fill(const char *fltr, regex_t *re)
-#endif
+/* Pick the filter results slot of the listing just read in the current context */
+static void fltrcache_load(void)
 {
-#ifdef PCRE2
-	fltrexp_t fltrexp = { .pcre2x = pcre2x, .str = fltr };
-#else
-	fltrexp_t fltrexp = { .regex = re, .str = fltr };
-#endif
+	const char * const fltr = g_ctx[cfg.curctx].c_fltr + 1;
+	static ullong_t stamp;
+	ullong_t digest = 14695981039346656037ULL; /* FNV-1a */
+	fltrcache_t *fc, *oldest = fltrcache;
 
-	int count = 0;
+	/* Names are contiguous in read order */
+	for (const uchar_t *p = (uchar_t *)pnamebuf,
+	     *end = ndents ? (uchar_t *)pdents[ndents - 1].name + pdents[ndents - 1].nlen : p;
+	     p < end; ++p)
+		digest = (digest ^ *p) * 1099511628211ULL;
 
-	while (count < ndents) {
-		if (filterfn(&fltrexp, pdents[count].name) == 0) {
-			if (count != --ndents)
-				swap_ent(count, ndents);
-		} else
-			++count;
+	for (fc = fltrcache; fc < fltrcache + CTX_MAX; ++fc) {
+		if (fc->digest == digest && fc->nents == ndents && fc->fltr[0]
+		    && !strcmp(fc->fltr, fltr) && fc->regex == cfg.regex && fc->fuzzy == cfg.fuzzy)
+			break;
+
+		if (fc->stamp < oldest->stamp)
+			oldest = fc;
 	}
 
-	return ndents;
+	if (fc == fltrcache + CTX_MAX) {
+		fc = oldest;
+		fc->digest = digest;
+		fc->nents = ndents;
+		fc->fltr[0] = '\0';
+	}
+
+	fc->stamp = ++stamp;
+	pfc = fc;
 }
 
-static int matches(const char *fltr)
+/* Make room to save the results of all entries for a new filter */
+static bool fltrcache_prep(fltrcache_t *fc, const char *fltr, uchar_t **pos, uchar_t *poslen)
 {
-#ifdef PCRE2
-	pcre2_code *pcre2x = NULL;
+	fc->fltr[0] = '\0';
 
-	/* Search filter */
-	if (cfg.regex && setfilter(&pcre2x, fltr))
-		return -1;
+	if (fc->cap < total_dents) {
+		fc->cap = 0;
+		fc->score = xrealloc(fc->score, total_dents * sizeof(int));
+		if (!fc->score)
+			return FALSE;
+		fc->mark = xrealloc(fc->mark, total_dents * sizeof(uint_t));
+		if (!fc->mark)
+			return FALSE;
+		memset(fc->mark, 0, total_dents * sizeof(uint_t));
+		fc->cap = total_dents;
+		fc->gen = 0;
+	}
 
-	ndents = fill(fltr, pcre2x);
+	/* Earlier matches don't count */
+	if (!++fc->gen) {
+		memset(fc->mark, 0, fc->cap * sizeof(uint_t));
+		fc->gen = 1;
+	}
 
+	*pos = NULL;
+	fc->poslen = 0;
+#ifdef DIM_FILTERED
+	/* Regex matches are not dimmed */
 	if (cfg.regex)
-		pcre2_code_free(pcre2x);
-#else
-	regex_t re;
-
-	/* Search filter */
-	if (cfg.regex && setfilter(&re, fltr))
-		return -1;
+		return TRUE;
 
-	ndents = fill(fltr, &re);
+	size_t n = mbstowcs(NULL, fltr, 0);
 
-	if (cfg.regex)
-		regfree(&re);
-#endif
+	if (!n || n >= REGEX_MAX)
+		return TRUE;
 
-	if (cfg.fuzzy && fltr[0]) {
-		fuzzy_sort_fltr = fltr;
-		ENTSORT(pdents, ndents, fuzzyentrycmp);
-		fuzzy_sort_fltr = NULL;
-	} else
-		ENTSORT(pdents, ndents, entrycmpfn);
+	if ((size_t)total_dents * n > fc->poscap) {
+		fc->pos = xrealloc(fc->pos, (size_t)total_dents * n);
+		fc->poscap = fc->pos ? (size_t)total_dents * n : 0;
+		if (!fc->pos)
+			return TRUE;
+	}
 
-	return ndents;
+	*pos = fc->pos;
+	*poslen = fc->poslen = (uchar_t)n;
+#else
+	(void) fltr;
+	(void) poslen;
+#endif
+	return TRUE;
 }
 
-/*
- * Return the position of the matching entry or 0 otherwise
- * Note there's no NULL check for fname
- */
-static int dentfind(const char *fname, int n)
+/* Compare the first n bytes ignoring case, s1 can be shorter */
+static int ascii_memcmp_fold(const char *s1, const char *s2, size_t n)
 {
-	for (int i = 0; i < n; ++i)
-		if (xstrcmp(fname, pdents[i].name) == 0)
-			return i;
+	int c1, c2;
+
+	for (size_t i = 0; i < n; ++i) {
+		c1 = TOLOWER((uchar_t)s1[i]);
+		c2 = TOLOWER((uchar_t)s2[i]);
+		if (c1 != c2)
+			return c1 - c2;
+	}
 
 	return 0;
 }
 
-static int filterentries(char *path, char *lastname)
+#define NAMEIDX_CHAR(ent, depth) TOLOWER((uchar_t)pnamebuf[(ent)->off + (depth)])
+
+/* Compare two suffixes ignoring case from depth on */
+static int nameidxcmp(const nameidx_t *a, const nameidx_t *b, uint_t depth)
 {
-	alignas(max_align_t) wchar_t wln[REGEX_MAX];
-	char *ln = g_ctx[cfg.curctx].c_fltr;
-	wint_t ch[1];
-	int r, total = ndents, len;
-	char *pln = g_ctx[cfg.curctx].c_fltr + 1;
+	int c1, c2;
 
-	DPRINTF_S(__func__);
+	do {
+		c1 = NAMEIDX_CHAR(a, depth);
+		c2 = NAMEIDX_CHAR(b, depth);
+		++depth;
+	} while (c1 == c2 && c1);
 
-	if (ndents && (ln[0] == FILTER || ln[0] == RFILTER) && *pln) {
-		if (matches(pln) != -1) {
+	return c1 - c2;
+}
+
+/* Multikey quicksort, the suffixes of a range share depth chars */
+static void nameidx_sort(nameidx_t *idx, size_t n, uint_t depth)
+{
+	nameidx_t tmp;
+	size_t lt, gt, i;
+	int pivot, c;
+
+	while (n > 1) {
+		if (__atomic_load_n(&nameidx_abort, __ATOMIC_RELAXED))
+			return;
+
+		if (n < 16) {
+			for (i = 1; i < n; ++i) {
+				tmp = idx[i];
+				for (lt = i; lt && nameidxcmp(&idx[lt - 1], &tmp, depth) > 0; --lt)
+					idx[lt] = idx[lt - 1];
+				idx[lt] = tmp;
+			}
+			return;
+		}
+
+		tmp = idx[n >> 1];
+		idx[n >> 1] = idx[0];
+		idx[0] = tmp;
+		pivot = NAMEIDX_CHAR(&idx[0], depth);
+
+		/* [0, lt) < pivot, [lt, i) == pivot, (gt, n) > pivot */
+		for (lt = 0, i = 1, gt = n - 1; i <= gt;) {
+			c = NAMEIDX_CHAR(&idx[i], depth);
+			if (c < pivot) {
+				tmp = idx[lt];
+				idx[lt++] = idx[i];
+				idx[i++] = tmp;
+			} else if (c > pivot) {
+				tmp = idx[gt];
+				idx[gt--] = idx[i];
+				idx[i] = tmp;
+			} else
+				++i;
+		}
+
+		nameidx_sort(idx, lt, depth);
+		nameidx_sort(idx + i, n - i, depth);
+		if (!pivot) /* Whole suffixes are equal */
+			return;
+
+		idx += lt;
+		n = i - lt;
+		++depth;
+	}
+}
+
+static void *nameidx_worker(void *arg)
+{
+	(void) arg;
+
+	nameidx_sort(pnameidx, nameidxlen, 0);
+	if (!__atomic_load_n(&nameidx_abort, __ATOMIC_RELAXED))
+		__atomic_store_n(&nameidxstate, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/* Drop the index, the names are read again */
+static void nameidx_stop(void)
+{
+	if (__atomic_load_n(&nameidxstate, __ATOMIC_ACQUIRE) > 0) {
+		__atomic_store_n(&nameidx_abort, TRUE, __ATOMIC_RELAXED);
+		pthread_join(nameidx_tid, NULL);
+		nameidx_abort = FALSE;
+	}
+	nameidxstate = -1;
+}
+
+/* Index the listing if it's large enough to gain from it, TRUE if it's ready */
+static bool nameidx_ready(void)
+{
+	const int n = pfc->nents;
+	size_t len = 0;
+	int state = __atomic_load_n(&nameidxstate, __ATOMIC_ACQUIRE);
+
+	if (state >= 0)
+		return state == 1;
+
+	nameidxstate = 0;
+	if (n < NAMEIDX_MIN)
+		return FALSE;
+
+	for (int i = 0; i < n; ++i)
+		len += pdents[i].nlen - 1;
+	if (len > NAMEIDX_MAX)
+		return FALSE;
+
+	if (nameidxcap < len) {
+		nameidxcap = 0;
+		pnameidx = xrealloc(pnameidx, len * sizeof(nameidx_t));
+		if (!pnameidx)
+			return FALSE;
+		nameidxcap = len;
+	}
+
+	if (idcap < n) {
+		idcap = 0;
+		pidslot = xrealloc(pidslot, n * sizeof(int));
+		pidseen = xrealloc(pidseen, n * sizeof(uint_t));
+		if (!pidslot || !pidseen)
+			return FALSE;
+		idcap = n;
+	}
+	memset(pidseen, 0, n * sizeof(uint_t));
+	idstamp = 0;
+
+	/* ASCII bytes never occur inside UTF-8 sequences, fold them only */
+	nameidxlen = 0;
+	for (int i = 0; i < n; ++i) {
+		const struct entry *ent = &pdents[i];
+		const uint_t off = (uint_t)(ent->name - pnamebuf);
+
+		pidslot[ent->id] = i;
+		for (uint_t k = 0; k < (uint_t)ent->nlen - 1; ++k)
+			pnameidx[nameidxlen++] = (nameidx_t){ .off = off + k, .id = ent->id };
+	}
+
+	/* The names don't change until the next read, filter by scanning till then */
+	nameidxstate = 2;
+	if (pthread_create(&nameidx_tid, NULL, nameidx_worker, NULL))
+		nameidxstate = 0;
+	return FALSE;
+}
+
+/* Return the first suffix starting with str ignoring case, set *end past the last one */
+static size_t nameidx_range(const char *str, size_t len, size_t *end)
+{
+	size_t lo = 0, hi = nameidxlen, mid, first;
+	int c;
+
+	while (lo < hi) {
+		mid = lo + ((hi - lo) >> 1);
+		c = ascii_memcmp_fold(pnamebuf + pnameidx[mid].off, str, len);
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	first = lo;
+	hi = nameidxlen;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) >> 1);
+		c = ascii_memcmp_fold(pnamebuf + pnameidx[mid].off, str, len);
+		if (c <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*end = lo;
+	return first;
+}
+
+/* Where an entry is in pdents */
+static int nameidx_slot(uint_t id)
+{
+	int slot = pidslot[id];
+
+	/* Entries are moved around outside the filter too */
+	if (slot >= pfc->nents || pdents[slot].id != id) {
+		for (int i = 0; i < pfc->nents; ++i)
+			pidslot[pdents[i].id] = i;
+		slot = pidslot[id];
+	}
+
+	return slot;
+}
+
+/* Save the slots of the listed entries after a sort */
+static void nameidx_update(void)
+{
+	if (__atomic_load_n(&nameidxstate, __ATOMIC_RELAXED) > 0)
+		for (int i = 0; i < ndents; ++i)
+			pidslot[pdents[i].id] = i;
+}
+
+/* Move a listed entry to the matches if it passes the filter */
+static void nameidx_take(const fltrexp_t *fltrexp, fltrcache_t *fc, uint_t id, int *count)
+{
+	const int slot = nameidx_slot(id);
+
+	if (slot < *count || slot >= ndents || !filterfn(fltrexp, &pdents[slot]))
+		return;
+
+	fc->mark[id] = fc->gen;
+	fc->score[id] = 0;
+	if (slot != *count) {
+		swap_ent(slot, *count);
+		pidslot[pdents[slot].id] = slot;
+		pidslot[id] = *count;
+	}
+	++*count;
+}
+
+/* Length of the literal of a regex like lib or ^lib, 0 if it's not one */
+static size_t regex_literal(const char *fltr, bool *anchored)
+{
+	size_t len = 0;
+
+	*anchored = (fltr[0] == '^');
+	fltr += *anchored;
+
+	for (uchar_t c; (c = (uchar_t)fltr[len]); ++len)
+		if (!(xisdigit(c) || ((uint_t)(c | 0x20) - 'a' <= 'z' - 'a') || strchr("-_,@%=~:", c)))
+			return 0;
+
+	return len;
+}
+
+/*
+ * Filter the listed entries through the name index, -1 if it can't
+ * answer. Only the names matching the filter anywhere are visited.
+ */
+static int nameidx_fill(const fltrexp_t *fltrexp, fltrcache_t *fc)
+{
+	const char *str = fltrexp->str;
+	size_t len = fltrexp->len, first, end;
+	bool anchored = FALSE;
+	int count = 0;
+
+	if (cfg.fuzzy || !fltrexp->ascii || !len || !nameidx_ready())
+		return -1;
+
+	if (cfg.regex) {
+		len = regex_literal(str, &anchored);
+		if (!len)
+			return -1;
+		str += anchored;
+	}
+
+	/* A short filter may be in many names, the scan is faster then */
+	first = nameidx_range(str, len, &end);
+	if ((end - first) * 4 >= (size_t)ndents)
+		return -1;
+
+	if (!++idstamp) {
+		memset(pidseen, 0, pfc->nents * sizeof(uint_t));
+		idstamp = 1;
+	}
+
+	for (; first < end; ++first) {
+		const nameidx_t *sfx = &pnameidx[first];
+
+		if (anchored && sfx->off && pnamebuf[sfx->off - 1])
+			continue;
+
+		if (pidseen[sfx->id] != idstamp) {
+			pidseen[sfx->id] = idstamp;
+			nameidx_take(fltrexp, fc, sfx->id, &count);
+		}
+	}
+
+	return count;
+}
+
+#ifdef PCRE2
+static int fill(const char *fltr, pcre2_code *pcre2x)
+#else
+static int fill(const char *fltr, regex_t *re)
+#endif
+{
+#ifdef PCRE2
+	fltrexp_t fltrexp = { .pcre2x = pcre2x, .str = fltr, .len = xstrlen(fltr) };
+#else
+	fltrexp_t fltrexp = { .regex = re, .str = fltr, .len = xstrlen(fltr) };
+#endif
+
+	fltrcache_t * const fc = pfc;
+	int count = 0, r;
+	bool save;
+
+	fltrexp.ascii = is_ascii(fltr, fltrexp.len);
+	fltrexp.icase = (fnstrstr == &strcasestr);
+
+	/* Entries filtered out earlier are saved as such, a subset is fine */
+	if (fc->fltr[0] && !strcmp(fc->fltr, fltr) && fc->regex == cfg.regex
+	    && fc->fuzzy == cfg.fuzzy && fc->icase == fltrexp.icase) {
+		while (count < ndents) {
+			if (!FLTR_MATCHED(fc, pdents[count].id)) {
+				if (count != --ndents)
+					swap_ent(count, ndents);
+			} else
+				++count;
+		}
+
+		return ndents;
+	}
+
+	save = fltrcache_prep(fc, fltr, &fltrexp.pos, &fltrexp.poslen);
+
+	if (save && (r = nameidx_fill(&fltrexp, fc)) != -1) {
+		ndents = r;
+		count = ndents; /* Done */
+	}
+
+	while (count < ndents) {
+		r = filterfn(&fltrexp, &pdents[count]);
+		if (save && r) {
+			fc->mark[pdents[count].id] = fc->gen;
+			fc->score[pdents[count].id] = (cfg.fuzzy && *fltr)
+				? fuzzy_match_score(fltr, pdents[count].name) : 0;
+		}
+
+		if (r == 0) {
+			/* All entries are listed if none matches, no columns to dim */
+			if (fltrexp.pos)
+				*FLTRPOS(&fltrexp, &pdents[count]) = FLTRPOS_NONE;
+			if (count != --ndents)
+				swap_ent(count, ndents);
+		} else
+			++count;
+	}
+
+	if (save && *fltr) {
+		xstrsncpy(fc->fltr, fltr, REGEX_MAX);
+		fc->regex = cfg.regex;
+		fc->fuzzy = cfg.fuzzy;
+		fc->icase = fltrexp.icase;
+	}
+
+	return ndents;
+}
+
+static int matches(const char *fltr)
+{
+#ifdef PCRE2
+	pcre2_code *pcre2x = NULL;
+
+	/* Search filter */
+	if (cfg.regex && setfilter(&pcre2x, fltr))
+		return -1;
+
+	ndents = fill(fltr, pcre2x);
+
+	if (cfg.regex)
+		pcre2_code_free(pcre2x);
+#else
+	regex_t re;
+
+	/* Search filter */
+	if (cfg.regex && setfilter(&re, fltr))
+		return -1;
+
+	ndents = fill(fltr, &re);
+
+	if (cfg.regex)
+		regfree(&re);
+#endif
+
+	if (cfg.fuzzy && fltr[0]) {
+		/* Scores are saved with the results unless out of memory */
+		fuzzy_sort_fltr = pfc->fltr[0] ? NULL : fltr;
+		ENTSORT(pdents, ndents, fuzzyentrycmp);
+		fuzzy_sort_fltr = NULL;
+	} else
+		ENTSORT(pdents, ndents, entrycmpfn);
+
+	nameidx_update();
+	return ndents;
+}
+
+/*
+ * Return the position of the matching entry or 0 otherwise
+ * Note there's no NULL check for fname
+ */
+static int dentfind(const char *fname, int n)
+{
+	for (int i = 0; i < n; ++i)
+		if (xstrcmp(fname, pdents[i].name) == 0)
+			return i;
+
+	return 0;
+}
+
+static int filterentries(char *path, char *lastname)
+{
+	alignas(max_align_t) wchar_t wln[REGEX_MAX];
+	char *ln = g_ctx[cfg.curctx].c_fltr;
+	wint_t ch[1];
+	int r, total = ndents, len;
+	char *pln = g_ctx[cfg.curctx].c_fltr + 1;
+
+	DPRINTF_S(__func__);
+
+	if (ndents && (ln[0] == FILTER || ln[0] == RFILTER) && *pln) {
+		if (matches(pln) != -1) {
 			move_cursor(dentfind(lastname, ndents), 0);
 			redraw(path);
 		}
@@ -3891,8 +5814,10 @@ static int filterentries(char *path, char *lastname)
 			/* Go to the top, we don't know if the hovered file will match the filter */
 			cur = 0;
 
-			if (matches(pln) != -1)
+			if (matches(pln) != -1) {
+				g_state.move = 1;
 				redraw(path);
+			}
 
 			showfilter(ln);
 			continue;
@@ -4035,6 +5960,7 @@ static int filterentries(char *path, char *lastname)
 		 * case of such an error. However, we optimize for successful
 		 * cases where the dir has permissions. This skips a redraw().
 		 */
+		g_state.move = 1;
 		redraw(path);
 		showfilter(ln);
 	}
@@ -4439,10 +6365,12 @@ static char *getreadline(const char *prompt)
 static int xlink(char *prefix, char *path, char *curfname, char *buf, int type)
 {
 	int count = 0, choice;
-	char *psel = pselbuf, *fname;
-	size_t pos = 0, len, r;
+	char *name, *fname;
+	size_t pos = 0, r;
+	uint_t dir = 0;
 	int (*link_fn)(const char *, const char *) = NULL;
 	char lnpath[PATH_MAX];
+	char fpath[PATH_MAX];
 
 	choice = get_cur_or_sel();
 	if (!choice)
@@ -4460,8 +6388,12 @@ static int xlink(char *prefix, char *path, char *curfname, char *buf, int type)
 
 		if (choice == 'c')
 			mkpath(path, curfname, buf); /* Generate target file path */
+		else {
+			name = selnext(&pos, &dir);
+			selfullpath(fpath, dir, name);
+		}
 
-		if (!link_fn((choice == 'c') ? buf : pselbuf, lnpath)) {
+		if (!link_fn((choice == 'c') ? buf : fpath, lnpath)) {
 			if (choice == 's')
 				clearselection();
 			return 1; /* One link created */
@@ -4471,18 +6403,15 @@ static int xlink(char *prefix, char *path, char *curfname, char *buf, int type)
 
 	r = xstrsncpy(buf, prefix, NAME_MAX + 1); /* Copy prefix */
 
-	while (pos < selbufpos) {
-		len = xstrlen(psel);
-		fname = xbasename(psel);
+	while ((name = selnext(&pos, &dir))) {
+		fname = xbasename(name);
 
 		xstrsncpy(buf + r - 1, fname, NAME_MAX - r); /* Suffix target file name */
 		mkpath(path, buf, lnpath); /* Generate link path */
 
-		if (!link_fn(psel, lnpath))
+		selfullpath(fpath, dir, name);
+		if (!link_fn(fpath, lnpath))
 			++count;
-
-		pos += len + 1;
-		psel += len + 1;
 	}
 
 	if (count == nselected) /* Clear selection if all links are generated */
@@ -4607,34 +6536,113 @@ static char *unescape(const char *str, uint_t maxcols)
 	char *buf = wbuf;
 
 	xstrsncpy(wbuf, str, maxcols);
+
+	while (*buf) {
+		if (*buf <= '\x1f' || *buf == '\x7f')
+			*buf = '\?';
+
+		++buf;
+	}
+
+	return wbuf;
+}
 #else
-static wchar_t *unescape(const char *str, uint_t maxcols)
-{
-	wchar_t * const wbuf = (wchar_t *)g_buf;
-	wchar_t *buf = wbuf;
-	size_t len = mbstowcs(wbuf, str, maxcols); /* Convert multi-byte to wide char */
+/* Decode the name once per listing, invalid and non-printable chars are shown as '?' */
+static const wname_t *getwname(const struct entry *ent)
+{
+	static wchar_t sname[NAME_MAX + 1]; /* Out of memory */
+	static ushort_t scols[NAME_MAX + 1];
+	static wname_t scratch = { sname, scols, 0, 0, NAME_MAX };
+	wname_t *wn = &scratch;
+	const char *str = ent->name;
+	size_t len = ent->nlen - 1, n;
+	mbstate_t mbs;
+	wchar_t wc;
+	int w;
+	uint_t i;
+
+	if (ent->id >= (uint_t)wnamecap && total_dents > wnamecap) {
+		wname_t *tmp = realloc(pwnames, total_dents * sizeof(wname_t));
+
+		if (tmp) {
+			memset(tmp + wnamecap, 0, (total_dents - wnamecap) * sizeof(wname_t));
+			pwnames = tmp;
+			wnamecap = total_dents;
+		} else {
+			/* Decode in scratch, drop the names decoded so far */
+			for (int j = 0; j < wnamecap; ++j)
+				free(pwnames[j].name);
+			free(pwnames);
+			pwnames = NULL;
+			wnamecap = 0;
+		}
+	}
+
+	if (ent->id < (uint_t)wnamecap) {
+		wn = &pwnames[ent->id];
+		if (wn->gen == dentgen)
+			return wn;
+
+		/* A name has at most as many wide chars as bytes */
+		if (wn->cap < len) {
+			wn->name = xrealloc(wn->name, (len + 1) * (sizeof(wchar_t) + sizeof(ushort_t)));
+			if (!wn->name) {
+				wn->cap = 0;
+				wn = &scratch;
+			} else {
+				wn->cols = (ushort_t *)(wn->name + len + 1);
+				wn->cap = (ushort_t)len;
+			}
+		}
+	}
 
-	len = wcswidth(wbuf, len);
+	memset(&mbs, 0, sizeof(mbs));
+	wn->cols[0] = 0;
 
-	if (len >= maxcols) {
-		size_t lencount = maxcols;
+	for (i = 0; len && i < wn->cap; ++i, str += n, len -= n) {
+		n = mbrtowc(&wc, str, len, &mbs);
+		if (n == (size_t)-1 || n == (size_t)-2 || !n) {
+			memset(&mbs, 0, sizeof(mbs));
+			wc = L'?';
+			n = 1;
+		}
 
-		while (len > maxcols) /* Reduce wide chars one by one till it fits */
-			len = wcswidth(wbuf, --lencount);
+		w = wcwidth(wc);
+		if (w < 0) {
+			wc = L'?';
+			w = 1;
+		}
 
-		wbuf[lencount] = L'\0'; // NOLINT
+		wn->name[i] = wc;
+		wn->cols[i + 1] = (ushort_t)(wn->cols[i] + w);
 	}
-#endif
 
-	while (*buf) {
-		if (*buf <= '\x1f' || *buf == '\x7f')
-			*buf = '\?';
+	wn->name[i] = L'\0';
+	wn->len = (ushort_t)i;
+	wn->gen = dentgen;
+	return wn;
+}
 
-		++buf;
+static wchar_t *unescape(const struct entry *ent, uint_t maxcols)
+{
+	wchar_t * const wbuf = (wchar_t *)g_buf;
+	const wname_t *wn = getwname(ent);
+	uint_t lo = 0, hi = MIN(wn->len, maxcols), mid;
+
+	/* Longest prefix that fits in maxcols columns */
+	while (lo < hi) {
+		mid = (lo + hi + 1) >> 1;
+		if (wn->cols[mid] <= maxcols)
+			lo = mid;
+		else
+			hi = mid - 1;
 	}
 
+	wmemcpy(wbuf, wn->name, lo);
+	wbuf[lo] = L'\0';
 	return wbuf;
 }
+#endif
 
 static off_t get_size(off_t size, off_t *pval, int comp)
 {
@@ -4754,26 +6762,47 @@ static char *get_lsperms(mode_t mode)
 }
 
 #ifdef ICONS_ENABLED
-static struct icon get_icon(const struct entry *ent)
+/*
+ * Match a file name against icons_name and icons_ext, done once at scan time.
+ * Returns 1 + index in icons_name, ELEMENTS(icons_name) + 1 + slot in
+ * icons_ext or 0 if there's no match.
+ */
+static ushort_t icon_match(const char *name, size_t len)
 {
-	for (size_t i = 0; i < ELEMENTS(icons_name); ++i)
-		if (strcasecmp(ent->name, icons_name[i].match) == 0)
-			return (struct icon){ icons_name[i].icon, icons_name[i].color };
+	uint_t k = icons_name_idx[icon_name_hash(name)];
 
-	if (ent->flags & DIR_OR_DIRLNK)
-		return dir_icon;
+	if (k && strcasecmp(name, icons_name[k - 1].match) == 0)
+		return (ushort_t)k;
 
-	char *tmp = xextension(ent->name, ent->nlen);
+	const char *tmp = xextension(name, len);
 
 	if (tmp) {
-		uint16_t z, k, h = icon_ext_hash(++tmp); /* ++tmp to skip '.' */
+		uint16_t z, h = icon_ext_hash(++tmp); /* ++tmp to skip '.' */
 		for (k = 0; k < ICONS_PROBE_MAX; ++k) {
 			z = (h + k) % ELEMENTS(icons_ext);
 			if (strcasecmp(tmp, icons_ext[z].match) == 0)
-				return (struct icon){ icons_ext_uniq[icons_ext[z].idx], icons_ext[z].color };
+				return (ushort_t)(ELEMENTS(icons_name) + 1 + z);
 		}
 	}
 
+	return 0;
+}
+
+static struct icon get_icon(const struct entry *ent)
+{
+	uint_t k = ent->icon;
+
+	if (k && k <= ELEMENTS(icons_name))
+		return (struct icon){ icons_name[k - 1].icon, icons_name[k - 1].color };
+
+	if (ent->flags & DIR_OR_DIRLNK)
+		return dir_icon;
+
+	if (k) {
+		k -= ELEMENTS(icons_name) + 1;
+		return (struct icon){ icons_ext_uniq[icons_ext[k].idx], icons_ext[k].color };
+	}
+
 	/* If there's no match and the file is executable, icon that */
 	if (ent->mode & 0100)
 		return exec_icon;
@@ -4797,19 +6826,15 @@ static void print_icon(const struct entry *ent, const int attrs)
 }
 #endif
 
-static void print_time(const time_t *timep, const uchar_t flags)
+static void print_time(const entdtl_t *dtl)
 {
-	struct tm t;
-
 	/* Highlight timestamp for entries 5 minutes young */
-	if (flags & FILE_YOUNG)
+	if (dtl->flags & FILE_YOUNG)
 		attron(A_REVERSE);
 
-	localtime_r(timep, &t);
-	printw("%s-%02d-%02d %02d:%02d",
-		xitoa(t.tm_year + 1900), t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min);
+	addstr(dtl->time);
 
-	if (flags & FILE_YOUNG)
+	if (dtl->flags & FILE_YOUNG)
 		attroff(A_REVERSE);
 }
 
@@ -4881,88 +6906,115 @@ static uchar_t get_color_pair_name_ind(const struct entry *ent, char *pind, int
 	return C_UND;
 }
 
-#ifdef DIM_FILTERED
-static void printent_name(const struct entry *ent, uint_t namecols)
+/* Return the formatted details of an entry, formatting them again only if they changed */
+static const entdtl_t *getdtl(const struct entry *ent)
+{
+	static entdtl_t scratch; /* Out of memory */
+	entdtl_t *dtl = &scratch;
+	const off_t size = cfg.blkorder ? (off_t)ent->blocks << blk_shift : ent->size;
+	const uchar_t key = 1 | (g_state.oldcolor << 1) | (g_state.dirctx << 2)
+			    | (cfg.showdetail << 3) | (!ent->size << 4) | (cfg.curctx << 5);
+	const int type = ent->mode & S_IFMT;
+	struct tm t;
+
+	if (ent->id >= (uint_t)dtlcap && total_dents > dtlcap) {
+		pdtls = xrealloc(pdtls, total_dents * sizeof(entdtl_t));
+		if (pdtls)
+			memset(pdtls + dtlcap, 0, (total_dents - dtlcap) * sizeof(entdtl_t));
+		dtlcap = pdtls ? total_dents : 0;
+	}
+
+	if (ent->id < (uint_t)dtlcap)
+		dtl = &pdtls[ent->id];
+
+	if (dtl->key == key && dtl->sec == ent->sec && dtl->size == size
+	    && dtl->mode == ent->mode && dtl->flags == ent->flags)
+		return dtl;
+
+	dtl->key = key;
+	dtl->sec = ent->sec;
+	dtl->size = size;
+	dtl->mode = ent->mode;
+	dtl->flags = ent->flags;
+
+	localtime_r(&ent->sec, &t);
+	snprintf(dtl->time, sizeof(dtl->time), "%s-%02u-%02u %02u:%02u", xitoa(t.tm_year + 1900),
+		 (uchar_t)(t.tm_mon + 1), (uchar_t)t.tm_mday, (uchar_t)t.tm_hour, (uchar_t)t.tm_min);
+
+	if (type == S_IFREG || type == S_IFDIR) {
+		const char *str = coolsize(size);
+
+		snprintf(dtl->info, sizeof(dtl->info), "  %c%c%c%9s ", '0' + ((ent->mode >> 6) & 7),
+			 '0' + ((ent->mode >> 3) & 7), '0' + (ent->mode & 7), str);
+		dtl->szoff = (uchar_t)(sizeof(dtl->info) - 2 - xstrlen(str));
+	} else {
+		snprintf(dtl->info, sizeof(dtl->info), "  %c%c%c%9c ", '0' + ((ent->mode >> 6) & 7),
+			 '0' + ((ent->mode >> 3) & 7), '0' + (ent->mode & 7), get_detail_ind(ent->mode));
+		dtl->szoff = 0;
+	}
+
+	dtl->ind = '\0';
+	dtl->attrs = 0;
+	dtl->color = get_color_pair_name_ind(ent, &dtl->ind, &dtl->attrs);
+
+	return dtl;
+}
+
+#ifdef DIM_FILTERED
+/* Return the saved filter match columns of an entry, NULL if there's nothing to dim */
+static const uchar_t *get_fltrpos(const struct entry *ent)
 {
 	char * const fltr = g_ctx[cfg.curctx].c_fltr;
+	const uchar_t *pos;
 
-	/* If there's a filter string, dim matching characters */
-	if (fltr[1]) {
-		uchar_t matched[NAME_MAX] = {0};
-		int match_attrs = A_DIM;
+	/* Regex matches are not dimmed */
+	if (!fltr[1] || !pfc->poslen || strcmp(fltr + 1, pfc->fltr) || !FLTR_MATCHED(pfc, ent->id))
+		return NULL;
 
-		/* Get match positions based on filter type */
-		if (cfg.regex) {
-			/* For regex, we don't dim - just print normally */
-#ifndef NOLC
-			addwstr(unescape(ent->name, namecols));
-#else
-			addstr(unescape(ent->name, MIN(namecols, ent->nlen) + 1));
-#endif
-		} else if (cfg.fuzzy) {
-			/* Get fuzzy match positions */
-			fuzzy_match_positions(fltr + 1, ent->name, matched);
+	pos = pfc->pos + ((size_t)ent->id * pfc->poslen);
+	return (*pos == FLTRPOS_NONE) ? NULL : pos;
+}
+
+static void printent_name(const struct entry *ent, uint_t namecols)
+{
+	/* If there's a filter string, dim matching characters */
+	const uchar_t *pos = get_fltrpos(ent);
 #ifndef NOLC
-			wchar_t * const wbuf = unescape(ent->name, namecols);
-			uint_t col = 0;
-			for (wchar_t *p = wbuf; *p && col < namecols; ++p, ++col) {
-				if (matched[col]) {
-					attron(match_attrs);
-					addnwstr(p, 1);
-					attroff(match_attrs);
-				} else {
-					addnwstr(p, 1);
-				}
-			}
+	wchar_t * const name = unescape(ent, namecols);
 #else
-			/* Non-wide character version for fuzzy dimming */
-			const char *name = unescape(ent->name, MIN(namecols, ent->nlen) + 1);
-			for (uint_t i = 0; (i < namecols) && name[i]; ++i) {
-				if (matched[i]) {
-					attron(match_attrs);
-					addch(name[i]);
-					attroff(match_attrs);
-				} else {
-					addch(name[i]);
-				}
-			}
+	char * const name = unescape(ent->name, MIN(namecols, ent->nlen) + 1);
 #endif
-		} else {
-			/* String match - dim the substring */
-			string_match_positions(fltr + 1, ent->name, matched);
+
+	if (!pos) {
 #ifndef NOLC
-			wchar_t * const wbuf = unescape(ent->name, namecols);
-			uint_t col = 0;
-			for (wchar_t *p = wbuf; *p && col < namecols; ++p, ++col) {
-				if (matched[col]) {
-					attron(match_attrs);
-					addnwstr(p, 1);
-					attroff(match_attrs);
-				} else {
-					addnwstr(p, 1);
-				}
-			}
+		addwstr(name);
 #else
-			/* Non-wide character version for string dimming */
-			const char *name = unescape(ent->name, MIN(namecols, ent->nlen) + 1);
-			for (uint_t i = 0; (i < namecols) && name[i]; ++i) {
-				if (matched[i]) {
-					attron(match_attrs);
-					addch(name[i]);
-					attroff(match_attrs);
-				} else {
-					addch(name[i]);
-				}
-			}
+		addstr(name);
 #endif
+		return;
+	}
+
+	/* Print alternate runs of unmatched and matched chars, columns are in ascending order */
+	for (uint_t col = 0, end, k = 0; name[col] && col < namecols; col = end) {
+		const bool dim = (k < pfc->poslen) && (pos[k] == col);
+
+		for (end = col; name[end] && end < namecols; ++end) {
+			const bool matched = (k < pfc->poslen) && (pos[k] == end);
+
+			if (matched != dim)
+				break;
+			k += matched;
 		}
-	} else {
-		/* No filter or filter not active - print normally */
+
+		if (dim)
+			attron(A_DIM);
 #ifndef NOLC
-		addwstr(unescape(ent->name, namecols));
+		addnwstr(name + col, end - col);
 #else
-		addstr(unescape(ent->name, MIN(namecols, ent->nlen) + 1));
+		addnstr(name + col, end - col);
 #endif
+		if (dim)
+			attroff(A_DIM);
 	}
 }
 #else
@@ -4970,7 +7022,7 @@ static void printent_name(const struct entry *ent, uint_t namecols)
 static inline void printent_name(const struct entry *ent, uint_t namecols)
 {
 #ifndef NOLC
-	addwstr(unescape(ent->name, namecols));
+	addwstr(unescape(ent, namecols));
 #else
 	addstr(unescape(ent->name, MIN(namecols, ent->nlen) + 1));
 #endif
@@ -4980,15 +7032,11 @@ static inline void printent_name(const struct entry *ent, uint_t namecols)
 static void printent(int pdents_index, uint_t namecols, bool sel)
 {
 	const struct entry *ent = &pdents[pdents_index];
-	char ind = '\0';
+	const entdtl_t *dtl = getdtl(ent);
+	const char ind = dtl->ind;
 	int attrs;
 
 	if (cfg.showdetail) {
-		int type = ent->mode & S_IFMT;
-		char perms[6] = {' ', ' ', (char)('0' + ((ent->mode >> 6) & 7)),
-				(char)('0' + ((ent->mode >> 3) & 7)),
-				(char)('0' + (ent->mode & 7)), '\0'};
-
 		addch(' ');
 		attrs = g_state.oldcolor ? (resetdircolor(ent->flags), A_DIM)
 					 : (fcolors[C_MIS] ? COLOR_PAIR(C_MIS) : 0);
@@ -4996,11 +7044,12 @@ static void printent(int pdents_index, uint_t namecols, bool sel)
 			attron(attrs);
 
 		/* Print details */
-		print_time(&ent->sec, ent->flags);
-
-		printw("%s%9s ", perms, (type == S_IFREG || type == S_IFDIR)
-			? coolsize(cfg.blkorder ? (blkcnt_t)ent->blocks << blk_shift : ent->size)
-			: (type = (uchar_t)get_detail_ind(ent->mode), (char *)&type));
+		print_time(dtl);
+		addstr(dtl->info);
+#ifndef NOUG
+		if (g_state.uidgid)
+			printw("%-*.*s ", ownerw, ownerw, getpwname(ent->uid));
+#endif
 
 		if (attrs)
 			attroff(attrs);
@@ -5011,9 +7060,9 @@ static void printent(int pdents_index, uint_t namecols, bool sel)
 		printw(rel_num == 0 ? "%4td" : "%+4td", rel_num);
 	}
 
-	attrs = 0;
+	attrs = dtl->attrs;
 
-	uchar_t color_pair = get_color_pair_name_ind(ent, &ind, &attrs);
+	uchar_t color_pair = dtl->color;
 
 	addch((ent->flags & FILE_SELECTED) ? '+' | A_REVERSE | A_BOLD : ' ');
 
@@ -5314,6 +7363,8 @@ static bool get_output(char *command, char *arg1, char *arg2, int fdout, bool pa
 		return ret;
 	}
 
+	selfilepack();
+
 	/* Setup file descriptors for child command */
 	if (page) {
 		// Case 2
@@ -5787,13 +7838,7 @@ static size_t get_fs_info(const char *path, uchar_t type)
 	if (statvfs(path, &svb) == -1)
 		return 0;
 
-	if (type == VFS_AVAIL)
-		return (size_t)svb.f_bavail << ffs((int)(svb.f_frsize >> 1));
-
-	if (type == VFS_USED)
-		return ((size_t)svb.f_blocks - (size_t)svb.f_bfree) << ffs((int)(svb.f_frsize >> 1));
-
-	return (size_t)svb.f_blocks << ffs((int)(svb.f_frsize >> 1)); /* VFS_SIZE */
+	return get_fs_size(&svb, type);
 }
 
 /* Create non-existent parents and a file or dir */
@@ -6299,11 +8344,11 @@ static void show_help(const char *path)
 	"1FILTER & PROMPT\n"
 		  "c/  Filter%17^N  Toggle type-to-nav\n"
 		"aEsc  Exit prompt%12^L  Clear/apply filter\n"
-		  "c.  Toggle hidden\n"
+		  "c.  Toggle hidden%11F  Find in subtree\n"
 	"0\n"
 	"1FILES\n"
 	       "9o ^O  Open with%15n  Create new/link\n"
-	       "9f ^F  File stats%14P  Preview toggle\n"
+	       "9f ^F  File stats%12P L  Preview/tail toggle\n"
 		 "b^R  Rename/dup%14r  Batch rename\n"
 		  "cz  Archive%17e  Edit file\n"
 		  "c*  Toggle exe%14>  Export list\n"
@@ -6321,6 +8366,7 @@ static void show_help(const char *path)
 	       "9t ^T  Sort toggles%12s  Manage session\n"
 		  "cT  Set time type%110  Lock\n"
 		 "b^L  Redraw%18?  Help, conf\n"
+		  "ci  Manage jobs\n"
 	};
 
 	int fd = create_tmp_file();
@@ -6778,26 +8824,103 @@ static void dentfree(void)
 			free(du_tasks[i].path);
 		du_task_len = 0;
 		du_tasks_pending = 0;
+		/* A copy removes the file it's in */
+		for (int i = 0; i < njobs; ++i)
+			jobs[i]->cancel = TRUE;
 		pthread_cond_broadcast(&work_cond);
 		pthread_mutex_unlock(&running_mutex);
 		for (int i = 0; i < num_du_threads; ++i)
 			pthread_join(worker_tids[i], NULL);
+
+		/* Remove the files left in part */
+		for (int i = 0; i < njobs; ++i) {
+			for (size_t j = 0; j < jobs[i]->nheld; ++j)
+				job_tasks[job_task_len++] = jobs[i]->held[j];
+			jobs[i]->nheld = 0;
+		}
+		for (size_t i = 0; i < job_task_len; ++i) {
+			if (job_tasks[i].part)
+				copy_finish(job_tasks[i].group->job, job_tasks[i].part, FALSE);
+			free(job_tasks[i].path);
+		}
+		job_task_len = job_held = 0;
 	}
 
+	/* Commands go on, the selection copies they read are left */
+	for (int i = 0; i < njobs; ++i)
+		job_free(jobs[i]);
+
+	/* The index thread reads the names */
+	nameidx_stop();
 	free(pnamebuf);
 	free(pdents);
 	free(mark);
+	for (int i = 0; i < CTX_MAX; ++i) {
+		free(fltrcache[i].score);
+		free(fltrcache[i].mark);
+		free(fltrcache[i].pos);
+	}
+	free(pnameidx);
+	free(pidslot);
+	free(pidseen);
+	free(scr.rows);
+	free(pdtls);
+#ifndef NOLC
+	for (int i = 0; i < wnamecap; ++i)
+		free(pwnames[i].name);
+	free(pwnames);
+#endif
+#ifndef NOUG
+	for (uint_t i = 0; i < uidmap.cap; ++i)
+		free(uidmap.tbl[i].name);
+	for (uint_t i = 0; i < gidmap.cap; ++i)
+		free(gidmap.tbl[i].name);
+	free(uidmap.tbl);
+	free(gidmap.tbl);
+#endif
+#ifndef NOFIND
+	free(fidxents);
+	free(fidxnames);
+	free(fidxhash);
+#ifdef LINUX_INOTIFY
+	free(fidxwds);
+#endif
+#endif
 
 	/* Thread data cleanup */
 	free(core_blocks);
 	free(core_data);
 	free(core_files);
 	free(du_tasks);
+	free(job_tasks);
 }
 
-/* Walk a directory tree using readdir to reduce FTS overhead */
-static bool du_queue_task(const char *path, du_group *group, bool count_root, bool inc_pending)
+/* Make room for a task at len of tasks */
+static bool du_room(du_task **tasks, size_t *cap, size_t len)
+{
+	size_t newcap;
+	du_task *tmp;
+
+	if (len < *cap)
+		return true;
+
+	newcap = *cap ? (*cap << 1) : TASK_CAP_DU;
+	tmp = realloc(*tasks, newcap * sizeof(du_task));
+	if (!tmp)
+		return false;
+
+	*tasks = tmp;
+	*cap = newcap;
+	return true;
+}
+
+/* Queue task for the pool, the tasks of jobs go on a queue of their own */
+static bool du_push(du_task task, bool inc_pending)
 {
+	du_group *group = task.group;
+	op_job *job = group->job;
+	bool queued = false;
+
 	if (inc_pending) {
 		pthread_mutex_lock(&du_count_mutex);
 		++group->pending;
@@ -6805,52 +8928,109 @@ static bool du_queue_task(const char *path, du_group *group, bool count_root, bo
 	}
 
 	pthread_mutex_lock(&running_mutex);
-	if (g_state.interrupt) {
-		pthread_mutex_unlock(&running_mutex);
-		if (inc_pending) {
-			pthread_mutex_lock(&du_count_mutex);
-			--group->pending;
-			pthread_mutex_unlock(&du_count_mutex);
-		}
-		return false;
+	/* The steps of a job run even if it's cancelled */
+	if ((task.path || task.part) && (job ? job->cancel : g_state.interrupt))
+		;
+	else if (job) {
+		/* Held tasks go back without growing it */
+		if (du_room(&job_tasks, &job_task_cap, job_task_len + job_held)) {
+			job_tasks[job_task_len++] = task;
+			++job->pending;
+			queued = true;
+			/* Worker 0 is kept for walks, it may be the one woken */
+			pthread_cond_broadcast(&work_cond);
+		}
+	} else if (du_room(&du_tasks, &du_task_cap, du_task_len)) {
+		du_tasks[du_task_len++] = task;
+		/* Walks in the background aren't waited for */
+		if (group->bg)
+			++du_bg_pending;
+		else
+			++du_tasks_pending;
+		queued = true;
+		pthread_cond_signal(&work_cond);
 	}
+	pthread_mutex_unlock(&running_mutex);
 
-	if (du_task_len == du_task_cap) {
-		size_t newcap = du_task_cap ? (du_task_cap << 1) : TASK_CAP_DU;
-		du_task *tmp = realloc(du_tasks, newcap * sizeof(*du_tasks));
-		if (!tmp) {
-			pthread_mutex_unlock(&running_mutex);
-			if (inc_pending) {
-				pthread_mutex_lock(&du_count_mutex);
-				--group->pending;
-				pthread_mutex_unlock(&du_count_mutex);
-			}
-			return false;
-		}
-		du_tasks = tmp;
-		du_task_cap = newcap;
+	if (!queued && inc_pending) {
+		pthread_mutex_lock(&du_count_mutex);
+		--group->pending;
+		pthread_mutex_unlock(&du_count_mutex);
 	}
 
-	du_tasks[du_task_len++] = (du_task){
+	return queued;
+}
+
+/* Walk a directory tree using readdir to reduce FTS overhead */
+static bool du_queue_task(const char *path, du_group *group, bool count_root, bool inc_pending, uint_t fidxent)
+{
+	du_task task = {
 		.path = xstrdup(path),
 		.group = group,
 		.count_root = count_root,
+		.fidxent = fidxent,
 	};
-	if (!du_tasks[du_task_len - 1].path) {
-		--du_task_len;
-		pthread_mutex_unlock(&running_mutex);
-		if (inc_pending) {
-			pthread_mutex_lock(&du_count_mutex);
-			--group->pending;
-			pthread_mutex_unlock(&du_count_mutex);
-		}
+
+	if (!task.path)
 		return false;
+
+	if (du_push(task, inc_pending))
+		return true;
+
+	free(task.path);
+	return false;
+}
+
+/* Wait for the tasks counted in pending, ^C stops waiting */
+static bool du_wait(const size_t *pending)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&running_mutex);
+	while (*pending && !g_state.interrupt) {
+		/* The signal handler can't wake us up */
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100 * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			++ts.tv_sec;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&du_cond, &running_mutex, &ts);
 	}
-	++du_tasks_pending;
-	pthread_cond_signal(&work_cond);
 	pthread_mutex_unlock(&running_mutex);
 
-	return true;
+	return !g_state.interrupt;
+}
+
+/* Drop the queued tasks of an aborted walk and wait for the running ones */
+static void du_walk_stop(void)
+{
+	size_t len = 0;
+	du_task task;
+	bool done;
+
+	pthread_mutex_lock(&running_mutex);
+	for (size_t i = 0; i < du_task_len; ++i) {
+		task = du_tasks[i];
+		if (task.group->bg) {
+			du_tasks[len++] = task;
+			continue;
+		}
+
+		free(task.path);
+		--du_tasks_pending;
+		pthread_mutex_lock(&du_count_mutex);
+		done = (--task.group->pending == 0);
+		pthread_mutex_unlock(&du_count_mutex);
+		if (done)
+			free(task.group);
+	}
+	du_task_len = len;
+
+	/* They write to the entries */
+	while (du_tasks_pending)
+		pthread_cond_wait(&du_cond, &running_mutex);
+	pthread_mutex_unlock(&running_mutex);
 }
 
 /* Add blocks from stat to total */
@@ -6935,7 +9115,7 @@ static void du_walk_dir(const char *root, du_group *group, bool count_root, ullo
 			if (sb.st_dev == root_dev) {
 				char childbuf[PATH_MAX];
 				mkpath(root, dp->d_name, childbuf);
-				du_queue_task(childbuf, group, false, true);
+				du_queue_task(childbuf, group, false, true, 0);
 			}
 		}
 	}
@@ -6943,1082 +9123,3876 @@ static void du_walk_dir(const char *root, du_group *group, bool count_root, ullo
 	closedir(dirp);
 }
 
-static void *du_worker_loop(void *p_data)
+#ifndef NOFIND
+#ifdef LINUX_INOTIFY
+#define FIDX_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+		   | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+/* Returns FALSE if the dir was removed or replaced meanwhile */
+static bool fidx_watch(const char *path, uint_t dirent)
 {
-	thread_data *pdata = (thread_data *)p_data;
-	const int core = (int)pdata->core;
-	du_task task = {0};
+	int wd = inotify_add_watch(fidxfd, path, FIDX_MASK);
+	bool ret = TRUE;
 
-#ifdef __linux__
-#ifndef __TERMUX__
-	/* Pin thread to specific CPU core for better cache locality and parallelism */
-	cpu_set_t cpuset;
-	CPU_ZERO(&cpuset);
-	int num_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
-	if (num_cpus > 0)
-		CPU_SET(core % num_cpus, &cpuset);
-	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
-#endif
-#endif
+	pthread_mutex_lock(&fidx_mutex);
+	if (dirent != FIDX_NONE && fidxents[dirent].gone)
+		ret = FALSE;
+	else if (wd < 0) {
+		/* Out of watches, changes would be missed */
+		if (errno == ENOSPC || errno == ENOMEM)
+			fidxstale = TRUE;
+	} else {
+		if (wd >= fidxwdcap) {
+			int cap = MAX(wd + 1, fidxwdcap << 1);
+			uint_t *tmp = realloc(fidxwds, cap * sizeof(uint_t));
 
-	for (;;) {
-		pthread_mutex_lock(&running_mutex);
-		while (du_task_len == 0 && !du_shutdown)
-			pthread_cond_wait(&work_cond, &running_mutex);
-		if (du_shutdown) {
-			pthread_mutex_unlock(&running_mutex);
-			return NULL;
+			if (!tmp) {
+				fidxstale = TRUE;
+				goto unlock;
+			}
+
+			for (int i = fidxwdcap; i < cap; ++i)
+				tmp[i] = FIDX_NOWD;
+			fidxwds = tmp;
+			fidxwdcap = cap;
 		}
 
-		task = du_tasks[--du_task_len];
-		++active_threads;
-		pthread_mutex_unlock(&running_mutex);
+		/* A dir moved within the tree keeps its watch, point it to the new entry */
+		fidxwds[wd] = dirent;
+	}
+unlock:
+	pthread_mutex_unlock(&fidx_mutex);
+	return ret;
+}
+#endif
 
-		ullong_t tfiles = 0;
-		blkcnt_t tblocks = 0;
-		du_walk_dir(task.path, task.group, task.count_root, &tfiles, &tblocks);
-		free(task.path);
+static uint_t fidx_hashkey(uint_t parent, const char *name, size_t len)
+{
+	uint_t h = (2166136261U ^ parent) * 16777619U; /* FNV-1a */
 
-		/* Aggregate into the shared group and finalize when done */
-		pthread_mutex_lock(&du_count_mutex);
-		task.group->blocks += tblocks;
-		task.group->files += tfiles;
-		if (task.group->pending > 0)
-			--task.group->pending;
-		bool done = (task.group->pending == 0);
-		if (done) {
-			if (task.group->entnum >= 0)
-				pdents[task.group->entnum].blocks = task.group->blocks;
-
-			if (!task.group->no_aggregate) {
-				if (!task.group->mntpoint) {
-					core_blocks[core] += task.group->blocks;
-					core_files[core] += task.group->files;
-				} else
-					core_files[core] += 1;
-			}
-		}
-		pthread_mutex_unlock(&du_count_mutex);
-		if (done)
-			free(task.group);
+	while (len--)
+		h = (h ^ (uchar_t)*name++) * 16777619U;
+	return h;
+}
 
-		pthread_mutex_lock(&running_mutex);
-		--active_threads;
-		if (du_tasks_pending > 0)
-			--du_tasks_pending;
-		pthread_cond_signal(&du_cond); /* signal instead of broadcast for better performance */
-		pthread_mutex_unlock(&running_mutex);
+static void fidx_hashput(uint_t i)
+{
+	const fidx_ent *ent = &fidxents[i];
+	uint_t slot = fidx_hashkey(ent->parent, fidxnames + ent->name, ent->nlen - 1);
+
+	for (slot &= fidxhashcap - 1; fidxhash[slot] != FIDX_NONE; slot = (slot + 1) & (fidxhashcap - 1))
+		;
+	fidxhash[slot] = i;
+}
+
+/* Entry of the name of length len in dir, the caller holds fidx_mutex */
+static uint_t fidx_find(uint_t dir, const char *name, size_t len)
+{
+	uint_t slot, i;
+
+	if (!fidxhashcap)
+		return FIDX_NONE;
+
+	/* Removed entries stay in the table, they are skipped */
+	for (slot = fidx_hashkey(dir, name, len) & (fidxhashcap - 1);
+	     (i = fidxhash[slot]) != FIDX_NONE; slot = (slot + 1) & (fidxhashcap - 1)) {
+		const fidx_ent *ent = &fidxents[i];
+
+		if (ent->parent == dir && !ent->gone && ent->nlen == len + 1
+		    && !memcmp(fidxnames + ent->name, name, len))
+			return i;
 	}
-	/* not reached */
-	return NULL;
+
+	return FIDX_NONE;
 }
 
-/* Assign one subdirectory to a worker; subdirectories are scanned in parallel by the pool */
-static void dirwalk(char *path, int entnum, bool mountpoint, bool no_aggregate)
+/* Mark name in dir removed, the caller holds fidx_mutex */
+static void fidx_drop(uint_t dir, const char *name)
 {
-	if (g_state.interrupt)
-		return;
+	size_t len = xstrlen(name);
 
-	du_group *group = calloc(1, sizeof(*group));
-	if (!group)
-		return;
-	group->pending = 1;
-	group->entnum = entnum;
-	group->mntpoint = mountpoint;
-	group->no_aggregate = no_aggregate;
+	for (uint_t i; (i = fidx_find(dir, name, len)) != FIDX_NONE;)
+		fidxents[i].gone = TRUE;
+}
 
-	if (!du_queue_task(path, group, true, false)) {
-		free(group);
-		return;
+/*
+ * Append n names to the index, returns the entry of the first one.
+ * With replace, earlier entries of the same names are removed.
+ * The caller holds fidx_mutex.
+ */
+static uint_t fidx_put(uint_t parent, const char *names, size_t len, uint_t n, bool replace)
+{
+	uint_t first = FIDX_NONE;
+
+	if (fidxcnt + n > fidxcap) {
+		uint_t cap = MAX(fidxcap << 1, fidxcnt + n);
+		fidx_ent *tmp = realloc(fidxents, cap * sizeof(fidx_ent));
+
+		if (!tmp)
+			goto fail;
+		fidxents = tmp;
+		fidxcap = cap;
 	}
 
-	if (first_call) {
-		tolastln();
-		addstr("[^C aborts]\n");
-		refresh();
-		first_call = FALSE;
+	if (fidxnameslen + len > fidxnamescap) {
+		size_t cap = MAX(fidxnamescap << 1, fidxnameslen + len);
+		char *tmp = realloc(fidxnames, cap);
+
+		if (!tmp)
+			goto fail;
+		fidxnames = tmp;
+		fidxnamescap = cap;
+	}
+
+	if ((size_t)(fidxcnt + n) << 1 > fidxhashcap) {
+		uint_t cap = fidxhashcap ? fidxhashcap << 1 : 1024;
+		uint_t *tmp;
+
+		while ((size_t)(fidxcnt + n) << 1 > cap)
+			cap <<= 1;
+		tmp = malloc(cap * sizeof(uint_t));
+		if (!tmp)
+			goto fail;
+		free(fidxhash);
+		fidxhash = tmp;
+		fidxhashcap = cap;
+		memset(fidxhash, 0xff, cap * sizeof(uint_t)); /* FIDX_NONE */
+		for (uint_t i = 0; i < fidxcnt; ++i)
+			fidx_hashput(i);
+	}
+
+	if (replace)
+		for (const char *name = names; name < names + len; name += xstrlen(name) + 1)
+			fidx_drop(parent, name);
+
+	memcpy(fidxnames + fidxnameslen, names, len);
+	for (uint_t i = 0; i < n; ++i) {
+		fidx_ent *ent = &fidxents[fidxcnt + i];
+
+		ent->parent = parent;
+		ent->name = (uint_t)fidxnameslen;
+		ent->nlen = (ushort_t)(xstrlen(fidxnames + fidxnameslen) + 1);
+		ent->gone = FALSE;
+		fidxnameslen += ent->nlen;
+		fidx_hashput(fidxcnt + i);
 	}
+
+	first = fidxcnt;
+	fidxcnt += n;
+	return first;
+fail:
+	fidxstale = TRUE;
+	return first;
 }
 
-static bool prep_threads(void)
+/* Add a batch of names read from the dir at path, queue the subdirs */
+static void fidx_flush(const char *path, uint_t dirent, du_group *group,
+		       const char *names, size_t len, const bool *subdir, uint_t n)
 {
-	if (!g_state.duinit) {
-		long n = sysconf(_SC_NPROCESSORS_ONLN);
+	char childbuf[PATH_MAX];
+	uint_t first;
 
-		/* Create one thread per CPU core for optimal parallelism */
-		num_du_threads = (n > 0 && n <= NUM_DU_THREADS_MAX) ? (int)n : 4;
-		if (num_du_threads < 2)
-			num_du_threads = 2;
-		du_shutdown = false;
-		for (int i = 0; i < num_du_threads; ++i)
-			work_ready[i] = false;
-		active_threads = 0;
-		du_task_len = 0;
-		du_tasks_pending = 0;
-		if (!du_task_cap)
-			du_task_cap = TASK_CAP_DU;
-		if (!du_tasks)
-			du_tasks = calloc(du_task_cap, sizeof(*du_tasks));
+	/* A new dir is walked while its changes come in, keep the later of both */
+	pthread_mutex_lock(&fidx_mutex);
+	first = fidx_put(dirent, names, len, n, group->bg);
+	pthread_mutex_unlock(&fidx_mutex);
 
-		if (!core_blocks)
-			core_blocks = calloc((size_t)num_du_threads, sizeof(blkcnt_t));
-		if (!core_data)
-			core_data = calloc((size_t)num_du_threads, sizeof(thread_data));
-		if (!core_files)
-			core_files = calloc((size_t)num_du_threads, sizeof(ullong_t));
+	if (first == FIDX_NONE)
+		return;
 
-		if (!core_blocks || !core_data || !core_files || !du_tasks) {
-			printwarn(NULL);
-			return FALSE;
+	for (uint_t i = 0; i < n; names += xstrlen(names) + 1, ++i) {
+		if (subdir[i]) {
+			mkpath(path, names, childbuf);
+			if (!du_queue_task(childbuf, group, false, true, first + i)) {
+				pthread_mutex_lock(&fidx_mutex);
+				fidxstale = TRUE;
+				pthread_mutex_unlock(&fidx_mutex);
+			}
 		}
-		for (int i = 0; i < num_du_threads; ++i) {
-			core_data[i].core = (ushort_t)i;
-			if (pthread_create(&worker_tids[i], NULL, du_worker_loop,
-			    (void *)&core_data[i]) != 0) {
-				du_shutdown = true;
-				pthread_cond_broadcast(&work_cond);
-				while (i--)
-					pthread_join(worker_tids[i], NULL);
-				printwarn(NULL);
-				return FALSE;
-			}
-		}
-#ifndef __APPLE__
-		/* Increase current open file descriptor limit */
-		max_openfds();
-#endif
-		g_state.duinit = TRUE;
-	} else {
-		memset(core_blocks, 0, (size_t)num_du_threads * sizeof(blkcnt_t));
-		memset(core_data, 0, (size_t)num_du_threads * sizeof(thread_data));
-		memset(core_files, 0, (size_t)num_du_threads * sizeof(ullong_t));
-		pthread_mutex_lock(&running_mutex);
-		for (size_t i = 0; i < du_task_len; ++i)
-			free(du_tasks[i].path);
-		du_task_len = 0;
-		du_tasks_pending = 0;
-		pthread_mutex_unlock(&running_mutex);
 	}
-	return TRUE;
-}
-
-/* Skip self and parent */
-static inline bool selforparent(const char *path)
-{
-	return path[0] == '.' && (path[1] == '\0' || (path[1] == '.' && path[2] == '\0'));
 }
 
-static int dentfill(char *path, struct entry **ppdents)
+static void fidx_walk_dir(const char *path, uint_t dirent, du_group *group)
 {
-	uchar_t entflags = 0;
-	int flags = 0;
+	char names[FIDX_BATCH * (NAME_MAX + 1)];
+	bool subdir[FIDX_BATCH];
+	size_t len = 0;
+	uint_t n = 0;
 	struct dirent *dp;
-	char *namep, *pnb, *buf;
-	struct entry *dentp;
-	size_t off = 0, namebuflen = NAMEBUF_INCR;
-	struct stat sb_path, sb;
-	DIR *dirp = opendir(path);
+	struct stat sb;
+	DIR *dirp;
+	dev_t dev;
+	int dfd;
 
-	ndents = 0;
-	gtimesecs = time(NULL);
+	if (fstatat(AT_FDCWD, path, &sb, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISDIR(sb.st_mode))
+		return;
 
-	DPRINTF_S(__func__);
+	dev = sb.st_dev;
+#ifdef LINUX_INOTIFY
+	/* Watch before reading, a name added meanwhile shows up in both */
+	if (!fidx_watch(path, dirent))
+		return;
+#endif
 
+	dirp = opendir(path);
 	if (!dirp)
-		return 0;
-
-	int fd = dirfd(dirp);
-
-	if (cfg.blkorder) {
-		first_call = TRUE;
-		num_files = 0;
-		dir_blocks = 0;
-		buf = g_buf;
+		return;
 
-		if (fstatat(fd, path, &sb_path, 0) == -1)
-			goto exit;
+	dfd = dirfd(dirp);
+	while ((dp = readdir(dirp)) && !g_state.interrupt) {
+		if (selforparent(dp->d_name))
+			continue;
 
-		if (!ihashbmp) {
-			ihashbmp = calloc(1, HASH_OCTETS << 3);
-			if (!ihashbmp)
-				goto exit;
-		} else
-			memset(ihashbmp, 0, HASH_OCTETS << 3);
+		/* Like du, don't follow symlinks or cross filesystems */
+		subdir[n] = (dp->d_type == DT_DIR || dp->d_type == DT_UNKNOWN)
+			    && fstatat(dfd, dp->d_name, &sb, AT_SYMLINK_NOFOLLOW) == 0
+			    && S_ISDIR(sb.st_mode) && sb.st_dev == dev;
 
-		if (!dir_dispatched_bmp) {
-			dir_dispatched_bmp = calloc(1, HASH_OCTETS << 3);
-			if (!dir_dispatched_bmp)
-				goto exit;
-		} else
-			memset(dir_dispatched_bmp, 0, HASH_OCTETS << 3);
+		len += xstrsncpy(names + len, dp->d_name, NAME_MAX + 1);
+		if (++n == FIDX_BATCH) {
+			fidx_flush(path, dirent, group, names, len, subdir, n);
+			len = n = 0;
+		}
+	}
 
-		if (!prep_threads())
-			goto exit;
+	if (n)
+		fidx_flush(path, dirent, group, names, len, subdir, n);
 
-		attron(COLOR_PAIR(cfg.curctx + 1));
+	/* Names are missing */
+	if (g_state.interrupt) {
+		pthread_mutex_lock(&fidx_mutex);
+		fidxstale = TRUE;
+		pthread_mutex_unlock(&fidx_mutex);
 	}
 
-#if _POSIX_C_SOURCE >= 200112L
-	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	closedir(dirp);
+}
 #endif
 
-	dp = readdir(dirp);
-	if (!dp)
-		goto exit;
+/* Count a failed entry, the first one is reported */
+static void op_fail(op_job *job, const char *path)
+{
+	int err = errno;
 
-#if defined(__sun) || defined(__HAIKU__)
-	flags = AT_SYMLINK_NOFOLLOW; /* no d_type */
-#else
-	if (cfg.blkorder || dp->d_type == DT_UNKNOWN) {
-		/*
-		 * Optimization added for filesystems which support dirent.d_type
-		 * see readdir(3)
-		 * Known drawbacks:
-		 * - the symlink size is set to 0
-		 * - the modification time of the symlink is set to that of the target file
-		 */
-		flags = AT_SYMLINK_NOFOLLOW;
+	pthread_mutex_lock(&du_count_mutex);
+	if (!job->errors++) {
+		job->err = err;
+		xstrsncpy(job->errname, xbasename((char *)path), NAME_MAX + 1);
 	}
-#endif
+	pthread_mutex_unlock(&du_count_mutex);
+}
 
-	do {
-		namep = dp->d_name;
+static void op_progress(op_job *job, off_t bytes)
+{
+	pthread_mutex_lock(&du_count_mutex);
+	job->done += bytes;
+	pthread_mutex_unlock(&du_count_mutex);
+}
 
-		if (selforparent(namep))
-			continue;
+/* Copy a slice of part, 1 when it's all in, -1 if there's more and 0 on error or cancel */
+static int copy_data(op_job *job, copy_part *part)
+{
+	char buf[COPY_BUF];
+	off_t left = COPY_SLICE;
+	ssize_t n;
 
-		if (!cfg.showhidden && namep[0] == '.') {
-			if (!cfg.blkorder)
-				continue;
+	while (!job->cancel) {
+		/* The rest is queued, held while paused */
+		if (left <= 0 || job->paused)
+			return -1;
 
-			if (fstatat(fd, namep, &sb, AT_SYMLINK_NOFOLLOW) == -1)
-				continue;
+#ifdef __linux__
+		if (part->kernel) {
+#ifdef LINUX_CPFR
+			if (part->kernel == 2)
+				n = syscall(SYS_copy_file_range, part->sfd, NULL, part->dfd, NULL, COPY_CHUNK, 0);
+			else
+#endif
+				n = sendfile(part->dfd, part->sfd, NULL, COPY_CHUNK);
 
-			/* Use resolved (dev,ino) for duplicate check (symlink-to-dir vs real dir) */
-			struct stat sb_dir_h;
-			if (S_ISLNK(sb.st_mode)) {
-				sb_dir_h.st_mode = 0;
-				fstatat(fd, namep, &sb_dir_h, 0);
-			} else
-				sb_dir_h = sb;
+			/* Not between these files, go on the next way from the same offsets */
+			if (n == -1 && errno != EINTR) {
+				--part->kernel;
+				continue;
+			}
+		} else
+#endif
+		{
+			n = read(part->sfd, buf, sizeof(buf));
+			if (n > 0 && write(part->dfd, buf, n) != n)
+				return 0;
+		}
 
-			if (S_ISDIR(sb_dir_h.st_mode)) {
-				if (sb_path.st_dev == sb_dir_h.st_dev) { // NOLINT
-					mkpath(path, namep, buf); // NOLINT
-					bool first = test_set_bit_dir(sb_dir_h.st_dev, sb_dir_h.st_ino);
-					dirwalk(buf, -1, FALSE, !first);
+		if (n == 0)
+			return 1;
 
-					if (g_state.interrupt)
-						goto exit;
-				}
-				++num_files; /* Count directories */
-			} else {
-				/* Do not recount hard links */
-				if (sb.st_size && S_ISREG(sb.st_mode) && (sb.st_nlink <= 1 || test_set_bit((uint_t)sb.st_ino)))
-					dir_blocks += (cfg.apparentsz ? sb.st_size : sb.st_blocks);
-				++num_files;
-			}
+		if (n > 0) {
+			op_progress(job, n);
+			left -= n;
+		} else if (errno != EINTR)
+			return 0;
+	}
 
-			continue;
-		}
+	return 0;
+}
 
-		if (fstatat(fd, namep, &sb, flags) == -1) {
-			if (flags || (fstatat(fd, namep, &sb, AT_SYMLINK_NOFOLLOW) == -1)) {
-				/* Missing file */
-				DPRINTF_U(flags);
-				if (!flags) {
-					DPRINTF_S(namep);
-					DPRINTF_S(strerror(errno));
-				}
+/* Give the copy at path or fd the owner, mode and times of sb like cp -p */
+static void copy_attrs(int fd, const char *path, const struct stat *sb)
+{
+	const struct timespec ts[2] = {
+		{ .tv_sec = sb->st_atime, .tv_nsec = NSEC_ATIME(*sb) },
+		{ .tv_sec = sb->st_mtime, .tv_nsec = NSEC_MTIME(*sb) },
+	};
+	mode_t mode = sb->st_mode & 07777;
 
-				entflags = FILE_MISSING;
-				memset(&sb, 0, sizeof(struct stat));
-			} else /* Orphaned symlink */
-				entflags = SYM_ORPHAN;
-		}
+	/* Set-ID bits go only with the owner */
+	if (fd >= 0) {
+		if (fchown(fd, sb->st_uid, sb->st_gid) == -1)
+			mode &= ~(S_ISUID | S_ISGID);
+		fchmod(fd, mode);
+		futimens(fd, ts);
+		return;
+	}
 
-		if (ndents == total_dents) {
-			if (cfg.blkorder) {
-				pthread_mutex_lock(&running_mutex);
-				while (du_tasks_pending)
-					pthread_cond_wait(&du_cond, &running_mutex);
-				pthread_mutex_unlock(&running_mutex);
-			}
+	if (fchownat(AT_FDCWD, path, sb->st_uid, sb->st_gid, AT_SYMLINK_NOFOLLOW) == -1)
+		mode &= ~(S_ISUID | S_ISGID);
+	if (!S_ISLNK(sb->st_mode))
+		chmod(path, mode);
+	utimensat(AT_FDCWD, path, ts, AT_SYMLINK_NOFOLLOW);
+}
 
-			total_dents += cfg.blkorder ? ENTRY_INCR_DU : ENTRY_INCR;
-			*ppdents = xrealloc(*ppdents, total_dents * sizeof(**ppdents));
-			if (!*ppdents) {
-				free(pnamebuf);
-				closedir(dirp);
-				errexit();
-			}
-			DPRINTF_P(*ppdents);
-		}
+/* Close the copy of part, a failed one is removed */
+static void copy_finish(op_job *job, copy_part *part, bool ok)
+{
+	if (ok) {
+		copy_attrs(part->dfd, part->dst, &part->sb);
+		if (close(part->dfd) == -1)
+			op_fail(job, part->dst);
+	} else {
+		if (!job->cancel)
+			op_fail(job, part->dst);
+		close(part->dfd);
+		unlink(part->dst);
+	}
 
-		/* If not enough bytes left to copy a file name of length NAME_MAX, re-allocate */
-		if (namebuflen - off < NAME_MAX + 1) {
-			namebuflen += NAMEBUF_INCR;
+	close(part->sfd);
+	free(part->dst);
+	free(part);
+}
 
-			pnb = pnamebuf;
-			pnamebuf = (char *)xrealloc(pnamebuf, namebuflen);
-			if (!pnamebuf) {
-				free(*ppdents);
-				closedir(dirp);
-				errexit();
-			}
-			DPRINTF_P(pnamebuf);
+/* Copy a slice of the file, the rest goes back in the queue not to keep the worker */
+static void copy_slice(copy_part *part, du_group *group)
+{
+	const int r = copy_data(group->job, part);
 
-			/* realloc() may result in memory move, we must re-adjust if that happens */
-			if (pnb != pnamebuf) {
-				dentp = *ppdents;
-				dentp->name = pnamebuf;
+	if (r == -1 && du_push((du_task){ .group = group, .part = part }, TRUE))
+		return;
 
-				for (int count = 1; count < ndents; ++dentp, ++count)
-					/* Current file name starts at last file name start + length */
-					(dentp + 1)->name = (char *)((size_t)dentp->name + dentp->nlen);
-			}
-		}
+	copy_finish(group->job, part, r == 1);
+}
 
-		dentp = *ppdents + ndents;
+static void copy_file(const char *src, const char *dst, const struct stat *sb, du_group *group)
+{
+	op_job *job = group->job;
+	copy_part *part;
+	int sfd, dfd;
 
-		/* Selection file name */
-		dentp->name = (char *)((size_t)pnamebuf + off);
-		dentp->nlen = xstrsncpy(dentp->name, namep, NAME_MAX + 1);
-		off += dentp->nlen;
+	sfd = open(src, O_RDONLY | O_NOCTTY);
+	if (sfd == -1) {
+		op_fail(job, src);
+		return;
+	}
 
-		/* Copy other fields */
-		if (cfg.timetype == T_MOD) {
-			dentp->sec = sb.st_mtime;
-			dentp->nsec = NSEC_MTIME(sb);
-		} else if (cfg.timetype == T_ACCESS) {
-			dentp->sec = sb.st_atime;
-			dentp->nsec = NSEC_ATIME(sb);
-		} else {
-			dentp->sec = sb.st_ctime;
-			dentp->nsec = NSEC_CTIME(sb);
+	dfd = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY, S_IRUSR | S_IWUSR);
+	if (dfd == -1 && errno == EEXIST) {
+		if (!job->overwrite) {
+			close(sfd);
+			return;
 		}
 
-		if ((gtimesecs - sb.st_mtime <= 300) || (gtimesecs - sb.st_ctime <= 300))
-			entflags |= FILE_YOUNG;
+		/* Replace it like cp -f, a symlink isn't written through */
+		if (unlink(dst) == 0)
+			dfd = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY, S_IRUSR | S_IWUSR);
+	}
 
-#if !(defined(__sun) || defined(__HAIKU__))
-		if (!flags && dp->d_type == DT_LNK) {
-			 /* Do not add sizes for links */
-			dentp->mode = (sb.st_mode & ~S_IFMT) | S_IFLNK;
-			dentp->size = listpath ? sb.st_size : 0;
-		} else {
-			dentp->mode = sb.st_mode;
-			dentp->size = sb.st_size;
+	part = (dfd == -1) ? NULL : malloc(sizeof(*part));
+	if (part) {
+		part->dst = xstrdup(dst);
+		if (!part->dst) {
+			free(part);
+			part = NULL;
+		}
+	}
+
+	if (!part) {
+		op_fail(job, dst);
+		if (dfd != -1) {
+			close(dfd);
+			unlink(dst);
 		}
+		close(sfd);
+		return;
+	}
+
+	part->sb = *sb;
+	part->sfd = sfd;
+	part->dfd = dfd;
+	part->kernel = 0;
+#ifdef __linux__
+	/* 2: copy_file_range(), 1: sendfile(), 0: read() and write() */
+#ifdef LINUX_CPFR
+	part->kernel = 2;
 #else
-		dentp->mode = sb.st_mode;
-		dentp->size = sb.st_size;
+	part->kernel = 1;
 #endif
 
-#ifndef NOUG
-		dentp->uid = sb.st_uid;
-		dentp->gid = sb.st_gid;
+	/* Pseudo files have no size, only read() gets their contents */
+	if (!sb->st_size)
+		part->kernel = 0;
+	/* Share the extents on filesystems like Btrfs and XFS */
+	else if (ioctl(dfd, FICLONE, sfd) == 0) {
+		op_progress(job, sb->st_size);
+		copy_finish(job, part, TRUE);
+		return;
+	}
 #endif
 
-		dentp->flags = S_ISDIR(sb.st_mode) ? 0 : ((sb.st_nlink > 1) ? HARD_LINK : 0);
-		if (entflags) {
-			dentp->flags |= entflags;
-			entflags = 0;
-		}
+	copy_slice(part, group);
+}
 
-		if (cfg.blkorder) {
-			/* Use resolved (dev,ino) for duplicate check so symlink-to-dir and real dir count once when at / */
-			struct stat sb_dir;
-			if (S_ISLNK(sb.st_mode)) {
-				sb_dir.st_mode = 0;
-				fstatat(fd, namep, &sb_dir, 0);
-			} else
-				sb_dir = sb;
+static int copy_mknode(const char *target, const char *dst, const struct stat *sb)
+{
+	if (target)
+		return symlink(target, dst);
 
-			if (S_ISDIR(sb_dir.st_mode)) {
-				mkpath(path, namep, buf); // NOLINT
+	if (S_ISFIFO(sb->st_mode))
+		return mkfifo(dst, sb->st_mode & 07777);
 
-				/* Need to show the disk usage of this dir; skip adding to totals if same dir already dispatched (e.g. symlink) */
-				bool first = test_set_bit_dir(sb_dir.st_dev, sb_dir.st_ino);
-				dirwalk(buf, ndents, (sb_path.st_dev != sb_dir.st_dev), !first); // NOLINT
+	return mknod(dst, sb->st_mode, sb->st_rdev);
+}
 
-				if (g_state.interrupt)
-					goto exit;
-				++num_files; /* Count directories */
-			} else {
-				dentp->blocks = (cfg.apparentsz ? sb.st_size : sb.st_blocks);
-				/* Do not recount hard links */
-				if (sb.st_size && S_ISREG(sb.st_mode) && (sb.st_nlink <= 1 || test_set_bit((uint_t)sb.st_ino)))
-					dir_blocks += dentp->blocks;
-				++num_files;
-			}
-		}
+/* Copy a symlink as a symlink, a special file as a special file */
+static void copy_node(op_job *job, const char *src, const char *dst, const struct stat *sb)
+{
+	char target[PATH_MAX];
+	ssize_t len;
+	int r;
 
-		if (flags) {
-			/* Flag if this is a dir or symlink to a dir */
-			if (S_ISLNK(sb.st_mode)) {
-				sb.st_mode = 0;
-				fstatat(fd, namep, &sb, 0);
-			}
-
-			if (S_ISDIR(sb.st_mode))
-				dentp->flags |= DIR_OR_DIRLNK;
-#if !(defined(__sun) || defined(__HAIKU__)) /* no d_type */
-		} else if (dp->d_type == DT_DIR || ((dp->d_type == DT_LNK
-			   || dp->d_type == DT_UNKNOWN) && S_ISDIR(sb.st_mode))) {
-			dentp->flags |= DIR_OR_DIRLNK;
-#endif
+	if (S_ISLNK(sb->st_mode)) {
+		len = readlink(src, target, sizeof(target) - 1);
+		if (len == -1) {
+			op_fail(job, src);
+			return;
 		}
+		target[len] = '\0';
+	}
 
-		++ndents;
-	} while ((dp = readdir(dirp)));
-
-exit:
-	if (g_state.duinit && cfg.blkorder) {
-		pthread_mutex_lock(&running_mutex);
-		while (du_tasks_pending)
-			pthread_cond_wait(&du_cond, &running_mutex);
-		pthread_mutex_unlock(&running_mutex);
+	r = copy_mknode(S_ISLNK(sb->st_mode) ? target : NULL, dst, sb);
+	if (r == -1 && errno == EEXIST) {
+		if (!job->overwrite)
+			return;
 
-		attroff(COLOR_PAIR(cfg.curctx + 1));
-		for (int i = 0; i < num_du_threads; ++i) {
-			num_files += core_files[i];
-			dir_blocks += core_blocks[i];
-		}
+		r = unlink(dst) ? -1 : copy_mknode(S_ISLNK(sb->st_mode) ? target : NULL, dst, sb);
 	}
 
-	/* Should never be null */
-	if (closedir(dirp) == -1)
-		errexit();
-
-	return ndents;
+	if (r == -1)
+		op_fail(job, dst);
+	else
+		copy_attrs(-1, dst, sb);
 }
 
-static void populate(char *path, char *lastname)
+static void copy_keepdir(op_job *job, const char *dst, const struct stat *sb)
 {
-#ifdef DEBUG
-	struct timespec ts1, ts2;
-
-	clock_gettime(CLOCK_REALTIME, &ts1); /* Use CLOCK_MONOTONIC on FreeBSD */
-#endif
+	char *path = xstrdup(dst);
 
-	ndents = dentfill(path, &pdents);
-	if (!ndents)
+	if (!path)
 		return;
 
-#ifndef NOSORT
-	ENTSORT(pdents, ndents, entrycmpfn);
-#endif
+	pthread_mutex_lock(&du_count_mutex);
+	if (job->ndirs == job->dircap) {
+		size_t cap = job->dircap ? job->dircap << 1 : TASK_CAP_DU;
+		copy_dir *tmp = realloc(job->dirs, cap * sizeof(copy_dir));
 
-#ifdef DEBUG
-	clock_gettime(CLOCK_REALTIME, &ts2);
-	DPRINTF_U(ts2.tv_nsec - ts1.tv_nsec);
-#endif
+		if (!tmp) {
+			pthread_mutex_unlock(&du_count_mutex);
+			free(path);
+			return;
+		}
+		job->dirs = tmp;
+		job->dircap = cap;
+	}
 
-	/* Find cur from history */
-	/* No NULL check for lastname, always points to an array */
-	move_cursor(*lastname ? dentfind(lastname, ndents) : 0, 0);
+	job->dirs[job->ndirs].path = path;
+	job->dirs[job->ndirs++].sb = *sb;
+	pthread_mutex_unlock(&du_count_mutex);
+}
 
-	// Force full redraw
-	last_curscroll = -1;
+/* Give the copied dirs their modes and times once the entries are in */
+static void copy_dirsattrs(op_job *job)
+{
+	for (size_t i = job->ndirs; i--;) {
+		copy_attrs(-1, job->dirs[i].path, &job->dirs[i].sb);
+		free(job->dirs[i].path);
+	}
+	free(job->dirs);
+	job->dirs = NULL;
+	job->ndirs = job->dircap = 0;
 }
 
-#ifndef NOFIFO
-static void notify_fifo(bool force)
+/* Make the dir and queue its entries to be copied by the pool */
+static void copy_dir_walk(const char *src, const char *dst, const struct stat *sb, du_group *group)
 {
-	if (!fifopath)
+	char child[PATH_MAX];
+	struct stat csb;
+	struct dirent *dp;
+	off_t bytes = 0;
+	op_job *job = group->job;
+	const size_t len = xstrlen(src);
+	DIR *dirp;
+
+	/* Writable till the entries are in */
+	if (mkdir(dst, (sb->st_mode & 07777) | S_IRWXU) == 0)
+		copy_keepdir(job, dst, sb);
+	else if (errno != EEXIST || stat(dst, &csb) == -1 || !S_ISDIR(csb.st_mode)) {
+		op_fail(job, dst);
 		return;
+	} else if (job->overwrite) /* Merge into the existing dir */
+		copy_keepdir(job, dst, sb);
 
-	if (fifofd == -1) {
-		fifofd = open(fifopath, O_WRONLY|O_NONBLOCK|O_CLOEXEC);
-		if (fifofd == -1) {
-			if (errno != ENXIO)
-				/* Unexpected error, the FIFO file might have been removed */
-				/* We give up FIFO notification */
-				fifopath = NULL;
-			return;
-		}
+	dirp = opendir(src);
+	if (!dirp) {
+		op_fail(job, src);
+		return;
 	}
 
-	static struct entry lastentry;
+	const int dfd = dirfd(dirp);
 
-	if (!force && !memcmp(&lastentry, &pdents[cur], sizeof(struct entry))) // NOLINT
-		return;
+	while ((dp = readdir(dirp)) && !job->cancel) {
+		if (selforparent(dp->d_name))
+			continue;
 
-	lastentry = pdents[cur];
+		/* Sizes for the ETA */
+		if ((dp->d_type == DT_REG || dp->d_type == DT_UNKNOWN)
+		    && fstatat(dfd, dp->d_name, &csb, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(csb.st_mode))
+			bytes += csb.st_size;
 
-	char path[PATH_MAX];
-	size_t len = mkpath(g_ctx[cfg.curctx].c_path, ndents ? pdents[cur].name : "", path);
+		/* A path cut short would copy some other entry */
+		if (len + 1 + xstrlen(dp->d_name) >= PATH_MAX) {
+			errno = ENAMETOOLONG;
+			op_fail(job, dp->d_name);
+			continue;
+		}
 
-	path[len - 1] = '\n';
+		/* A skipped entry must keep the sources of a move */
+		mkpath(src, dp->d_name, child);
+		if (!du_queue_task(child, group, false, true, 0) && !job->cancel)
+			op_fail(job, dp->d_name);
+	}
 
-	ssize_t ret = write(fifofd, path, len);
+	closedir(dirp);
 
-	if (ret != (ssize_t)len && !(ret == -1 && (errno == EAGAIN || errno == EPIPE))) {
-		DPRINTF_S(strerror(errno));
-	}
+	pthread_mutex_lock(&du_count_mutex);
+	job->total += bytes;
+	pthread_mutex_unlock(&du_count_mutex);
 }
 
-static void send_to_explorer(int *presel)
+/* Copy an entry of the tree of group, below cpdst at the same place */
+static void copy_entry(const char *src, du_group *group)
 {
-	if (nselected) {
-		int fd = open(fifopath, O_WRONLY|O_NONBLOCK|O_CLOEXEC, 0600);
-		if ((fd == -1) || (seltofile(fd, NULL, NEWLINE) != (size_t)(selbufpos)))
-			printwarn(presel);
-		else {
-			resetselind();
-			clearselection();
-		}
-		if (fd > 1)
-			close(fd);
-	} else
-		notify_fifo(TRUE); /* Send opened path to NNN_FIFO */
+	char dst[PATH_MAX];
+	struct stat sb;
+	const char *rel = src + group->cpsrclen;
+	size_t len = xstrlen(group->cpdst);
+	op_job *job = group->job;
+
+	if (job->cancel)
+		return;
+
+	if (len + xstrlen(rel) >= PATH_MAX) {
+		errno = ENAMETOOLONG;
+		op_fail(job, src);
+		return;
+	}
+
+	memcpy(dst, group->cpdst, len);
+	xstrsncpy(dst + len, rel, PATH_MAX - len);
+
+	if (lstat(src, &sb) == -1)
+		op_fail(job, src);
+	else if (S_ISDIR(sb.st_mode))
+		copy_dir_walk(src, dst, &sb, group);
+	else if (S_ISREG(sb.st_mode))
+		copy_file(src, dst, &sb, group);
+	else
+		copy_node(job, src, dst, &sb);
 }
-#endif
 
-static void move_cursor(int target, int ignore_scrolloff)
+/*
+ * Queue the dir name to be removed by the pool once the walk empties it.
+ * name is relative to the dir of parent, a path of its own without one.
+ */
+static bool rm_queue(op_job *job, const char *name, du_group *parent)
 {
-	target = MAX(0, MIN(ndents - 1, target));
-	last_curscroll = curscroll;
-	last = cur;
-	cur = target;
+	du_group *group = calloc(1, sizeof(*group));
 
-	if (!ignore_scrolloff) {
-		int delta = target - last;
-		int scrolloff = MIN(SCROLLOFF, ONSCREEN >> 1);
+	if (group)
+		group->rmname = xstrdup(name);
+	if (!group || !group->rmname) {
+		free(group);
+		return FALSE;
+	}
 
-		/*
-		 * When ignore_scrolloff is 1, the cursor can jump into the scrolloff
-		 * margin area, but when ignore_scrolloff is 0, act like a boa
-		 * constrictor and squeeze the cursor towards the middle region of the
-		 * screen by allowing it to move inward and disallowing it to move
-		 * outward (deeper into the scrolloff margin area).
-		 */
-		if (((cur < (curscroll + scrolloff)) && delta < 0)
-		    || ((cur > (curscroll + ONSCREEN - scrolloff - 1)) && delta > 0))
-			curscroll += delta;
+	group->pending = 1;
+	group->entnum = -1;
+	group->no_aggregate = TRUE;
+	group->rmfd = -1;
+	group->rmpfd = parent ? parent->rmfd : AT_FDCWD;
+	group->parent = parent;
+	group->job = job;
+
+	/* The parent is done only after its subdirs */
+	if (parent) {
+		pthread_mutex_lock(&du_count_mutex);
+		++parent->pending;
+		pthread_mutex_unlock(&du_count_mutex);
 	}
-	curscroll = MIN(curscroll, MIN(cur, ndents - ONSCREEN));
-	curscroll = MAX(curscroll, MAX(cur - (ONSCREEN - 1), 0));
 
-#ifndef NOFIFO
-	if (!g_state.fifomode)
-		notify_fifo(FALSE); /* Send hovered path to NNN_FIFO */
-#endif
+	if (du_queue_task(name, group, FALSE, FALSE, 0))
+		return TRUE;
+
+	/* The walk of the parent is still on, it can't be done */
+	if (parent) {
+		pthread_mutex_lock(&du_count_mutex);
+		--parent->pending;
+		pthread_mutex_unlock(&du_count_mutex);
+	}
+
+	free(group->rmname);
+	free(group);
+	return FALSE;
 }
 
-static void handle_screen_move(enum action sel)
+/*
+ * Unlink the entries of the dir name of group relative to it, subdirs are
+ * queued for the pool. The dir stays open for them till the group is done.
+ */
+static void rm_dir_walk(const char *name, du_group *group)
 {
-	switch (sel) {
-	case SEL_NEXT:
-		if (cfg.rollover || (cur != ndents - 1))
-			move_cursor((cur + 1) % ndents, 0);
-		break;
-	case SEL_PREV:
-		if (cfg.rollover || cur)
-			move_cursor((cur + ndents - 1) % ndents, 0);
-		break;
-	case SEL_PGDN:
-		move_cursor(curscroll + (ONSCREEN - 1), 1);
-		curscroll += ONSCREEN - 1;
-		break;
-	case SEL_CTRL_D:
-		move_cursor(curscroll + (ONSCREEN - 1), 1);
-		curscroll += ONSCREEN >> 1;
-		break;
-	case SEL_PGUP:
-		move_cursor(curscroll, 1);
-		curscroll -= ONSCREEN - 1;
-		break;
-	case SEL_CTRL_U:
-		move_cursor(curscroll, 1);
-		curscroll -= ONSCREEN >> 1;
-		break;
-	case SEL_JUMP:
-	{
-		char *input = xreadline(NULL, "jump (+n/-n/n): ");
+	struct dirent *dp;
+	struct stat sb;
+	off_t removed = 0;
+	DIR *dirp = NULL;
+	op_job *job = group->job;
+	bool isdir;
+	int fd, dfd = -1;
 
-		if (!input || !*input)
-			break;
-		if (input[0] == '-') {
-			cur -= atoi(input + 1);
-			if (cur < 0)
-				cur = 0;
-		} else if (input[0] == '+') {
-			cur += atoi(input + 1);
-			if (cur >= ndents)
-				cur = ndents - 1;
-		} else {
-			int index = atoi(input);
+	if (job->cancel)
+		return;
 
-			if ((index < 1) || (index > ndents))
-				break;
-			cur = index - 1;
-		}
-		move_cursor(cur, 1);
-		curscroll -= ONSCREEN >> 1;
-		break;
-	}
-	case SEL_HOME:
-		move_cursor(0, 1);
-		break;
-	case SEL_END:
-		move_cursor(ndents - 1, 1);
-		break;
-	case SEL_YOUNG:
-	{
-		for (int r = cur;;) {
-			if (++r >= ndents)
-				r = 0;
-			if (r == cur)
-				break;
-			if (pdents[r].flags & FILE_YOUNG) {
-				move_cursor(r, 0);
-				break;
-			}
-		}
-		break;
+	/* Don't follow a dir swapped for a symlink */
+	fd = openat(group->rmpfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd != -1)
+		dfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (dfd != -1)
+		dirp = fdopendir(dfd);
+	if (!dirp) {
+		op_fail(job, name);
+		if (dfd != -1)
+			close(dfd);
+		if (fd != -1)
+			close(fd);
+		return;
 	}
-	default: /* case SEL_FIRST */
-	{
-		int c = get_input(messages[MSG_FIRST]);
-
-		if (!c)
-			break;
+	group->rmfd = fd;
 
-		c = TOUPPER(c);
+	while ((dp = readdir(dirp)) && !job->cancel) {
+		if (selforparent(dp->d_name))
+			continue;
 
-		int r = (c == TOUPPER(*pdents[cur].name)) ? (cur + 1) : 0;
+		isdir = (dp->d_type == DT_DIR);
+		if (dp->d_type == DT_UNKNOWN && fstatat(fd, dp->d_name, &sb, AT_SYMLINK_NOFOLLOW) == 0)
+			isdir = S_ISDIR(sb.st_mode);
 
-		for (; r < ndents; ++r) {
-			if (((c == '\'') && !(pdents[r].flags & DIR_OR_DIRLNK))
-			    || (c == TOUPPER(*pdents[r].name))) {
-				move_cursor((r) % ndents, 0);
-				break;
-			}
+		if (!isdir) {
+			if (unlinkat(fd, dp->d_name, 0) == 0)
+				++removed;
+			else
+				op_fail(job, dp->d_name);
+			continue;
 		}
-		break;
-	}
+
+		if (!rm_queue(job, dp->d_name, group) && !job->cancel)
+			op_fail(job, dp->d_name);
 	}
+
+	closedir(dirp);
+	op_progress(job, removed);
 }
 
-static void handle_openwith(const char *path, const char *name, char *newpath, char *tmp)
+/* Remove the emptied dir of group and the dirs above it emptied by that */
+static void rm_done(du_group *group)
 {
-	/* Confirm if app is CLI or GUI */
-	int r = get_input(messages[MSG_CLI_MODE]);
+	du_group *parent;
+	bool done;
 
-	r = (r == 'c' ? F_CLI :
-	     ((r == 'g' || r == '\r') ? (F_NOWAIT | F_NOTRACE | F_MULTI) : 0));
-	if (r) {
-		mkpath(path, name, newpath);
-		spawn(tmp, newpath, NULL, NULL, r);
-	}
+	while (group) {
+		if (group->rmfd != -1)
+			close(group->rmfd);
+		if (unlinkat(group->rmpfd, group->rmname, AT_REMOVEDIR) == 0)
+			op_progress(group->job, 1);
+		else if (!group->job->cancel) /* Left non-empty by a cancel */
+			op_fail(group->job, group->rmname);
+
+		parent = group->parent;
+		free(group->rmname);
+		free(group);
+		if (!parent)
+			break;
+
+		pthread_mutex_lock(&du_count_mutex);
+		done = (--parent->pending == 0);
+		pthread_mutex_unlock(&du_count_mutex);
+		group = done ? parent : NULL;
+	}
+}
+
+/*
+ * Take the newest walk, else a task of a job. Worker 0 is kept for the
+ * walks. The tasks of a paused job are held till it's resumed.
+ */
+static bool du_take(int core, du_task *task)
+{
+	op_job *job;
+
+	if (du_task_len) {
+		*task = du_tasks[--du_task_len];
+		return true;
+	}
+
+	while (core && job_task_len) {
+		*task = job_tasks[--job_task_len];
+		job = task->group->job;
+		if (!job->paused || job->cancel || !du_room(&job->held, &job->heldcap, job->nheld))
+			return true;
+
+		job->held[job->nheld++] = *task;
+		++job_held;
+	}
+
+	return false;
+}
+
+/* Run a taken task and account for it */
+static void du_run_task(du_task task, int core)
+{
+	/* The group may be gone once the task is done */
+	op_job *job = task.group->job;
+	bool bg = task.group->bg;
+	ullong_t tfiles = 0;
+	blkcnt_t tblocks = 0;
+
+	if (task.part)
+		copy_slice(task.part, task.group);
+	else if (task.group->rmlist)
+		rm_paths(job, task.group->rmlist, task.group->rmlistlen);
+	else if (task.group->cpattrs)
+		copy_dirsattrs(job);
+#ifndef NOFIND
+	else if (task.group->fidx)
+		fidx_walk_dir(task.path, task.fidxent, task.group);
+#endif
+	else if (task.group->cpdst)
+		copy_entry(task.path, task.group);
+	else if (task.group->rmname)
+		rm_dir_walk(task.path, task.group);
+	else
+		du_walk_dir(task.path, task.group, task.count_root, &tfiles, &tblocks);
+	free(task.path);
+
+	/* Aggregate into the shared group and finalize when done */
+	pthread_mutex_lock(&du_count_mutex);
+	task.group->blocks += tblocks;
+	task.group->files += tfiles;
+	if (task.group->pending > 0)
+		--task.group->pending;
+	bool done = (task.group->pending == 0);
+	if (done) {
+		if (task.group->entnum >= 0)
+			pdents[task.group->entnum].blocks = task.group->blocks;
+
+		if (!task.group->no_aggregate) {
+			if (!task.group->mntpoint) {
+				core_blocks[core] += task.group->blocks;
+				core_files[core] += task.group->files;
+			} else
+				core_files[core] += 1;
+		}
+	}
+	pthread_mutex_unlock(&du_count_mutex);
+	if (done && task.group->rmname)
+		rm_done(task.group);
+	else if (done) {
+		free(task.group->cpdst);
+		free(task.group->rmlist);
+		free(task.group);
+	}
+
+	pthread_mutex_lock(&running_mutex);
+	--active_threads;
+	if (job)
+		--job->pending;
+	else if (bg)
+		--du_bg_pending;
+	else if (du_tasks_pending > 0)
+		--du_tasks_pending;
+	pthread_cond_signal(&du_cond); /* signal instead of broadcast for better performance */
+	pthread_mutex_unlock(&running_mutex);
+}
+
+static void *du_worker_loop(void *p_data)
+{
+	thread_data *pdata = (thread_data *)p_data;
+	const int core = (int)pdata->core;
+	du_task task = {0};
+
+#ifdef __linux__
+#ifndef __TERMUX__
+	/* Pin thread to specific CPU core for better cache locality and parallelism */
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	int num_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_cpus > 0)
+		CPU_SET(core % num_cpus, &cpuset);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+#endif
+#endif
+
+	for (;;) {
+		pthread_mutex_lock(&running_mutex);
+		while (!du_shutdown && !du_take(core, &task))
+			pthread_cond_wait(&work_cond, &running_mutex);
+		if (du_shutdown) {
+			pthread_mutex_unlock(&running_mutex);
+			return NULL;
+		}
+
+		++active_threads;
+		pthread_mutex_unlock(&running_mutex);
+
+		du_run_task(task, core);
+	}
+	/* not reached */
+	return NULL;
+}
+
+/* Assign one subdirectory to a worker; subdirectories are scanned in parallel by the pool */
+static void dirwalk(char *path, int entnum, bool mountpoint, bool no_aggregate)
+{
+	if (g_state.interrupt)
+		return;
+
+	du_group *group = calloc(1, sizeof(*group));
+	if (!group)
+		return;
+	group->pending = 1;
+	group->entnum = entnum;
+	group->mntpoint = mountpoint;
+	group->no_aggregate = no_aggregate;
+
+	if (!du_queue_task(path, group, true, false, 0)) {
+		free(group);
+		return;
+	}
+
+	if (first_call) {
+		tolastln();
+		addstr("[^C aborts]\n");
+		refresh();
+		first_call = FALSE;
+	}
+}
+
+static bool prep_threads(void)
+{
+	if (!g_state.duinit) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+		/* Create one thread per CPU core for optimal parallelism */
+		num_du_threads = (n > 0 && n <= NUM_DU_THREADS_MAX) ? (int)n : 4;
+		if (num_du_threads < 2)
+			num_du_threads = 2;
+		du_shutdown = false;
+		for (int i = 0; i < num_du_threads; ++i)
+			work_ready[i] = false;
+		active_threads = 0;
+		du_task_len = 0;
+		du_tasks_pending = 0;
+		if (!du_task_cap)
+			du_task_cap = TASK_CAP_DU;
+		if (!du_tasks)
+			du_tasks = calloc(du_task_cap, sizeof(*du_tasks));
+
+		if (!core_blocks)
+			core_blocks = calloc((size_t)num_du_threads, sizeof(blkcnt_t));
+		if (!core_data)
+			core_data = calloc((size_t)num_du_threads, sizeof(thread_data));
+		if (!core_files)
+			core_files = calloc((size_t)num_du_threads, sizeof(ullong_t));
+
+		if (!core_blocks || !core_data || !core_files || !du_tasks) {
+			printwarn(NULL);
+			return FALSE;
+		}
+		for (int i = 0; i < num_du_threads; ++i) {
+			core_data[i].core = (ushort_t)i;
+			if (pthread_create(&worker_tids[i], NULL, du_worker_loop,
+			    (void *)&core_data[i]) != 0) {
+				du_shutdown = true;
+				pthread_cond_broadcast(&work_cond);
+				while (i--)
+					pthread_join(worker_tids[i], NULL);
+				printwarn(NULL);
+				return FALSE;
+			}
+		}
+#ifndef __APPLE__
+		/* Increase current open file descriptor limit */
+		max_openfds();
+#endif
+		g_state.duinit = TRUE;
+	} else {
+		memset(core_blocks, 0, (size_t)num_du_threads * sizeof(blkcnt_t));
+		memset(core_data, 0, (size_t)num_du_threads * sizeof(thread_data));
+		memset(core_files, 0, (size_t)num_du_threads * sizeof(ullong_t));
+		pthread_mutex_lock(&running_mutex);
+		size_t len = 0;
+
+		/* Drop what's left of a walk, the walks in the background go on */
+		for (size_t i = 0; i < du_task_len; ++i) {
+			if (du_tasks[i].group->bg)
+				du_tasks[len++] = du_tasks[i];
+			else
+				free(du_tasks[i].path);
+		}
+		du_task_len = len;
+		du_tasks_pending = 0;
+		pthread_mutex_unlock(&running_mutex);
+	}
+	return TRUE;
+}
+
+/* Skip self and parent */
+static inline bool selforparent(const char *path)
+{
+	return path[0] == '.' && (path[1] == '\0' || (path[1] == '.' && path[2] == '\0'));
+}
+
+/* Run time of the job in ms, the pauses left out */
+static ullong_t job_ms(const op_job *job)
+{
+	const ullong_t now = job->paused ? job->paused_at : monotonic_ns();
+
+	return (now - job->start - job->paused_ns) / 1000000;
+}
+
+/* Put secs as [h:]m:ss in buf */
+static void durstr(ullong_t secs, char *buf, size_t len)
+{
+	if (secs >= 3600)
+		snprintf(buf, len, "%llu:%02llu:%02llu", secs / 3600, secs / 60 % 60, secs % 60);
+	else
+		snprintf(buf, len, "%llu:%02llu", secs / 60, secs % 60);
+}
+
+/*
+ * Describe the job: the bytes copied, the rate and the time left of a
+ * copy, the entries removed by a remove, the run time of a command
+ */
+static void job_info(const op_job *job, char *buf, size_t len)
+{
+	char done[16], total[16], rate[16], eta[32];
+	const char *state = job->paused ? " paused" : "";
+	const ullong_t ms = job_ms(job);
+	off_t count, size, speed;
+	int n;
+
+	n = snprintf(buf, len, "%s%s%s ", job->name, job->to[0] ? " " : "", job->to);
+	if (n < 0 || (size_t)n >= len)
+		return;
+	buf += n;
+	len -= n;
+
+	pthread_mutex_lock(&du_count_mutex);
+	count = job->done;
+	size = MAX(job->total, job->done);
+	pthread_mutex_unlock(&du_count_mutex);
+
+	speed = ms ? (off_t)((double)count * 1000 / ms) : 0;
+
+	if (job->op == 'x') {
+		durstr(ms / 1000, eta, sizeof(eta));
+		snprintf(buf, len, "%s%s", eta, state);
+		return;
+	}
+
+	if (job->op == 'r') {
+		snprintf(buf, len, "%lld removed, %lld/s%s", (long long)count, (long long)speed, state);
+		return;
+	}
+
+	xstrsncpy(done, coolsize(count), sizeof(done));
+	xstrsncpy(total, coolsize(size), sizeof(total));
+	xstrsncpy(rate, coolsize(speed), sizeof(rate));
+
+	if (speed)
+		durstr((ullong_t)((size - count) / speed), eta, sizeof(eta));
+	else
+		xstrsncpy(eta, "-", sizeof(eta));
+
+	snprintf(buf, len, "%s/%s %s/s ETA %s%s", done, total, rate, eta, state);
+}
+
+/* Show the job running, the number of jobs or how the last one ended at the end of the status bar */
+static void showjobs(void)
+{
+	static int drawn; /* Clear what a longer one left */
+	char info[NAME_MAX + 128], msg[NAME_MAX + 130];
+	int len, y, x;
+
+	if (njobs == 1)
+		job_info(jobs[0], info, sizeof(info));
+	else if (njobs)
+		snprintf(info, sizeof(info), "%d jobs", njobs);
+	else if (jobnote[0])
+		xstrsncpy(info, jobnote, sizeof(info));
+	else
+		return;
+
+	len = snprintf(msg, sizeof(msg), "[%s]", info);
+	len = MIN(len, xcols - 1);
+	if (len <= 0)
+		return;
+
+	getyx(stdscr, y, x);
+	if (drawn > len && drawn < xcols)
+		mvhline(xlines - 1, xcols - 1 - drawn, ' ', drawn - len);
+	drawn = len;
+	attron(COLOR_PAIR(cfg.curctx + 1));
+	mvaddnstr(xlines - 1, xcols - 1 - len, msg, len);
+	attroff(COLOR_PAIR(cfg.curctx + 1));
+	move(y, x);
+}
+
+/* Add a job to the list, NULL if there's no room */
+static op_job *job_new(const char *name, char op, const char *to)
+{
+	op_job *job;
+
+	if (njobs == JOBS_MAX)
+		return NULL;
+
+	job = calloc(1, sizeof(*job));
+	if (!job) {
+		printwarn(NULL);
+		return NULL;
+	}
+
+	job->name = name;
+	job->op = op;
+	if (to)
+		xstrsncpy(job->to, xbasename((char *)to), NAME_MAX + 1);
+	job->start = monotonic_ns();
+	jobs[njobs++] = job;
+	return job;
+}
+
+static void job_free(op_job *job)
+{
+	for (size_t i = 0; i < job->ndirs; ++i)
+		free(job->dirs[i].path);
+	free(job->dirs);
+	free(job->held);
+	free(job->srcs);
+	free(job->list);
+	free(job);
+}
+
+/* Check if a job can run on the du worker threads */
+static bool jobs_room(void)
+{
+	return njobs < JOBS_MAX && prep_threads();
+}
+
+/* Copy the selection for a command job to read, it may change meanwhile */
+static char *job_list(void)
+{
+	char *buf, *list = NULL;
+	off_t len;
+	int fd;
+
+	if (njobs == JOBS_MAX)
+		return NULL;
+
+	selfilepack();
+	buf = readfile(selpath, &len);
+	if (!buf)
+		return NULL;
+
+	fd = create_tmp_file();
+	if (fd != -1) {
+		if (write(fd, buf, len) == len)
+			list = xstrdup(g_tmpfpath);
+		if (!list)
+			unlink(g_tmpfpath);
+		close(fd);
+	}
+
+	free(buf);
+	return list;
+}
+
+static void job_unlist(char *list)
+{
+	if (list) {
+		unlink(list);
+		free(list);
+	}
+}
+
+/*
+ * Run a command as a job, in a session of its own to pause or cancel it
+ * whole. It has no terminal, list is the copy of the selection it reads.
+ */
+static bool job_spawn(const char *name, const char *to, char *list, char *cmd, char *arg1, char *arg2)
+{
+	char *argv[EXEC_ARGS_MAX] = {0};
+	int index = 0;
+	char *line = parseargs(cmd, argv, &index);
+	op_job *job;
+	pid_t pid;
+
+	if (!line)
+		return FALSE;
+
+	job = job_new(name, 'x', to);
+	if (!job) {
+		free(line);
+		return FALSE;
+	}
+
+	if (arg1)
+		argv[index++] = arg1;
+	if (arg2)
+		argv[index] = arg2;
+
+	pid = fork();
+	if (pid == 0) {
+		enable_signals();
+		setsid();
+		dup2(devnullfd, STDIN_FILENO);
+		dup2(devnullfd, STDOUT_FILENO);
+		dup2(devnullfd, STDERR_FILENO);
+		execvp(*argv, argv);
+		_exit(EXIT_FAILURE);
+	}
+	free(line);
+
+	if (pid == -1) {
+		printwarn(NULL);
+		jobs[--njobs] = NULL;
+		free(job);
+		return FALSE;
+	}
+
+	job->pid = pid;
+	job->list = list;
+	return TRUE;
+}
+
+/*
+ * Remove the NUL-separated paths like rm -rf. Subdirs are emptied
+ * by the du worker threads in parallel and removed bottom-up.
+ */
+static void rm_paths(op_job *job, char *buf, off_t len)
+{
+	struct stat sb;
+	off_t removed = 0;
+
+	for (char *path = buf; path < buf + len; path += xstrlen(path) + 1) {
+		if (!*path)
+			continue;
+
+		/* rm refuses this too */
+		if (path[0] == '/' && !path[1]) {
+			errno = EPERM;
+			op_fail(job, path);
+		} else if (lstat(path, &sb) == -1) {
+			if (errno != ENOENT) /* Like -f */
+				op_fail(job, path);
+		} else if (S_ISDIR(sb.st_mode)) {
+			if (!rm_queue(job, path, NULL) && !job->cancel)
+				op_fail(job, path);
+		} else if (unlink(path) == 0)
+			++removed;
+		else
+			op_fail(job, path);
+	}
+
+	op_progress(job, removed);
+}
+
+/*
+ * Queue a step of job for the pool: remove the paths in list, which it
+ * takes over, or give the copied dirs their modes and times without one.
+ */
+static bool job_step(op_job *job, char *list, off_t len)
+{
+	du_group *group = calloc(1, sizeof(*group));
+
+	if (!group)
+		return FALSE;
+
+	group->pending = 1;
+	group->entnum = -1;
+	group->no_aggregate = TRUE;
+	group->rmlist = list;
+	group->rmlistlen = len;
+	group->cpattrs = !list;
+	group->job = job;
+
+	if (du_push((du_task){ .group = group }, FALSE))
+		return TRUE;
+
+	free(group);
+	return FALSE;
+}
+
+/* Remove the paths like rm -rf in a job */
+static bool rm_job(char *buf, off_t len, const char *to)
+{
+	op_job *job = job_new("rm", 'r', to);
+	char *list;
+
+	if (!job)
+		return FALSE;
+
+	list = malloc(len);
+	if (list) {
+		memcpy(list, buf, len);
+		if (job_step(job, list, len))
+			return TRUE;
+		free(list);
+	}
+
+	rm_paths(job, buf, len);
+	return TRUE;
+}
+
+static bool rm_selection(void)
+{
+	off_t len;
+	char *buf = readfile(selpath, &len);
+	bool ret;
+
+	if (!buf)
+		return FALSE;
+
+	ret = rm_job(buf, len, NULL);
+	free(buf);
+	return ret;
+}
+
+/* Put where src goes in path to dst, 1 if it's taken, -1 if src can't go there */
+static int copy_check(char *src, const char *path, char *dst, struct stat *sb)
+{
+	struct stat dsb;
+	size_t len = xstrlen(src);
+
+	/* A trailing slash is no part of the name */
+	while (len > 1 && src[len - 1] == '/')
+		src[--len] = '\0';
+
+	if (lstat(src, sb) == -1)
+		return -1;
+
+	/* A dir can't go into itself */
+	if (S_ISDIR(sb->st_mode) && is_prefix(path, src, len)
+	    && (!path[len] || path[len] == '/' || len == 1)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	mkpath(path, xbasename(src), dst);
+	if (lstat(dst, &dsb) == -1)
+		return 0;
+
+	/* Nor onto itself */
+	if (dsb.st_dev == sb->st_dev && dsb.st_ino == sb->st_ino) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * Copy the selection to path like cp -iRp in a job, the entries are
+ * copied by the du worker threads. Existing entries are replaced or
+ * skipped on a single prompt, existing dirs are merged. A move renames
+ * the entries, those on another filesystem are copied and removed once
+ * all of them are in.
+ */
+static bool copy_selection(const char *path, bool move)
+{
+	char dst[PATH_MAX], msg[64];
+	char *buf, *src, *next;
+	struct stat sb;
+	du_group *group;
+	op_job *job;
+	off_t len;
+	int r, exist = 0;
+	bool overwrite = FALSE, copied = FALSE;
+
+	buf = readfile(selpath, &len);
+	if (!buf)
+		return FALSE;
+
+	for (src = buf; src < buf + len; src += xstrlen(src) + 1)
+		if (*src && copy_check(src, path, dst, &sb) > 0)
+			++exist;
+
+	if (exist) {
+		snprintf(msg, sizeof(msg), "%d exist, %s", exist, messages[MSG_OVERWRITE]);
+		r = get_input(msg);
+		if (r == ESC) {
+			free(buf);
+			printmsg(messages[MSG_CANCEL]);
+			return FALSE;
+		}
+		overwrite = xconfirm(r);
+	}
+
+	job = job_new(move ? "mv" : "cp", 'c', path);
+	if (!job) {
+		free(buf);
+		return FALSE;
+	}
+	job->overwrite = overwrite;
+
+	for (src = buf; src < buf + len; src = next) {
+		next = src + xstrlen(src) + 1;
+		if (!*src)
+			continue;
+
+		r = copy_check(src, path, dst, &sb);
+		if (r == -1) {
+			op_fail(job, src);
+			goto drop;
+		}
+
+		/* Keep existing entries, a copy merges into existing dirs */
+		if (r && !overwrite && (move || !S_ISDIR(sb.st_mode)))
+			goto drop;
+
+		if (move && rename(src, dst) == 0)
+			goto drop;
+
+		/* Only entries on another filesystem are copied */
+		if (move && errno != EXDEV) {
+			op_fail(job, src);
+			goto drop;
+		}
+
+		if (S_ISREG(sb.st_mode)) {
+			pthread_mutex_lock(&du_count_mutex);
+			job->total += sb.st_size;
+			pthread_mutex_unlock(&du_count_mutex);
+		}
+
+		group = calloc(1, sizeof(*group));
+		if (group)
+			group->cpdst = xstrdup(dst);
+		if (!group || !group->cpdst) {
+			op_fail(job, src);
+			free(group);
+			goto drop;
+		}
+
+		group->pending = 1;
+		group->entnum = -1;
+		group->no_aggregate = TRUE;
+		group->cpsrclen = xstrlen(src);
+		group->job = job;
+
+		if (du_queue_task(src, group, FALSE, FALSE, 0)) {
+			copied = TRUE;
+			continue;
+		}
+
+		op_fail(job, src);
+		free(group->cpdst);
+		free(group);
+drop:
+		/* Not to be removed after a move */
+		*src = '\0';
+	}
+
+	if (move && copied) {
+		job->srcs = buf;
+		job->srclen = len;
+	} else
+		free(buf);
+
+	return TRUE;
+}
+
+/* Check if the job is over, a move goes on to remove the copied sources */
+static bool job_done(op_job *job)
+{
+	size_t pending;
+	int status;
+	pid_t p;
+	bool rm;
+
+	if (job->pid) {
+		p = waitpid(job->pid, &status, WNOHANG);
+		if (p == 0 || (p == -1 && errno == EINTR))
+			return FALSE;
+
+		job->status = (p == job->pid && WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+		return TRUE;
+	}
+
+	pthread_mutex_lock(&running_mutex);
+	pending = job->pending;
+	pthread_mutex_unlock(&running_mutex);
+	if (pending)
+		return FALSE;
+
+	/* The entries are in, the pool gives the dirs their modes and times */
+	if (job->ndirs && job_step(job, NULL, 0))
+		return FALSE;
+	copy_dirsattrs(job); /* No room for the step */
+
+	if (!job->srcs)
+		return TRUE;
+
+	/* Sources are kept unless all of them are copied */
+	rm = !job->errors && !job->cancel;
+	if (rm) {
+		job->op = 'r';
+		job->done = 0;
+		if (job_step(job, job->srcs, job->srclen))
+			job->srcs = NULL;
+		else
+			rm_paths(job, job->srcs, job->srclen);
+	}
+	free(job->srcs);
+	job->srcs = NULL;
+
+	return !rm;
+}
+
+/* Note how the job ended and drop it */
+static void job_end(op_job *job)
+{
+	if (job->cancel)
+		snprintf(jobnote, sizeof(jobnote), "%s %s", job->name, messages[MSG_CANCEL]);
+	else if (job->errors)
+		snprintf(jobnote, sizeof(jobnote), "%s: %s: %s [%u failed]",
+			 job->name, job->errname, strerror(job->err), job->errors);
+	else if (job->status)
+		snprintf(jobnote, sizeof(jobnote), "%s %s", job->name, messages[MSG_FAILED]);
+	else
+		snprintf(jobnote, sizeof(jobnote), "%s done", job->name);
+
+	if (job->list)
+		unlink(job->list);
+	job_free(job);
+}
+
+/* End the jobs that are over, TRUE if any */
+static bool jobs_poll(void)
+{
+	bool ended = FALSE;
+
+	for (int i = 0; i < njobs;) {
+		if (!job_done(jobs[i])) {
+			++i;
+			continue;
+		}
+
+		job_end(jobs[i]);
+		--njobs;
+		memmove(jobs + i, jobs + i + 1, (njobs - i) * sizeof(*jobs));
+		ended = TRUE;
+	}
+
+#ifndef NOX11
+	/* Show notification on operation complete */
+	if (ended && cfg.x11)
+		plugscript(utils[UTIL_NTFY], F_NOWAIT | F_NOTRACE);
+#endif
+
+	return ended;
+}
+
+static void job_pause(op_job *job, bool pause)
+{
+	const ullong_t now = monotonic_ns();
+
+	if (job->pid)
+		kill(-job->pid, pause ? SIGSTOP : SIGCONT);
+
+	pthread_mutex_lock(&running_mutex);
+	if (pause)
+		job->paused_at = now;
+	else
+		job->paused_ns += now - job->paused_at;
+	job->paused = pause;
+
+	/* The held tasks go back in the queue, there's room for them */
+	if (!pause && job->nheld) {
+		memcpy(job_tasks + job_task_len, job->held, job->nheld * sizeof(du_task));
+		job_task_len += job->nheld;
+		job_held -= job->nheld;
+		job->nheld = 0;
+		pthread_cond_broadcast(&work_cond);
+	}
+	pthread_mutex_unlock(&running_mutex);
+}
+
+/* A cancelled copy removes the file it was in, the rest of its tasks are dropped */
+static void job_cancel(op_job *job)
+{
+	job->cancel = TRUE;
+	if (job->pid)
+		kill(-job->pid, SIGTERM);
+	if (job->paused)
+		job_pause(job, FALSE);
+}
+
+/* List the jobs to pause, resume or cancel one */
+static bool jobs_manage(void)
+{
+	char info[NAME_MAX + 128];
+	op_job *job;
+	int r = '1';
+
+	if (!njobs) {
+		printmsg(messages[MSG_0_JOBS]);
+		return FALSE;
+	}
+
+	attron(COLOR_PAIR(cfg.curctx + 1));
+	for (int i = 0; i < njobs; ++i) {
+		job_info(jobs[i], info, sizeof(info));
+		mvprintw(xlines - 1 - njobs + i, 0, "%d %s", i + 1, info);
+		clrtoeol();
+	}
+	attroff(COLOR_PAIR(cfg.curctx + 1));
+
+	if (njobs > 1)
+		r = get_input(messages[MSG_JOB_NUM]);
+	if (r < '1' || r >= '1' + njobs) {
+		printmsg(messages[MSG_INVALID_KEY]);
+		return FALSE;
+	}
+	job = jobs[r - '1'];
+
+	r = get_input(messages[MSG_JOB_OPTS]);
+	if (r == 'c')
+		job_cancel(job);
+	else if (r == 'p')
+		job_pause(job, !job->paused);
+	else {
+		printmsg(messages[MSG_INVALID_KEY]);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+#ifndef NOFIND
+/*
+ * Index the dir at path and all below it using the du worker threads.
+ * A walk in the background is only queued.
+ */
+static bool fidx_walk(const char *path, uint_t dirent, bool bg)
+{
+	du_group *group = calloc(1, sizeof(*group));
+
+	if (!group || !prep_threads()) {
+		free(group);
+		return FALSE;
+	}
+
+	group->pending = 1;
+	group->entnum = -1;
+	group->no_aggregate = TRUE;
+	group->fidx = TRUE;
+	group->bg = bg;
+
+	if (!du_queue_task(path, group, FALSE, FALSE, dirent)) {
+		free(group);
+		return FALSE;
+	}
+
+	if (bg || du_wait(&du_tasks_pending))
+		return TRUE;
+
+	/* The index is cleared next, no walker may be in it */
+	du_walk_stop();
+	return FALSE;
+}
+
+static void fidx_clear(void)
+{
+	/* Walks of new dirs in the background may be running */
+	pthread_mutex_lock(&fidx_mutex);
+	fidxroot[0] = '\0';
+	fidxcnt = 0;
+	fidxnameslen = 0;
+	fidxstale = FALSE;
+	if (fidxhash)
+		memset(fidxhash, 0xff, fidxhashcap * sizeof(uint_t)); /* FIDX_NONE */
+#ifdef LINUX_INOTIFY
+	if (fidxfd >= 0) {
+		close(fidxfd); /* Drops all the watches */
+		fidxfd = -1;
+	}
+	for (int i = 0; i < fidxwdcap; ++i)
+		fidxwds[i] = FIDX_NOWD;
+#endif
+	pthread_mutex_unlock(&fidx_mutex);
+}
+
+static bool fidx_build(const char *path)
+{
+	fidx_clear();
+#ifdef LINUX_INOTIFY
+	fidxfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fidxfd < 0)
+		fidxstale = TRUE;
+#else
+	/* Nothing tells us about changes */
+	fidxstale = TRUE;
+#endif
+	xstrsncpy(fidxroot, path, PATH_MAX);
+
+	printmsg(messages[MSG_INDEXING]);
+	refresh();
+
+	if (!fidx_walk(path, FIDX_NONE, FALSE)) {
+		g_state.interrupt = 0;
+		fidx_clear();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Find the entry of the dir with the given components below the root */
+static bool fidx_lookup(const char *path, uint_t *dirent)
+{
+	uint_t dir = FIDX_NONE;
+	size_t len;
+
+	for (const char *next; *path; path = next) {
+		while (*path == '/')
+			++path;
+		next = strchr(path, '/');
+		if (!next)
+			next = path + xstrlen(path);
+		len = next - path;
+		if (!len)
+			break;
+
+		dir = fidx_find(dir, path, len);
+		if (dir == FIDX_NONE)
+			return FALSE;
+	}
+
+	*dirent = dir;
+	return TRUE;
+}
+
+/*
+ * Put together the full path of an entry in buf.
+ * Returns FALSE if the entry or a dir above it is gone, or it's not below dir.
+ */
+static bool fidx_path(uint_t ent, uint_t dir, char *buf)
+{
+	uint_t chain[PATH_MAX >> 1];
+	int depth = 0;
+	size_t len;
+	bool below = (dir == FIDX_NONE);
+
+	/* Parents are always added before their entries */
+	for (uint_t i = ent; i != FIDX_NONE; i = fidxents[i].parent) {
+		if (fidxents[i].gone || depth == (PATH_MAX >> 1))
+			return FALSE;
+		if (i == dir) {
+			if (i == ent)
+				return FALSE;
+			below = TRUE;
+		}
+		chain[depth++] = i;
+	}
+
+	if (!below)
+		return FALSE;
+
+	len = (fidxroot[1] ? xstrsncpy(buf, fidxroot, PATH_MAX) - 1 : 0);
+	while (depth--) {
+		const fidx_ent *pent = &fidxents[chain[depth]];
+
+		if (len + pent->nlen + 1 > PATH_MAX)
+			return FALSE;
+		buf[len++] = '/';
+		memcpy(buf + len, fidxnames + pent->name, pent->nlen);
+		len += pent->nlen - 1;
+	}
+
+	return TRUE;
+}
+
+#ifdef LINUX_INOTIFY
+/* The caller holds fidx_mutex, walks of new dirs append meanwhile */
+static void fidx_add(uint_t dir, const char *name, bool isdir)
+{
+	char path[PATH_MAX];
+	/* The walk of a new dir may have seen it already */
+	uint_t ent = fidx_put(dir, name, xstrlen(name) + 1, 1, TRUE);
+
+	if (!isdir || ent == FIDX_NONE)
+		return;
+
+	if (dir == FIDX_NONE)
+		xstrsncpy(path, fidxroot, PATH_MAX);
+	else if (!fidx_path(dir, FIDX_NONE, path))
+		return;
+
+	mkpath(path, name, path);
+	if (!fidx_walk(path, ent, TRUE))
+		fidxstale = TRUE;
+}
+
+/* Apply the changes reported by inotify */
+static void fidx_update(void)
+{
+	alignas(struct inotify_event) char buf[NUM_EVENT_SLOTS * (EVENT_SIZE + NAME_MAX + 1)];
+	const struct inotify_event *event;
+	ssize_t len;
+	uint_t dir;
+	int count = 0;
+
+	if (fidxfd < 0)
+		return;
+
+	pthread_mutex_lock(&fidx_mutex);
+	while (!fidxstale && (len = read(fidxfd, buf, sizeof(buf))) > 0) {
+		for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *)ptr;
+
+			if ((event->mask & IN_Q_OVERFLOW) || ++count > FIDX_EVENTS_MAX) {
+				fidxstale = TRUE;
+				break;
+			}
+
+			if (event->wd < 0 || event->wd >= fidxwdcap)
+				continue;
+
+			dir = fidxwds[event->wd];
+			if (event->mask & IN_IGNORED)
+				fidxwds[event->wd] = FIDX_NOWD;
+
+			if (!event->len || dir == FIDX_NOWD)
+				continue;
+
+			if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+				fidx_drop(dir, event->name);
+			else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+				fidx_add(dir, event->name, event->mask & IN_ISDIR);
+		}
+	}
+
+	/* Stop collecting changes, the index is rebuilt on next use */
+	if (fidxstale) {
+		close(fidxfd);
+		fidxfd = -1;
+	}
+	pthread_mutex_unlock(&fidx_mutex);
+}
+#endif
+
+/* Search the names below path and show the matches in list mode */
+static char *fidx_search(const char *path)
+{
+	char fltr[REGEX_MAX], buf[PATH_MAX], **paths, *tmpdir = NULL;
+	const size_t rootlen = xstrlen(fidxroot);
+	struct entry ent = {0};
+	uint_t dir = FIDX_NONE;
+	ssize_t n = 0;
+	int msgnum = 0;
+
+	xstrsncpy(fltr, xreadline(NULL, messages[MSG_FIND]), REGEX_MAX);
+	if (!fltr[0])
+		return NULL;
+
+#ifdef PCRE2
+	pcre2_code *pcre2x = NULL;
+
+	if (cfg.regex && setfilter(&pcre2x, fltr)) {
+#else
+	regex_t re;
+
+	if (cfg.regex && setfilter(&re, fltr)) {
+#endif
+		printmsg(messages[MSG_INVALID_REG]);
+		return NULL;
+	}
+
+#ifdef PCRE2
+	fltrexp_t fltrexp = { .pcre2x = pcre2x, .str = fltr, .len = xstrlen(fltr) };
+#else
+	fltrexp_t fltrexp = { .regex = &re, .str = fltr, .len = xstrlen(fltr) };
+#endif
+	fltrexp.ascii = is_ascii(fltr, fltrexp.len);
+	fltrexp.icase = (fnstrstr == &strcasestr);
+
+#ifdef LINUX_INOTIFY
+	fidx_update();
+	/* New dirs are indexed in the background */
+	if (!du_wait(&du_bg_pending)) {
+		g_state.interrupt = 0;
+		goto free_re;
+	}
+#endif
+	/* Reuse the index if path is in the indexed subtree */
+	if (fidxstale || !rootlen || !is_prefix(path, fidxroot, rootlen)
+	    || (path[rootlen] && path[rootlen] != '/' && rootlen != 1)
+	    || !fidx_lookup(path + rootlen, &dir)) {
+		dir = FIDX_NONE;
+		if (!fidx_build(path))
+			goto free_re;
+	}
+
+	paths = malloc(LIST_FILES_MAX * sizeof(char *));
+	if (!paths)
+		goto free_re;
+
+	for (uint_t i = 0; i < fidxcnt; ++i) {
+		if (fidxents[i].gone)
+			continue;
+
+		ent.name = fidxnames + fidxents[i].name;
+		ent.nlen = fidxents[i].nlen;
+		if (!filterfn(&fltrexp, &ent) || !fidx_path(i, dir, buf))
+			continue;
+
+		if (n == LIST_FILES_MAX) {
+			msgnum = MSG_FILE_LIMIT;
+			break;
+		}
+
+		paths[n] = xstrdup(buf);
+		if (!paths[n])
+			break;
+		++n;
+	}
+
+	if (!n)
+		msgnum = MSG_0_ENTRIES;
+	else {
+		rmlistpath();
+		if (!listroot)
+			listroot = malloc(PATH_MAX);
+		if (listroot) {
+			xstrsncpy(listroot, path, PATH_MAX);
+			tmpdir = make_tmp_tree(paths, n, listroot);
+		}
+	}
+
+	while (n--)
+		free(paths[n]);
+	free(paths);
+
+	if (msgnum) {
+		printmsg(messages[msgnum]);
+		xdelay(XDELAY_INTERVAL_MS << 2);
+	}
+
+free_re:
+	if (cfg.regex)
+#ifdef PCRE2
+		pcre2_code_free(pcre2x);
+#else
+		regfree(&re);
+#endif
+	return tmpdir;
+}
+#endif
+
+/* Stat a dir entry, returns the flags of a missing file or an orphaned symlink */
+static uchar_t dentstat(int fd, const char *name, int flags, struct stat *sb)
+{
+	if (fstatat(fd, name, sb, flags) == -1) {
+		if (flags || (fstatat(fd, name, sb, AT_SYMLINK_NOFOLLOW) == -1)) {
+			/* Missing file */
+			DPRINTF_U(flags);
+			if (!flags) {
+				DPRINTF_S(name);
+				DPRINTF_S(strerror(errno));
+			}
+
+			memset(sb, 0, sizeof(struct stat));
+			return FILE_MISSING;
+		}
+
+		/* Orphaned symlink */
+		return SYM_ORPHAN;
+	}
+
+	return 0;
+}
+
+/* Copy the stat of a dir entry, the name and du blocks are set by the caller */
+static void dentset(struct entry *dentp, int fd, const struct dirent *dp, int flags,
+		    const struct stat *sb, uchar_t entflags, time_t now, uint_t timetype, bool list)
+{
+	struct stat tsb;
+
+	if (timetype == T_MOD) {
+		dentp->sec = sb->st_mtime;
+		dentp->nsec = NSEC_MTIME(*sb);
+	} else if (timetype == T_ACCESS) {
+		dentp->sec = sb->st_atime;
+		dentp->nsec = NSEC_ATIME(*sb);
+	} else {
+		dentp->sec = sb->st_ctime;
+		dentp->nsec = NSEC_CTIME(*sb);
+	}
+
+	if ((now - sb->st_mtime <= 300) || (now - sb->st_ctime <= 300))
+		entflags |= FILE_YOUNG;
+
+#if !(defined(__sun) || defined(__HAIKU__))
+	if (!flags && dp->d_type == DT_LNK) {
+		 /* Do not add sizes for links */
+		dentp->mode = (sb->st_mode & ~S_IFMT) | S_IFLNK;
+		dentp->size = list ? sb->st_size : 0;
+	} else {
+		dentp->mode = sb->st_mode;
+		dentp->size = sb->st_size;
+	}
+#else
+	dentp->mode = sb->st_mode;
+	dentp->size = sb->st_size;
+#endif
+
+#ifndef NOUG
+	dentp->uid = sb->st_uid;
+	dentp->gid = sb->st_gid;
+#endif
+
+	dentp->flags = S_ISDIR(sb->st_mode) ? 0 : ((sb->st_nlink > 1) ? HARD_LINK : 0);
+	dentp->flags |= entflags;
+
+	if (flags) {
+		/* Flag if this is a dir or symlink to a dir */
+		tsb.st_mode = sb->st_mode;
+		if (S_ISLNK(sb->st_mode)) {
+			tsb.st_mode = 0;
+			fstatat(fd, dp->d_name, &tsb, 0);
+		}
+
+		if (S_ISDIR(tsb.st_mode))
+			dentp->flags |= DIR_OR_DIRLNK;
+#if !(defined(__sun) || defined(__HAIKU__)) /* no d_type */
+	} else if (dp->d_type == DT_DIR || ((dp->d_type == DT_LNK
+		   || dp->d_type == DT_UNKNOWN) && S_ISDIR(sb->st_mode))) {
+		dentp->flags |= DIR_OR_DIRLNK;
+#endif
+	}
+}
+
+static int dentfill(char *path, struct entry **ppdents)
+{
+	uchar_t entflags = 0;
+	int flags = 0;
+	struct dirent *dp;
+	char *namep, *pnb, *buf;
+	struct entry *dentp;
+	size_t off = 0, namebuflen = NAMEBUF_INCR;
+	struct stat sb_path, sb;
+	DIR *dirp = opendir(path);
+
+	ndents = 0;
+	++dentgen;
+	gtimesecs = time(NULL);
+
+	DPRINTF_S(__func__);
+
+	if (!dirp)
+		return 0;
+
+	int fd = dirfd(dirp);
+
+	if (cfg.blkorder) {
+		first_call = TRUE;
+		num_files = 0;
+		dir_blocks = 0;
+		buf = g_buf;
+
+		if (fstatat(fd, path, &sb_path, 0) == -1)
+			goto exit;
+		dirdev = sb_path.st_dev;
+
+		if (!ihashbmp) {
+			ihashbmp = calloc(1, HASH_OCTETS << 3);
+			if (!ihashbmp)
+				goto exit;
+		} else
+			memset(ihashbmp, 0, HASH_OCTETS << 3);
+
+		if (!dir_dispatched_bmp) {
+			dir_dispatched_bmp = calloc(1, HASH_OCTETS << 3);
+			if (!dir_dispatched_bmp)
+				goto exit;
+		} else
+			memset(dir_dispatched_bmp, 0, HASH_OCTETS << 3);
+
+		if (!prep_threads())
+			goto exit;
+
+		attron(COLOR_PAIR(cfg.curctx + 1));
+	}
+
+#if _POSIX_C_SOURCE >= 200112L
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	dp = readdir(dirp);
+	if (!dp)
+		goto exit;
+
+#if defined(__sun) || defined(__HAIKU__)
+	flags = AT_SYMLINK_NOFOLLOW; /* no d_type */
+#else
+	if (cfg.blkorder || dp->d_type == DT_UNKNOWN) {
+		/*
+		 * Optimization added for filesystems which support dirent.d_type
+		 * see readdir(3)
+		 * Known drawbacks:
+		 * - the symlink size is set to 0
+		 * - the modification time of the symlink is set to that of the target file
+		 */
+		flags = AT_SYMLINK_NOFOLLOW;
+	}
+#endif
+
+	do {
+		namep = dp->d_name;
+
+		if (selforparent(namep))
+			continue;
+
+		if (!cfg.showhidden && namep[0] == '.') {
+			if (!cfg.blkorder)
+				continue;
+
+			if (fstatat(fd, namep, &sb, AT_SYMLINK_NOFOLLOW) == -1)
+				continue;
+
+			/* Use resolved (dev,ino) for duplicate check (symlink-to-dir vs real dir) */
+			struct stat sb_dir_h;
+			if (S_ISLNK(sb.st_mode)) {
+				sb_dir_h.st_mode = 0;
+				fstatat(fd, namep, &sb_dir_h, 0);
+			} else
+				sb_dir_h = sb;
+
+			if (S_ISDIR(sb_dir_h.st_mode)) {
+				if (sb_path.st_dev == sb_dir_h.st_dev) { // NOLINT
+					mkpath(path, namep, buf); // NOLINT
+					bool first = test_set_bit_dir(sb_dir_h.st_dev, sb_dir_h.st_ino);
+					dirwalk(buf, -1, FALSE, !first);
+
+					if (g_state.interrupt)
+						goto exit;
+				}
+				++num_files; /* Count directories */
+			} else {
+				/* Do not recount hard links */
+				if (sb.st_size && S_ISREG(sb.st_mode) && (sb.st_nlink <= 1 || test_set_bit((uint_t)sb.st_ino)))
+					dir_blocks += (cfg.apparentsz ? sb.st_size : sb.st_blocks);
+				++num_files;
+			}
+
+			continue;
+		}
+
+		entflags = dentstat(fd, namep, flags, &sb);
+
+		if (ndents == total_dents) {
+			if (cfg.blkorder && !du_wait(&du_tasks_pending))
+				du_walk_stop();
+
+			total_dents += cfg.blkorder ? ENTRY_INCR_DU : ENTRY_INCR;
+			*ppdents = xrealloc(*ppdents, total_dents * sizeof(**ppdents));
+			if (!*ppdents) {
+				free(pnamebuf);
+				closedir(dirp);
+				errexit();
+			}
+			DPRINTF_P(*ppdents);
+		}
+
+		/* If not enough bytes left to copy a file name of length NAME_MAX, re-allocate */
+		if (namebuflen - off < NAME_MAX + 1) {
+			namebuflen += NAMEBUF_INCR;
+
+			pnb = pnamebuf;
+			pnamebuf = (char *)xrealloc(pnamebuf, namebuflen);
+			if (!pnamebuf) {
+				free(*ppdents);
+				closedir(dirp);
+				errexit();
+			}
+			DPRINTF_P(pnamebuf);
+
+			/* realloc() may result in memory move, we must re-adjust if that happens */
+			if (pnb != pnamebuf) {
+				dentp = *ppdents;
+				dentp->name = pnamebuf;
+
+				for (int count = 1; count < ndents; ++dentp, ++count)
+					/* Current file name starts at last file name start + length */
+					(dentp + 1)->name = (char *)((size_t)dentp->name + dentp->nlen);
+			}
+		}
+
+		dentp = *ppdents + ndents;
+
+		/* Selection file name */
+		dentp->name = (char *)((size_t)pnamebuf + off);
+		dentp->nlen = xstrsncpy(dentp->name, namep, NAME_MAX + 1);
+		off += dentp->nlen;
+		dentp->id = ndents;
+#ifdef ICONS_ENABLED
+		dentp->icon = icon_match(dentp->name, dentp->nlen - 1);
+#endif
+
+		dentset(dentp, fd, dp, flags, &sb, entflags, gtimesecs, cfg.timetype, listpath != NULL);
+
+		if (cfg.blkorder) {
+			/* Use resolved (dev,ino) for duplicate check so symlink-to-dir and real dir count once when at / */
+			struct stat sb_dir;
+			if (S_ISLNK(sb.st_mode)) {
+				sb_dir.st_mode = 0;
+				fstatat(fd, namep, &sb_dir, 0);
+			} else
+				sb_dir = sb;
+
+			if (S_ISDIR(sb_dir.st_mode)) {
+				mkpath(path, namep, buf); // NOLINT
+
+				/* Need to show the disk usage of this dir; skip adding to totals if same dir already dispatched (e.g. symlink) */
+				bool first = test_set_bit_dir(sb_dir.st_dev, sb_dir.st_ino);
+				dirwalk(buf, ndents, (sb_path.st_dev != sb_dir.st_dev), !first); // NOLINT
+
+				if (g_state.interrupt)
+					goto exit;
+				++num_files; /* Count directories */
+			} else {
+				dentp->blocks = (cfg.apparentsz ? sb.st_size : sb.st_blocks);
+				/* Do not recount hard links */
+				if (sb.st_size && S_ISREG(sb.st_mode) && (sb.st_nlink <= 1 || test_set_bit((uint_t)sb.st_ino)))
+					dir_blocks += dentp->blocks;
+				++num_files;
+			}
+		}
+
+		++ndents;
+	} while ((dp = readdir(dirp)));
+
+exit:
+	if (g_state.duinit && cfg.blkorder) {
+		if (!du_wait(&du_tasks_pending))
+			du_walk_stop();
+
+		attroff(COLOR_PAIR(cfg.curctx + 1));
+		for (int i = 0; i < num_du_threads; ++i) {
+			num_files += core_files[i];
+			dir_blocks += core_blocks[i];
+		}
+	}
+
+	/* Should never be null */
+	if (closedir(dirp) == -1)
+		errexit();
+
+	return ndents;
+}
+
+static void populate(char *path, char *lastname)
+{
+#ifdef DEBUG
+	struct timespec ts1, ts2;
+
+	clock_gettime(CLOCK_REALTIME, &ts1); /* Use CLOCK_MONOTONIC on FreeBSD */
+#endif
+
+	nameidx_stop();
+	ndents = dentfill(path, &pdents);
+	/* Entry ids are reassigned */
+	fltrcache_load();
+	if (!ndents)
+		return;
+
+#ifndef NOUG
+	if (g_state.uidgid || cfg.ownerorder)
+		idmap_warm();
+#endif
+
+#ifndef NOSORT
+	ENTSORT(pdents, ndents, entrycmpfn);
+#endif
+
+#ifdef DEBUG
+	clock_gettime(CLOCK_REALTIME, &ts2);
+	DPRINTF_U(ts2.tv_nsec - ts1.tv_nsec);
+#endif
+
+	/* Find cur from history */
+	/* No NULL check for lastname, always points to an array */
+	move_cursor(*lastname ? dentfind(lastname, ndents) : 0, 0);
+
+	// Force full redraw
+	last_curscroll = -1;
+}
+
+#ifndef NOFIFO
+static void notify_fifo(bool force)
+{
+	if (!fifopath)
+		return;
+
+	if (fifofd == -1) {
+		fifofd = open(fifopath, O_WRONLY|O_NONBLOCK|O_CLOEXEC);
+		if (fifofd == -1) {
+			if (errno != ENXIO)
+				/* Unexpected error, the FIFO file might have been removed */
+				/* We give up FIFO notification */
+				fifopath = NULL;
+			return;
+		}
+	}
+
+	static struct entry lastentry;
+
+	if (!force && !memcmp(&lastentry, &pdents[cur], sizeof(struct entry))) // NOLINT
+		return;
+
+	lastentry = pdents[cur];
+
+	char path[PATH_MAX];
+	size_t len = mkpath(g_ctx[cfg.curctx].c_path, ndents ? pdents[cur].name : "", path);
+
+	path[len - 1] = '\n';
+
+	ssize_t ret = write(fifofd, path, len);
+
+	if (ret != (ssize_t)len && !(ret == -1 && (errno == EAGAIN || errno == EPIPE))) {
+		DPRINTF_S(strerror(errno));
+	}
+}
+
+static void send_to_explorer(int *presel)
+{
+	if (nselected) {
+		int fd = open(fifopath, O_WRONLY|O_NONBLOCK|O_CLOEXEC, 0600);
+		if ((fd == -1) || !seltofile(fd, NULL, NEWLINE))
+			printwarn(presel);
+		else {
+			resetselind();
+			clearselection();
+		}
+		if (fd > 1)
+			close(fd);
+	} else
+		notify_fifo(TRUE); /* Send opened path to NNN_FIFO */
+}
+#endif
+
+static void move_cursor(int target, int ignore_scrolloff)
+{
+	target = MAX(0, MIN(ndents - 1, target));
+	last_curscroll = curscroll;
+	last = cur;
+	cur = target;
+
+	if (!ignore_scrolloff) {
+		int delta = target - last;
+		int scrolloff = MIN(SCROLLOFF, ONSCREEN >> 1);
+
+		/*
+		 * When ignore_scrolloff is 1, the cursor can jump into the scrolloff
+		 * margin area, but when ignore_scrolloff is 0, act like a boa
+		 * constrictor and squeeze the cursor towards the middle region of the
+		 * screen by allowing it to move inward and disallowing it to move
+		 * outward (deeper into the scrolloff margin area).
+		 */
+		if (((cur < (curscroll + scrolloff)) && delta < 0)
+		    || ((cur > (curscroll + ONSCREEN - scrolloff - 1)) && delta > 0))
+			curscroll += delta;
+	}
+	curscroll = MIN(curscroll, MIN(cur, ndents - ONSCREEN));
+	curscroll = MAX(curscroll, MAX(cur - (ONSCREEN - 1), 0));
+
+#ifndef NOFIFO
+	if (!g_state.fifomode)
+		notify_fifo(FALSE); /* Send hovered path to NNN_FIFO */
+#endif
+}
+
+static void handle_screen_move(enum action sel)
+{
+	switch (sel) {
+	case SEL_NEXT:
+		if (cfg.rollover || (cur != ndents - 1))
+			move_cursor((cur + 1) % ndents, 0);
+		break;
+	case SEL_PREV:
+		if (cfg.rollover || cur)
+			move_cursor((cur + ndents - 1) % ndents, 0);
+		break;
+	case SEL_PGDN:
+		move_cursor(curscroll + (ONSCREEN - 1), 1);
+		curscroll += ONSCREEN - 1;
+		break;
+	case SEL_CTRL_D:
+		move_cursor(curscroll + (ONSCREEN - 1), 1);
+		curscroll += ONSCREEN >> 1;
+		break;
+	case SEL_PGUP:
+		move_cursor(curscroll, 1);
+		curscroll -= ONSCREEN - 1;
+		break;
+	case SEL_CTRL_U:
+		move_cursor(curscroll, 1);
+		curscroll -= ONSCREEN >> 1;
+		break;
+	case SEL_JUMP:
+	{
+		char *input = xreadline(NULL, "jump (+n/-n/n): ");
+
+		if (!input || !*input)
+			break;
+		if (input[0] == '-') {
+			cur -= atoi(input + 1);
+			if (cur < 0)
+				cur = 0;
+		} else if (input[0] == '+') {
+			cur += atoi(input + 1);
+			if (cur >= ndents)
+				cur = ndents - 1;
+		} else {
+			int index = atoi(input);
+
+			if ((index < 1) || (index > ndents))
+				break;
+			cur = index - 1;
+		}
+		move_cursor(cur, 1);
+		curscroll -= ONSCREEN >> 1;
+		break;
+	}
+	case SEL_HOME:
+		move_cursor(0, 1);
+		break;
+	case SEL_END:
+		move_cursor(ndents - 1, 1);
+		break;
+	case SEL_YOUNG:
+	{
+		for (int r = cur;;) {
+			if (++r >= ndents)
+				r = 0;
+			if (r == cur)
+				break;
+			if (pdents[r].flags & FILE_YOUNG) {
+				move_cursor(r, 0);
+				break;
+			}
+		}
+		break;
+	}
+	default: /* case SEL_FIRST */
+	{
+		int c = get_input(messages[MSG_FIRST]);
+
+		if (!c)
+			break;
+
+		c = TOUPPER(c);
+
+		int r = (c == TOUPPER(*pdents[cur].name)) ? (cur + 1) : 0;
+
+		for (; r < ndents; ++r) {
+			if (((c == '\'') && !(pdents[r].flags & DIR_OR_DIRLNK))
+			    || (c == TOUPPER(*pdents[r].name))) {
+				move_cursor((r) % ndents, 0);
+				break;
+			}
+		}
+		break;
+	}
+	}
+}
+
+/*
+ * Apply the navigation keys queued up while the last frame was drawn,
+ * without drawing in between. Keeps reading moves till the next frame
+ * is due. Any other key is pushed back for nextsel().
+ */
+static void coalesce_moves(void)
+{
+	ullong_t now;
+	wint_t c;
+	int r, i;
+
+	while (1) {
+		now = monotonic_ns();
+		timeout((lastframe + frame_ns > now) ? (int)((lastframe + frame_ns - now) / 1000000) : 0);
+
+		r = get_wch(&c);
+		if (r == ERR)
+			break;
+
+		for (i = 0; i < (int)ELEMENTS(bindings); ++i)
+			if (c == bindings[i].sym)
+				break;
+
+		if (i == (int)ELEMENTS(bindings) || bindings[i].act < SEL_NEXT
+		    || bindings[i].act > SEL_END) {
+			(r == KEY_CODE_YES) ? ungetch(c) : unget_wch(c);
+			break;
+		}
+
+		handle_screen_move(bindings[i].act);
+	}
+
+	settimeout();
+}
+
+#ifdef DEBUG
+static void log_latency(void)
+{
+	for (int i = 0; i < LATENCY_BUCKETS; ++i)
+		xprintf(DEBUG_FD, "frame latency %s%4u ms: %u\n", (i == LATENCY_BUCKETS - 1) ? ">=" : " <",
+			1U << ((i == LATENCY_BUCKETS - 1) ? i - 1 : i), latency[i]);
+}
+#endif
+
+static void handle_openwith(const char *path, const char *name, char *newpath, char *tmp)
+{
+	/* Confirm if app is CLI or GUI */
+	int r = get_input(messages[MSG_CLI_MODE]);
+
+	r = (r == 'c' ? F_CLI :
+	     ((r == 'g' || r == '\r') ? (F_NOWAIT | F_NOTRACE | F_MULTI) : 0));
+	if (r) {
+		mkpath(path, name, newpath);
+		spawn(tmp, newpath, NULL, NULL, r);
+	}
+}
+
+static void copynextname(char *lastname)
+{
+	if (cur) {
+		cur += (cur != (ndents - 1)) ? 1 : -1;
+		copycurname();
+	} else
+		lastname[0] = '\0';
+}
+
+static int handle_context_switch(enum action sel)
+{
+	int r = -1;
+
+	switch (sel) {
+	case SEL_CYCLE: // fallthrough
+	case SEL_CYCLER:
+		/* visit next and previous contexts */
+		r = cfg.curctx;
+		if (sel == SEL_CYCLE)
+			do
+				r = (r + 1) & ~CTX_MAX;
+			while (!g_ctx[r].c_cfg.ctxactive);
+		else {
+			do /* Attempt to create a new context */
+				r = (r + 1) & ~CTX_MAX;
+			while (g_ctx[r].c_cfg.ctxactive && (r != cfg.curctx));
+
+			if (r == cfg.curctx) /* If all contexts are active, reverse cycle */
+				do
+					r = (r + (CTX_MAX - 1)) & (CTX_MAX - 1);
+				while (!g_ctx[r].c_cfg.ctxactive);
+		} // fallthrough
+	default: /* SEL_CTXN */
+		if (sel >= SEL_CTX1) /* CYCLE keys are lesser in value */
+			r = sel - SEL_CTX1; /* Save the next context id */
+
+		if (cfg.curctx == r) {
+			if (sel == SEL_CYCLE)
+				(r == CTX_MAX - 1) ? (r = 0) : ++r;
+			else if (sel == SEL_CYCLER)
+				(r == 0) ? (r = CTX_MAX - 1) : --r;
+			else
+				return -1;
+		}
+	}
+
+	return r;
+}
+
+static void reset_sort_flags(void)
+{
+	cfg.timeorder = 0;
+	cfg.sizeorder = 0;
+	cfg.apparentsz = 0;
+	cfg.blkorder = 0;
+	cfg.extnorder = 0;
+	cfg.ownerorder = 0;
+}
+
+static int set_sort_flags(int r)
+{
+	bool session = (r == '\0');
+	bool reverse = FALSE;
+
+	if (ISUPPER_(r) && (r != 'R') && (r != 'C')) {
+		reverse = TRUE;
+		r = TOLOWER(r);
+	}
+
+	/* Set the correct input in case of a session load */
+	if (session) {
+		if (cfg.apparentsz) {
+			cfg.apparentsz = 0;
+			r = 'a';
+		} else if (cfg.blkorder) {
+			cfg.blkorder = 0;
+			r = 'd';
+		}
+
+		/* Ensure function pointers are in sync with cfg. */
+		entrycmpfn = cfg.reverse ? &reventrycmp : &entrycmp;
+		namecmpfn = cfg.version ? &xstrverscasecmp : &xstricmp;
+	} else if (r == CONTROL('T')) {
+		/* Cycling order: clear -> size -> time -> clear */
+		if (cfg.timeorder)
+			r = 's';
+		else if (cfg.sizeorder)
+			r = 'c';
+		else
+			r = 't';
+	}
+
+	switch (r) {
+	case 'a': /* Apparent du */
+		cfg.apparentsz ^= 1;
+		if (cfg.apparentsz) {
+			cfg.blkorder = 1;
+			blk_shift = 0;
+		} else
+			cfg.blkorder = 0;
+		// fallthrough
+	case 'd': /* Disk usage */
+		if (r == 'd') {
+			if (!cfg.apparentsz)
+				cfg.blkorder ^= 1;
+			cfg.apparentsz = 0;
+			blk_shift = ffs(S_BLKSIZE) - 1;
+		}
+
+		if (cfg.blkorder)
+			cfg.showdetail = 1;
+		cfg.timeorder = 0;
+		cfg.sizeorder = 0;
+		cfg.extnorder = 0;
+		cfg.ownerorder = 0;
+		if (!session) {
+			cfg.reverse = 0;
+			entrycmpfn = &entrycmp;
+		}
+		endselection(TRUE); /* We are going to reload dir */
+		break;
+	case 'c':
+		reset_sort_flags();
+		cfg.reverse = 0;
+		cfg.version = 0;
+		entrycmpfn = &entrycmp;
+		namecmpfn = &xstricmp;
+		break;
+	case 'e': /* File extension */ {
+		bool val = cfg.extnorder ^ 1;
+		reset_sort_flags();
+		cfg.extnorder = val;
+		cfg.reverse = 0;
+		entrycmpfn = &entrycmp;
+		break;
+	}
+#ifndef NOUG
+	case 'o': /* Owner */ {
+		bool val = cfg.ownerorder ^ 1;
+		reset_sort_flags();
+		cfg.ownerorder = val;
+		cfg.reverse = 0;
+		entrycmpfn = &entrycmp;
+		break;
+	}
+#endif
+	case 'r': /* Reverse sort */
+		cfg.reverse ^= 1;
+		entrycmpfn = cfg.reverse ? &reventrycmp : &entrycmp;
+		break;
+	case 's': /* File size */ {
+		bool val = cfg.sizeorder ^ 1;
+		reset_sort_flags();
+		cfg.sizeorder = val;
+		cfg.reverse = 0;
+		entrycmpfn = &entrycmp;
+		break;
+	}
+	case 't': /* Time */ {
+		bool val = cfg.timeorder ^ 1;
+		reset_sort_flags();
+		cfg.timeorder = val;
+		cfg.reverse = 0;
+		entrycmpfn = &entrycmp;
+		break;
+	}
+	case 'v': /* Version */
+		cfg.version ^= 1;
+		namecmpfn = cfg.version ? &xstrverscasecmp : &xstricmp;
+		reset_sort_flags();
+		break;
+	default:
+		return 0;
+	}
+
+	if (reverse) {
+		cfg.reverse = 1;
+		entrycmpfn = &reventrycmp;
+	}
+
+	cfgsort[cfg.curctx] = (uchar_t)r;
+
+	return r;
+}
+
+static bool set_time_type(int *presel)
+{
+	bool ret = FALSE;
+	char buf[] = "'a'ccess / 'c'hange / 'm'od [ ]";
+
+	buf[sizeof(buf) - 3] = cfg.timetype == T_MOD ? 'm' : (cfg.timetype == T_ACCESS ? 'a' : 'c');
+
+	int r = get_input(buf);
+
+	if (r == 'a' || r == 'c' || r == 'm') {
+		r = (r == 'm') ? T_MOD : ((r == 'a') ? T_ACCESS : T_CHANGE);
+		if (cfg.timetype != r) {
+			cfg.timetype = r;
+
+			if (cfg.filtermode || g_ctx[cfg.curctx].c_fltr[1])
+				*presel = FILTER;
+
+			ret = TRUE;
+		} else
+			r = MSG_NOCHANGE;
+	} else
+		r = MSG_INVALID_KEY;
+
+	if (!ret)
+		printwait(messages[r], presel);
+
+	return ret;
+}
+
+static void statusbar(char *path)
+{
+	int i = 0, len = 0;
+	char *ptr;
+	pEntry pent = &pdents[cur];
+
+	if (!ndents) {
+		printmsg("0/0");
+		showjobs();
+		return;
+	}
+
+	/* Get the file extension for regular files */
+	if (S_ISREG(pent->mode)) {
+		i = (int)(pent->nlen - 1);
+		ptr = xextension(pent->name, i);
+		if (ptr)
+			len = i - (ptr - pent->name);
+		if (!ptr || len > 5 || len < 2)
+			ptr = "\b";
+	} else
+		ptr = "\b";
+
+	attron(COLOR_PAIR(cfg.curctx + 1));
+
+	if (cfg.fileinfo && getfiletype())
+		mvaddstr(xlines - 2, 2, g_buf);
+
+	tolastln();
+
+	printw("%d/%d ", cur + 1, ndents);
+
+	if (g_state.selmode || nselected) {
+		attron(A_REVERSE);
+		addch(' ');
+		if (g_state.rangesel)
+			addch('*');
+		else if (g_state.selmode)
+			addch('+');
+		if (nselected)
+			addstr(xitoa(nselected));
+		addch(' ');
+		attroff(A_REVERSE);
+		addch(' ');
+	}
+
+	if (cfg.blkorder) { /* du mode */
+		char buf[24];
+
+		xstrsncpy(buf, coolsize(dir_blocks << blk_shift), 12);
+
+		printw("%cu:%s avail:%s files:%llu %lluB %s\n",
+		       (cfg.apparentsz ? 'a' : 'd'), buf, fsavail(path),
+		       num_files, (ullong_t)pent->blocks << blk_shift, ptr);
+	} else { /* light or detail mode */
+		char sort[] = "\0\0\0\0\0";
+
+		if (cfg.filtermode)
+			addch('F');
+
+		getorderstr(sort) ? addstr(sort) : addch(' ');
+
+		const entdtl_t *dtl = getdtl(pent);
+
+		/* Timestamp */
+		print_time(dtl);
+
+		addch(' ');
+		addstr(get_lsperms(pent->mode));
+		addch(' ');
+#ifndef NOUG
+		if (g_state.uidgid) {
+			addstr(getpwname(pent->uid));
+			addch(':');
+			addstr(getgrname(pent->gid));
+			addch(' ');
+		}
+#endif
+		if (S_ISLNK(pent->mode)) {
+			if (!cfg.fileinfo) {
+				i = readlink(pent->name, g_buf, PATH_MAX);
+				addstr(coolsize(i >= 0 ? i : pent->size)); /* Show symlink size */
+				if (i > 1) { /* Show symlink target */
+					int y;
+
+					addstr(" ->");
+					getyx(stdscr, len, y);
+					i = MIN(i, xcols - y);
+					g_buf[i] = '\0';
+					addstr(g_buf);
+				}
+			}
+		} else {
+			if (dtl->szoff)
+				addstr(dtl->info + dtl->szoff);
+			else {
+				addstr(coolsize(pent->size));
+				addch(' ');
+			}
+			addstr(ptr);
+			if (pent->flags & HARD_LINK) {
+				struct stat sb;
+
+				if (stat(pent->name, &sb) != -1) {
+					addch(' ');
+					addstr(xitoa((int)sb.st_nlink)); /* Show number of links */
+					addch('-');
+					addstr(xitoa((int)sb.st_ino)); /* Show inode number */
+				}
+			}
+		}
+		clrtoeol();
+	}
+
+	attroff(COLOR_PAIR(cfg.curctx + 1));
+	showjobs();
+	/* Place HW cursor on current for Braille systems */
+	tocursor();
+}
+
+static inline void markhovered(void)
+{
+	if (cfg.showdetail && ndents) { /* Bold forward arrowhead */
+		tocursor();
+		addch('>' | A_BOLD);
+	}
+}
+
+#define PREVIEW_BORDER_COL (xcols / 2)
+#define PREVIEW_COL        (PREVIEW_BORDER_COL + 2)
+#define PREVIEW_WIDTH      (xcols - PREVIEW_COL - 1)
+#define MIN_PREVIEW_COLS   40
+#define PREVIEW_CANCEL_MS  50 /* Check for a newer request while the previewer runs */
+#define PREVIEW_DRAIN_MS   500 /* Wait for a stale answer before restarting the co-process */
+#define PREVIEW_REAP_MS    500 /* Wait for a previewer to exit before killing it */
+#define PREVIEW_HELLO_MS   1000
+#define PREVIEW_HELLO      "nnn-preview 1\n"
+#define PREVIEW_TEXT_CHECK 512 /* Bytes checked to tell text from binary */
+
+/* Check if a file is likely text from its initial bytes */
+static bool is_text(const unsigned char *buf, ssize_t n)
+{
+	if (n <= 0)
+		return FALSE;
+
+	/* Reject known binary magic signatures */
+	static const struct {
+		const unsigned char bytes[8];
+		unsigned char len;
+	} magics[] = {
+		{ { '%',  'P',  'D',  'F'              }, 4 }, /* PDF */
+		{ { 0x89, 'P',  'N',  'G'              }, 4 }, /* PNG */
+		{ { 'G',  'I',  'F',  '8'              }, 4 }, /* GIF */
+		{ { 0xFF, 0xD8, 0xFF                   }, 3 }, /* JPEG */
+		{ { 'P',  'K',  0x03, 0x04             }, 4 }, /* ZIP */
+		{ { 0x7F, 'E',  'L',  'F'              }, 4 }, /* ELF */
+		{ { 0x1F, 0x8B                         }, 2 }, /* Gzip */
+		{ { 'B',  'M'                          }, 2 }, /* BMP */
+		{ { 'R',  'I',  'F',  'F'              }, 4 }, /* RIFF */
+		{ { 'O',  'g',  'g',  'S'              }, 4 }, /* OGG */
+		{ { 'f',  'L',  'a',  'C'              }, 4 }, /* FLAC */
+		{ { 'I',  'D',  '3'                    }, 3 }, /* MP3 ID3 */
+		{ { 0xFE, 0xED, 0xFA                   }, 3 }, /* Mach-O */
+		{ { 0xFD, '7',  'z',  'X',  'Z',  0x00 }, 6 }, /* XZ */
+		{ { '7',  'z',  0xBC, 0xAF, 0x27, 0x1C }, 6 }, /* 7z */
+		{ { 'S',  'Q',  'L',  'i',  't',  'e'  }, 6 }, /* SQLite */
+	};
+
+	for (size_t i = 0; i < sizeof(magics) / sizeof(magics[0]); ++i) {
+		if (n >= magics[i].len
+		    && !memcmp(buf, magics[i].bytes, magics[i].len))
+			return FALSE;
+	}
+
+	/* MP3 sync word (needs mask check) */
+	if (n >= 2 && buf[0] == 0xFF && (buf[1] & 0xE0) == 0xE0)
+		return FALSE;
+
+	/* Check for NUL bytes and non-text control characters */
+	for (ssize_t i = 0; i < n; ++i) {
+		unsigned char c = buf[i];
+		if (c == '\0')
+			return FALSE;
+		/* Reject most control chars except common text ones */
+		if (c < 0x20 && c != '\n' && c != '\r' && c != '\t'
+		    && c != '\f' && c != '\033') /* ESC for ANSI */
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* A newer preview was requested, a key was pressed while working ahead or nnn is quitting */
+static bool preview_stale(uint_t gen)
+{
+	bool ret;
+
+	pthread_mutex_lock(&preview_mutex);
+	ret = (gen != prevgen) || prevquit || (prefetching && gen != prefgen);
+	pthread_mutex_unlock(&preview_mutex);
+
+	return ret;
+}
+
+/* Add a line wrapped at width to the preview, FALSE once the pane is full */
+static bool preview_addline(preview_t *pv, char *line, size_t len, int width, int maxrows)
+{
+	size_t off = 0, n;
+
+	/* Strip trailing newline */
+	if (len > 0 && line[len - 1] == '\n')
+		--len;
+	if (len > 0 && line[len - 1] == '\r')
+		--len;
+
+	/* Replace tabs with spaces for consistent display */
+	for (size_t i = 0; i < len; ++i)
+		if (line[i] == '\t')
+			line[i] = ' ';
+
+	/* Wrap long lines across multiple rows */
+	do {
+		if (pv->rows >= maxrows)
+			return FALSE;
+
+		n = MIN(len - off, (size_t)width);
+		if (pv->len + n + 1 > pv->cap) {
+			pv->cap = (pv->len + n + 1) << 1;
+			pv->buf = xrealloc(pv->buf, pv->cap);
+			if (!pv->buf) {
+				pv->len = pv->cap = 0;
+				pv->rows = 0;
+				return FALSE;
+			}
+		}
+
+		memcpy(pv->buf + pv->len, line + off, n);
+		pv->len += n;
+		pv->buf[pv->len++] = '\0';
+		++pv->rows;
+		off += n;
+	} while (off < len);
+
+	return pv->rows < maxrows;
+}
+
+/* In a previewer child forked by the preview thread */
+static void preview_child(void)
+{
+	sigset_t mask;
+
+	setpgid(0, 0); /* Cancel kills the whole pipeline */
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+	/* Don't read from the terminal */
+	dup2(devnullfd, STDIN_FILENO);
+}
+
+/* Wait for a previewer to exit, kill it if it doesn't in time */
+static void preview_reap(pid_t pid)
+{
+	pid_t r;
+
+	for (int ms = 0; (r = waitpid(pid, NULL, WNOHANG)) == 0 || (r == -1 && errno == EINTR);
+	     ms += PREVIEW_CANCEL_MS) {
+		if (ms >= PREVIEW_REAP_MS) {
+			kill(-pid, SIGKILL);
+			waitpid(pid, NULL, 0);
+			return;
+		}
+		usleep(PREVIEW_CANCEL_MS * 1000);
+	}
+}
+
+/* Read the output of the .npreview plugin, kill it if the preview goes stale */
+static void preview_run(const char *prog, const char *fpath, int width, int height, uint_t gen, preview_t *pv)
+{
+	char widthbuf[16], heightbuf[16], line[PREVIEW_MAX_LINE];
+	char *ptr, *nl;
+	struct pollfd pfd;
+	size_t len = 0;
+	ssize_t n;
+	int pipefd[2];
+	bool more = TRUE;
+
+	if (pipe(pipefd) == -1)
+		return;
+
+	snprintf(widthbuf, sizeof(widthbuf), "%d", width);
+	snprintf(heightbuf, sizeof(heightbuf), "%d", height);
+
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		preview_child();
+		close(pipefd[0]);
+		dup2(pipefd[1], STDOUT_FILENO);
+		dup2(pipefd[1], STDERR_FILENO);
+		close(pipefd[1]);
+
+		execlp(prog, prog, fpath, widthbuf, heightbuf, (char *)NULL);
+		_exit(EXIT_FAILURE);
+	}
+	close(pipefd[1]);
+
+	if (pid == -1) {
+		close(pipefd[0]);
+		return;
+	}
+
+	pfd.fd = pipefd[0];
+	pfd.events = POLLIN;
+
+	while (more) {
+		if (preview_stale(gen)) {
+			kill(-pid, SIGTERM);
+			break;
+		}
+
+		n = poll(&pfd, 1, PREVIEW_CANCEL_MS);
+		if (n == 0 || (n == -1 && errno == EINTR))
+			continue;
+
+		n = (n == -1) ? -1 : read(pipefd[0], line + len, sizeof(line) - 1 - len);
+		if (n <= 0) {
+			if (len) /* Last line without a newline */
+				preview_addline(pv, line, len, width, height - 1);
+			break;
+		}
+
+		len += n;
+		ptr = line;
+		while (more && (nl = memchr(ptr, '\n', line + len - ptr))) {
+			more = preview_addline(pv, ptr, nl - ptr + 1, width, height - 1);
+			ptr = nl + 1;
+		}
+
+		/* Split overlong lines like fgets() */
+		if (more && ptr == line && len == sizeof(line) - 1) {
+			more = preview_addline(pv, line, len, width, height - 1);
+			ptr = line + len;
+		}
+
+		len -= ptr - line;
+		memmove(line, ptr, len);
+	}
+
+	/* The pane is full, don't wait for the rest */
+	if (!more)
+		kill(-pid, SIGTERM);
+	close(pipefd[0]);
+	preview_reap(pid);
 }
 
-static void copynextname(char *lastname)
+static void prevsrv_stop(void)
 {
-	if (cur) {
-		cur += (cur != (ndents - 1)) ? 1 : -1;
-		copycurname();
-	} else
-		lastname[0] = '\0';
+	if (prevsrvfd == -1)
+		return;
+
+	close(prevsrvfd);
+	prevsrvfd = -1;
+	prevsrvlen = 0;
+	kill(-prevsrvpid, SIGTERM);
+	preview_reap(prevsrvpid);
 }
 
-static int handle_context_switch(enum action sel)
+/* Read more output of the co-process, waits up to ms. Returns -1 on EOF. */
+static ssize_t prevsrv_fill(int ms)
 {
-	int r = -1;
+	struct pollfd pfd = {.fd = prevsrvfd, .events = POLLIN};
+	ssize_t n = poll(&pfd, 1, ms);
 
-	switch (sel) {
-	case SEL_CYCLE: // fallthrough
-	case SEL_CYCLER:
-		/* visit next and previous contexts */
-		r = cfg.curctx;
-		if (sel == SEL_CYCLE)
-			do
-				r = (r + 1) & ~CTX_MAX;
-			while (!g_ctx[r].c_cfg.ctxactive);
-		else {
-			do /* Attempt to create a new context */
-				r = (r + 1) & ~CTX_MAX;
-			while (g_ctx[r].c_cfg.ctxactive && (r != cfg.curctx));
+	if (n <= 0)
+		return (n == 0 || errno == EINTR) ? 0 : -1;
 
-			if (r == cfg.curctx) /* If all contexts are active, reverse cycle */
-				do
-					r = (r + (CTX_MAX - 1)) & (CTX_MAX - 1);
-				while (!g_ctx[r].c_cfg.ctxactive);
-		} // fallthrough
-	default: /* SEL_CTXN */
-		if (sel >= SEL_CTX1) /* CYCLE keys are lesser in value */
-			r = sel - SEL_CTX1; /* Save the next context id */
+	n = read(prevsrvfd, prevsrvbuf + prevsrvlen, sizeof(prevsrvbuf) - prevsrvlen);
+	if (n <= 0)
+		return -1;
 
-		if (cfg.curctx == r) {
-			if (sel == SEL_CYCLE)
-				(r == CTX_MAX - 1) ? (r = 0) : ++r;
-			else if (sel == SEL_CYCLER)
-				(r == 0) ? (r = CTX_MAX - 1) : --r;
-			else
-				return -1;
+	prevsrvlen += n;
+	return n;
+}
+
+static void prevsrv_consume(size_t len)
+{
+	prevsrvlen -= len;
+	memmove(prevsrvbuf, prevsrvbuf + len, prevsrvlen);
+}
+
+/*
+ * Start the previewer as a co-process with NNN_PREVIEW_SERVER=1 set.
+ * A previewer that supports it says PREVIEW_HELLO, others exit or print
+ * something else and are run once per preview.
+ */
+static bool prevsrv_start(const char *prog)
+{
+	extern char **environ;
+	static char srvenv[] = "NNN_PREVIEW_SERVER=1";
+	char *argv[] = {(char *)prog, NULL};
+	char **envp;
+	size_t n = 0;
+	int sv[2], nullfd;
+
+	while (environ[n])
+		++n;
+
+	envp = malloc((n + 2) * sizeof(char *));
+	if (!envp)
+		return FALSE;
+
+	memcpy(envp, environ, n * sizeof(char *));
+	envp[n] = srvenv;
+	envp[n + 1] = NULL;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		free(envp);
+		return FALSE;
+	}
+
+	nullfd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	prevsrvpid = fork();
+	if (prevsrvpid == 0) {
+		preview_child();
+		close(sv[0]);
+		dup2(sv[1], STDIN_FILENO);
+		dup2(sv[1], STDOUT_FILENO);
+		if (nullfd != -1)
+			dup2(nullfd, STDERR_FILENO);
+		close(sv[1]);
+
+		execve(prog, argv, envp);
+		_exit(EXIT_FAILURE);
+	}
+
+	free(envp);
+	close(sv[1]);
+	if (nullfd != -1)
+		close(nullfd);
+
+	if (prevsrvpid == -1) {
+		close(sv[0]);
+		return FALSE;
+	}
+
+	fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+	prevsrvfd = sv[0];
+	prevsrvlen = 0;
+
+	for (int ms = 0; prevsrvlen < sizeof(PREVIEW_HELLO) - 1 && ms < PREVIEW_HELLO_MS;
+	     ms += PREVIEW_CANCEL_MS)
+		if (prevsrv_fill(PREVIEW_CANCEL_MS) < 0)
+			break;
+
+	if (prevsrvlen < sizeof(PREVIEW_HELLO) - 1
+	    || memcmp(prevsrvbuf, PREVIEW_HELLO, sizeof(PREVIEW_HELLO) - 1)) {
+		prevsrv_stop();
+		return FALSE;
+	}
+
+	prevsrv_consume(sizeof(PREVIEW_HELLO) - 1);
+	return TRUE;
+}
+
+/*
+ * Wait for more output of the co-process. Gives up if the preview stays
+ * stale for PREVIEW_DRAIN_MS, the co-process is restarted then.
+ */
+static bool prevsrv_wait(uint_t gen, ullong_t *stale)
+{
+	if (preview_stale(gen)) {
+		if (!*stale)
+			*stale = monotonic_ns();
+		else if (monotonic_ns() - *stale >= (ullong_t)PREVIEW_DRAIN_MS * 1000000)
+			return FALSE;
+	}
+
+	return prevsrv_fill(PREVIEW_CANCEL_MS) >= 0;
+}
+
+/*
+ * Preview a file with the co-process. The request is the line
+ * "<id> <width> <height> <path length>" followed by the path, the
+ * answer is the line "<id> <length>" followed by the preview text.
+ * Returns FALSE if the co-process has to be restarted.
+ */
+static bool prevsrv_query(const char *fpath, int width, int height, uint_t gen, preview_t *pv)
+{
+	char hdr[64];
+	const size_t pathlen = xstrlen(fpath);
+	size_t left, n;
+	ullong_t stale = 0;
+	uint_t id;
+	char *nl;
+	bool more = TRUE;
+	int len = snprintf(hdr, sizeof(hdr), "%u %d %d %zu\n", gen, width, height, pathlen);
+
+	if (write(prevsrvfd, hdr, len) != len || write(prevsrvfd, fpath, pathlen) != (ssize_t)pathlen)
+		return FALSE;
+
+	while (!(nl = memchr(prevsrvbuf, '\n', prevsrvlen)))
+		if (prevsrvlen == sizeof(prevsrvbuf) || !prevsrv_wait(gen, &stale))
+			return FALSE;
+
+	*nl = '\0';
+	if (sscanf(prevsrvbuf, "%u %zu", &id, &left) != 2 || id != gen)
+		return FALSE;
+	prevsrv_consume(nl - prevsrvbuf + 1);
+
+	while (left) {
+		if (!prevsrvlen && !prevsrv_wait(gen, &stale))
+			return FALSE;
+
+		n = MIN(left, prevsrvlen);
+		nl = memchr(prevsrvbuf, '\n', n);
+		if (nl) /* A full line */
+			n = nl - prevsrvbuf + 1;
+		else if (n < left && prevsrvlen < sizeof(prevsrvbuf)) { /* Wait for the rest of the line */
+			if (!prevsrv_wait(gen, &stale))
+				return FALSE;
+			continue;
 		}
+
+		if (more)
+			more = preview_addline(pv, prevsrvbuf, n, width, height - 1);
+		prevsrv_consume(n);
+		left -= n;
 	}
 
-	return r;
+	return TRUE;
 }
 
-static void reset_sort_flags(void)
+/*
+ * Start of the text filling the last maxrows rows of a pane.
+ * A line cut by the start of buf is wrapped from the cut.
+ */
+static char *preview_tailstart(char *buf, const char *end, int width, int maxrows)
 {
-	cfg.timeorder = 0;
-	cfg.sizeorder = 0;
-	cfg.apparentsz = 0;
-	cfg.blkorder = 0;
-	cfg.extnorder = 0;
+	const char *ptr = end;
+	char *start;
+	size_t len;
+	int rows = 0, lrows;
+
+	/* The newline ending the file doesn't start a row */
+	if (ptr > buf && ptr[-1] == '\n')
+		--ptr;
+
+	while (1) {
+		for (start = (char *)ptr; start > buf && start[-1] != '\n'; --start);
+
+		len = ptr - start;
+		if (len && start[len - 1] == '\r')
+			--len;
+		lrows = len ? (int)((len + width - 1) / width) : 1;
+
+		if (rows + lrows >= maxrows) /* Show only the last rows of a wrapped line */
+			return start + (size_t)(rows + lrows - maxrows) * width;
+
+		rows += lrows;
+		if (start == buf)
+			return buf;
+		ptr = start - 1;
+	}
 }
 
-static int set_sort_flags(int r)
+/*
+ * Preview the start or the end of a text file. Reads only as much as
+ * fits in the pane, even from huge files.
+ */
+static void preview_text(const char *fpath, off_t size, int width, int maxrows,
+			 bool tail, uint_t gen, preview_t *pv)
 {
-	bool session = (r == '\0');
-	bool reverse = FALSE;
+	unsigned char head[PREVIEW_TEXT_CHECK];
+	const size_t win = MIN((ullong_t)size, (ullong_t)maxrows * (width + 2));
+	char *ptr, *end, *nl;
+	int fd = open(fpath, O_RDONLY | O_CLOEXEC);
+	ssize_t n;
 
-	if (ISUPPER_(r) && (r != 'R') && (r != 'C')) {
-		reverse = TRUE;
-		r = TOLOWER(r);
+	if (fd == -1)
+		return;
+
+	n = pread(fd, head, sizeof(head), 0);
+	if (!is_text(head, n)) {
+		close(fd);
+		pv->binsize = size;
+		return;
 	}
 
-	/* Set the correct input in case of a session load */
-	if (session) {
-		if (cfg.apparentsz) {
-			cfg.apparentsz = 0;
-			r = 'a';
-		} else if (cfg.blkorder) {
-			cfg.blkorder = 0;
-			r = 'd';
-		}
+	if (win > prevfcap) {
+		prevfbuf = xrealloc(prevfbuf, win);
+		prevfcap = prevfbuf ? win : 0;
+	}
 
-		/* Ensure function pointers are in sync with cfg. */
-		entrycmpfn = cfg.reverse ? &reventrycmp : &entrycmp;
-		namecmpfn = cfg.version ? &xstrverscasecmp : &xstricmp;
-	} else if (r == CONTROL('T')) {
-		/* Cycling order: clear -> size -> time -> clear */
-		if (cfg.timeorder)
-			r = 's';
-		else if (cfg.sizeorder)
-			r = 'c';
-		else
-			r = 't';
+	n = prevfbuf ? pread(fd, prevfbuf, win, tail ? size - (off_t)win : 0) : -1;
+	close(fd);
+	if (n <= 0)
+		return;
+
+	end = prevfbuf + n;
+	ptr = tail ? preview_tailstart(prevfbuf, end, width, maxrows) : prevfbuf;
+
+	while (ptr < end && !preview_stale(gen)) {
+		nl = memchr(ptr, '\n', end - ptr);
+		if (!nl) /* Last line without a newline */
+			nl = end - 1;
+
+		if (!preview_addline(pv, ptr, nl - ptr + 1, width, maxrows))
+			break;
+		ptr = nl + 1;
 	}
+}
 
-	switch (r) {
-	case 'a': /* Apparent du */
-		cfg.apparentsz ^= 1;
-		if (cfg.apparentsz) {
-			cfg.blkorder = 1;
-			blk_shift = 0;
-		} else
-			cfg.blkorder = 0;
-		// fallthrough
-	case 'd': /* Disk usage */
-		if (r == 'd') {
-			if (!cfg.apparentsz)
-				cfg.blkorder ^= 1;
-			cfg.apparentsz = 0;
-			blk_shift = ffs(S_BLKSIZE) - 1;
-		}
+/*
+ * Render the preview of a file in a pane of width x height,
+ * leaving out the top line. Uses the previewer prog if set.
+ */
+#ifndef NOSORT
+/* Order of the listing on entering the dir */
+static int prevcmp(const struct entry *pa, const struct entry *pb, const prevsort_t *ps)
+{
+	int ret;
 
-		if (cfg.blkorder)
-			cfg.showdetail = 1;
-		cfg.timeorder = 0;
-		cfg.sizeorder = 0;
-		cfg.extnorder = 0;
-		if (!session) {
-			cfg.reverse = 0;
-			entrycmpfn = &entrycmp;
+	if (IS_DIR_OR_DIRLNK(pb) != IS_DIR_OR_DIRLNK(pa))
+		return IS_DIR_OR_DIRLNK(pb) ? 1 : -1;
+
+#ifndef NOUG
+	/* Owner names are looked up by the UI thread only, order by name */
+	if (ps->cfg.ownerorder)
+		ret = ps->namecmp(pa->name, pb->name);
+	else
+#endif
+		ret = entrycmp_by(pa, pb, &ps->cfg, ps->namecmp);
+
+	return ps->cfg.reverse ? -ret : ret;
+}
+#endif
+
+/*
+ * List a dir the way the listing shows it on entering. Only the entries
+ * that fit in the pane are kept, in a partial insertion sort.
+ */
+static void preview_dir(const char *dpath, int width, int maxrows, bool hidden,
+			const prevsort_t *ps, uint_t gen, preview_t *pv)
+{
+	char line[PREVIEW_MAX_LINE];
+	struct dirent *dp;
+	struct stat sb;
+	struct entry ent;
+	const int max = maxrows - 1;
+	const time_t now = time(NULL);
+	char *name;
+	int flags = 0, n = 0, lo;
+	uint_t count = 0;
+	size_t len = 0;
+	DIR *dirp = opendir(dpath);
+
+	if (!dirp)
+		return;
+
+	xstrsncpy(line, "[directory]", sizeof(line));
+	preview_addline(pv, line, xstrlen(line), width, maxrows);
+
+	if (max <= 0)
+		goto exit;
+
+	if (pv->entcap < max) {
+		pv->ents = xrealloc(pv->ents, max * sizeof(struct entry));
+		pv->entcap = pv->ents ? max : 0;
+	}
+
+	if (prevdncap < max) {
+		prevdnames = xrealloc(prevdnames, (size_t)max * (NAME_MAX + 1));
+		prevdncap = prevdnames ? max : 0;
+	}
+
+	if (!pv->entcap || !prevdncap)
+		goto exit;
+
+	memset(&ent, 0, sizeof(ent));
+
+	while ((dp = readdir(dirp))) {
+		if (selforparent(dp->d_name) || (!hidden && dp->d_name[0] == '.'))
+			continue;
+
+		if (!(++count & 0xff) && preview_stale(gen))
+			break;
+
+#if defined(__sun) || defined(__HAIKU__)
+		flags = AT_SYMLINK_NOFOLLOW; /* no d_type */
+#else
+		flags = (dp->d_type == DT_UNKNOWN) ? AT_SYMLINK_NOFOLLOW : 0;
+#endif
+		ent.name = dp->d_name;
+		ent.nlen = xstrlen(dp->d_name) + 1;
+		ent.id = count;
+		dentset(&ent, dirfd(dirp), dp, flags, &sb, dentstat(dirfd(dirp), dp->d_name, flags, &sb),
+			now, ps->cfg.timetype, ps->list);
+		ent.blocks = S_ISDIR(sb.st_mode) ? 0 : (ps->cfg.apparentsz ? sb.st_size : sb.st_blocks);
+
+#ifdef NOSORT
+		/* Directory order */
+		if (n == max)
+			break;
+		lo = n;
+#else
+		if (n == max && prevcmp(&ent, &pv->ents[n - 1], ps) >= 0)
+			continue;
+
+		lo = 0;
+		for (int hi = (n == max) ? n - 1 : n, mid; lo < hi;) {
+			mid = (lo + hi) >> 1;
+			if (prevcmp(&ent, &pv->ents[mid], ps) < 0)
+				hi = mid;
+			else
+				lo = mid + 1;
 		}
-		endselection(TRUE); /* We are going to reload dir */
-		break;
-	case 'c':
-		reset_sort_flags();
-		cfg.reverse = 0;
-		cfg.version = 0;
-		entrycmpfn = &entrycmp;
-		namecmpfn = &xstricmp;
-		break;
-	case 'e': /* File extension */ {
-		bool val = cfg.extnorder ^ 1;
-		reset_sort_flags();
-		cfg.extnorder = val;
-		cfg.reverse = 0;
-		entrycmpfn = &entrycmp;
-		break;
+#endif
+
+		/* Reuse the name of the entry that drops out */
+		name = (n < max) ? prevdnames + (size_t)n * (NAME_MAX + 1) : pv->ents[--n].name;
+		ent.nlen = xstrsncpy(name, dp->d_name, NAME_MAX + 1);
+		ent.name = name;
+
+		memmove(&pv->ents[lo + 1], &pv->ents[lo], (n - lo) * sizeof(struct entry));
+		pv->ents[lo] = ent;
+		++n;
 	}
-	case 'r': /* Reverse sort */
-		cfg.reverse ^= 1;
-		entrycmpfn = cfg.reverse ? &reventrycmp : &entrycmp;
-		break;
-	case 's': /* File size */ {
-		bool val = cfg.sizeorder ^ 1;
-		reset_sort_flags();
-		cfg.sizeorder = val;
-		cfg.reverse = 0;
-		entrycmpfn = &entrycmp;
-		break;
+
+	/* The cached preview keeps the names, the buffer is reused for the next dir */
+	for (int i = 0; i < n; ++i)
+		len += pv->ents[i].nlen;
+	if (len > pv->namescap) {
+		pv->names = xrealloc(pv->names, len);
+		pv->namescap = pv->names ? len : 0;
 	}
-	case 't': /* Time */ {
-		bool val = cfg.timeorder ^ 1;
-		reset_sort_flags();
-		cfg.timeorder = val;
-		cfg.reverse = 0;
-		entrycmpfn = &entrycmp;
-		break;
+	if (!pv->names)
+		n = 0;
+	for (int i = 0, off = 0; i < n; off += pv->ents[i++].nlen) {
+		memcpy(pv->names + off, pv->ents[i].name, pv->ents[i].nlen);
+		pv->ents[i].name = pv->names + off;
 	}
-	case 'v': /* Version */
-		cfg.version ^= 1;
-		namecmpfn = cfg.version ? &xstrverscasecmp : &xstricmp;
-		reset_sort_flags();
-		break;
-	default:
-		return 0;
+
+	/* Leave a column for the indicator */
+	for (int i = 0; i < n; ++i)
+		if (!preview_addline(pv, pv->ents[i].name, MIN((size_t)pv->ents[i].nlen - 1, (size_t)width - 1),
+				     width, maxrows))
+			break;
+	pv->nents = pv->rows ? pv->rows - 1 : 0;
+
+exit:
+	closedir(dirp);
+}
+
+static void preview_render(const char *prog, const char *fpath, int width, int height,
+			   uint_t opts, const prevsort_t *ps, uint_t gen, bool prefetch, preview_t *pv)
+{
+	char line[PREVIEW_MAX_LINE];
+	struct stat sb;
+	const int maxrows = height - 1;
+
+	pv->len = 0;
+	pv->rows = 0;
+	pv->binsize = -1;
+	pv->nents = 0;
+
+	if (maxrows <= 0)
+		return;
+
+	if (prog) {
+		/*
+		 * Work ahead with a previewer of its own, it's killed as soon as
+		 * the preview goes stale. The co-process can't drop a request.
+		 */
+		if (!prefetch && !prevsrv)
+			prevsrv = prevsrv_start(prog) ? 1 : -1;
+
+		if (!prefetch && prevsrv == 1) {
+			if (prevsrv_query(fpath, width, height, gen, pv))
+				return;
+
+			/* Restart it for the next preview */
+			prevsrv_stop();
+			prevsrv = 0;
+			if (preview_stale(gen))
+				return;
+
+			pv->len = 0;
+			pv->rows = 0;
+		}
+
+		preview_run(prog, fpath, width, height, gen, pv);
+		return;
 	}
 
-	if (reverse) {
-		cfg.reverse = 1;
-		entrycmpfn = &reventrycmp;
+	if (lstat(fpath, &sb) == -1)
+		return;
+
+	/* For directories, list the entries */
+	if (S_ISDIR(sb.st_mode)) {
+		preview_dir(fpath, width, maxrows, opts & PREVIEW_HIDDEN, ps, gen, pv);
+		return;
 	}
 
-	cfgsort[cfg.curctx] = (uchar_t)r;
+	/* For symlinks, resolve and show target */
+	if (S_ISLNK(sb.st_mode)) {
+		ssize_t len = readlink(fpath, line + 3, sizeof(line) - 4);
 
-	return r;
+		if (len > 0) {
+			memcpy(line, "-> ", 3);
+			preview_addline(pv, line, MIN((size_t)len + 3, (size_t)width), width, maxrows);
+		}
+		/* Resolve symlink for further preview */
+		if (stat(fpath, &sb) == -1 || !S_ISREG(sb.st_mode))
+			return;
+	}
+
+	/* For regular files, show content preview if text */
+	if (S_ISREG(sb.st_mode)) {
+		if (sb.st_size == 0) {
+			xstrsncpy(line, "[empty file]", sizeof(line));
+			preview_addline(pv, line, xstrlen(line), width, maxrows);
+			return;
+		}
+
+		preview_text(fpath, sb.st_size, width, maxrows, opts & PREVIEW_TAIL, gen, pv);
+	}
 }
 
-static bool set_time_type(int *presel)
+/* Cache slot of the preview of a path in a pane size, -1 if there's none */
+static int prevcache_find(const char *fpath, int width, int height, uint_t opts)
 {
-	bool ret = FALSE;
-	char buf[] = "'a'ccess / 'c'hange / 'm'od [ ]";
-
-	buf[sizeof(buf) - 3] = cfg.timetype == T_MOD ? 'm' : (cfg.timetype == T_ACCESS ? 'a' : 'c');
+	for (int i = 0; i < PREVIEW_CACHE; ++i)
+		if (prevcache[i].used && prevcache[i].width == width && prevcache[i].height == height
+		    && prevcache[i].opts == opts && !strcmp(prevcache[i].path, fpath))
+			return i;
 
-	int r = get_input(buf);
+	return -1;
+}
 
-	if (r == 'a' || r == 'c' || r == 'm') {
-		r = (r == 'm') ? T_MOD : ((r == 'a') ? T_ACCESS : T_CHANGE);
-		if (cfg.timetype != r) {
-			cfg.timetype = r;
+/* Slot to store a new preview in */
+static int prevcache_victim(void)
+{
+	int slot = 0;
 
-			if (cfg.filtermode || g_ctx[cfg.curctx].c_fltr[1])
-				*presel = FILTER;
+	for (int i = 1; i < PREVIEW_CACHE; ++i)
+		if (prevcache[i].used < prevcache[slot].used)
+			slot = i;
 
-			ret = TRUE;
-		} else
-			r = MSG_NOCHANGE;
-	} else
-		r = MSG_INVALID_KEY;
+	return slot;
+}
 
-	if (!ret)
-		printwait(messages[r], presel);
+/* Version of a file for the cache, a symlink is versioned by its target */
+static void preview_stat(const char *fpath, struct stat *sb)
+{
+	struct stat tsb;
 
-	return ret;
+	if (lstat(fpath, sb) == -1)
+		memset(sb, 0, sizeof(*sb));
+	else if (S_ISLNK(sb->st_mode) && stat(fpath, &tsb) == 0) {
+		sb->st_mtime = MAX(sb->st_mtime, tsb.st_mtime);
+		sb->st_size = tsb.st_size;
+	}
 }
 
-static void statusbar(char *path)
+/* Slot with a current preview of the file version, -1 if there's none */
+static int prevcache_get(const char *fpath, int width, int height, uint_t opts, const struct stat *sb)
 {
-	int i = 0, len = 0;
-	char *ptr;
-	pEntry pent = &pdents[cur];
+	int slot = prevcache_find(fpath, width, height, opts);
+	prevcache_t *ent = (slot >= 0) ? &prevcache[slot] : NULL;
 
-	if (!ndents) {
-		printmsg("0/0");
-		return;
+	if (ent && ent->dev == sb->st_dev && ent->ino == sb->st_ino
+	    && ent->mtime == sb->st_mtime && ent->size == sb->st_size) {
+		ent->used = ++prevclock;
+		return slot;
 	}
 
-	/* Get the file extension for regular files */
-	if (S_ISREG(pent->mode)) {
-		i = (int)(pent->nlen - 1);
-		ptr = xextension(pent->name, i);
-		if (ptr)
-			len = i - (ptr - pent->name);
-		if (!ptr || len > 5 || len < 2)
-			ptr = "\b";
-	} else
-		ptr = "\b";
+	return -1;
+}
 
-	attron(COLOR_PAIR(cfg.curctx + 1));
+/* Move the preview rendered in prevwork to the cache */
+static int prevcache_put(const char *fpath, int width, int height, uint_t opts, const struct stat *sb)
+{
+	int slot = prevcache_find(fpath, width, height, opts);
+	prevcache_t *ent;
+	preview_t tmp;
 
-	if (cfg.fileinfo && get_output("file", "-b", pdents[cur].name, -1, FALSE))
-		mvaddstr(xlines - 2, 2, g_buf);
+	if (slot < 0)
+		slot = prevcache_victim();
+	ent = &prevcache[slot];
 
-	tolastln();
+	tmp = ent->pv;
+	ent->pv = prevwork;
+	prevwork = tmp;
+	xstrsncpy(ent->path, fpath, PATH_MAX);
+	ent->dev = sb->st_dev;
+	ent->ino = sb->st_ino;
+	ent->mtime = sb->st_mtime;
+	ent->size = sb->st_size;
+	ent->width = width;
+	ent->height = height;
+	ent->opts = opts;
+	ent->used = ++prevclock;
 
-	printw("%d/%d ", cur + 1, ndents);
+	return slot;
+}
 
-	if (g_state.selmode || nselected) {
-		attron(A_REVERSE);
-		addch(' ');
-		if (g_state.rangesel)
-			addch('*');
-		else if (g_state.selmode)
-			addch('+');
-		if (nselected)
-			addstr(xitoa(nselected));
-		addch(' ');
-		attroff(A_REVERSE);
-		addch(' ');
-	}
+/* Stat the entries of a dir so that the listing finds them in the kernel caches */
+static void preview_warmdir(const char *dpath, uint_t gen)
+{
+	DIR *dirp = opendir(dpath);
+	struct dirent *dp;
+	struct stat sb;
+	int n = 0;
 
-	if (cfg.blkorder) { /* du mode */
-		char buf[24];
+	if (!dirp)
+		return;
 
-		xstrsncpy(buf, coolsize(dir_blocks << blk_shift), 12);
+	while ((dp = readdir(dirp)) && ++n <= PREVIEW_WARM_MAX && !preview_stale(gen))
+		fstatat(dirfd(dirp), dp->d_name, &sb, AT_SYMLINK_NOFOLLOW);
+	closedir(dirp);
+}
 
-		printw("%cu:%s avail:%s files:%llu %lluB %s\n",
-		       (cfg.apparentsz ? 'a' : 'd'), buf, coolsize(get_fs_info(path, VFS_AVAIL)),
-		       num_files, (ullong_t)pent->blocks << blk_shift, ptr);
-	} else { /* light or detail mode */
-		char sort[] = "\0\0\0\0\0";
+static void *preview_worker(void *arg)
+{
+	char fpath[PATH_MAX];
+	prevsort_t sort;
+	struct stat sb;
+	const char *prog;
+	uint_t gen;
+	int width, height, slot;
+	uint_t opts;
+	bool warm;
+	sigset_t mask;
 
-		if (cfg.filtermode)
-			addch('F');
+	(void)arg;
 
-		getorderstr(sort) ? addstr(sort) : addch(' ');
+	/* Writing to a co-process that quit fails with EPIPE */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
 
-		/* Timestamp */
-		print_time(&pent->sec, pent->flags);
+	pthread_mutex_lock(&preview_mutex);
+	while (1) {
+		while (!prevpending && !prevquit && (prefidx >= prefcount || prefgen != prevgen))
+			pthread_cond_wait(&preview_cond, &preview_mutex);
+		if (prevquit)
+			break;
 
-		addch(' ');
-		addstr(get_lsperms(pent->mode));
-		addch(' ');
-#ifndef NOUG
-		if (g_state.uidgid) {
-			addstr(getpwname(pent->uid));
-			addch(':');
-			addstr(getgrname(pent->gid));
-			addch(' ');
+		/* Work ahead only when the hovered file is done */
+		prefetching = !prevpending;
+		if (prefetching) {
+			xstrsncpy(fpath, prefetches[prefidx].path, PATH_MAX);
+			warm = prefetches[prefidx++].warm;
+		} else {
+			xstrsncpy(fpath, prevreq, PATH_MAX);
+			prevpending = FALSE;
+			warm = FALSE;
+		}
+		width = prevreqw;
+		height = prevreqh;
+		opts = prevreqopts;
+		sort = prevreqsort;
+		gen = prevgen;
+		prog = previewer;
+		pthread_mutex_unlock(&preview_mutex);
+
+		if (warm) {
+			preview_warmdir(fpath, gen);
+			pthread_mutex_lock(&preview_mutex);
+			continue;
 		}
-#endif
-		if (S_ISLNK(pent->mode)) {
-			if (!cfg.fileinfo) {
-				i = readlink(pent->name, g_buf, PATH_MAX);
-				addstr(coolsize(i >= 0 ? i : pent->size)); /* Show symlink size */
-				if (i > 1) { /* Show symlink target */
-					int y;
 
-					addstr(" ->");
-					getyx(stdscr, len, y);
-					i = MIN(i, xcols - y);
-					g_buf[i] = '\0';
-					addstr(g_buf);
-				}
+		preview_stat(fpath, &sb);
+
+		pthread_mutex_lock(&preview_mutex);
+		slot = prevcache_get(fpath, width, height, opts, &sb);
+		if (slot >= 0) {
+			if (!prefetching && gen == prevgen) {
+				prevslot = slot;
+				prevdone = gen;
 			}
-		} else {
-			addstr(coolsize(pent->size));
-			addch(' ');
-			addstr(ptr);
-			if (pent->flags & HARD_LINK) {
-				struct stat sb;
+			continue;
+		}
+		pthread_mutex_unlock(&preview_mutex);
 
-				if (stat(pent->name, &sb) != -1) {
-					addch(' ');
-					addstr(xitoa((int)sb.st_nlink)); /* Show number of links */
-					addch('-');
-					addstr(xitoa((int)sb.st_ino)); /* Show inode number */
-				}
+		preview_render(prog, fpath, width, height, opts, &sort, gen, prefetching, &prevwork);
+
+		pthread_mutex_lock(&preview_mutex);
+		/* Drop the result if there's a newer request */
+		if (gen == prevgen && (!prefetching || gen == prefgen)) {
+			slot = prevcache_put(fpath, width, height, opts, &sb);
+			if (!prefetching) {
+				prevslot = slot;
+				prevdone = gen;
 			}
 		}
-		clrtoeol();
 	}
+	pthread_mutex_unlock(&preview_mutex);
 
-	attroff(COLOR_PAIR(cfg.curctx + 1));
-	/* Place HW cursor on current for Braille systems */
-	tocursor();
+	return NULL;
+}
+
+static bool preview_start(void)
+{
+	if (!previnit)
+		previnit = (pthread_create(&preview_tid, NULL, preview_worker, NULL) == 0) ? 1 : -1;
+
+	return previnit == 1;
+}
+
+static void preview_stop(void)
+{
+	if (previnit == 1) {
+		pthread_mutex_lock(&preview_mutex);
+		prevquit = TRUE;
+		pthread_cond_signal(&preview_cond);
+		pthread_mutex_unlock(&preview_mutex);
+		pthread_join(preview_tid, NULL);
+	}
+
+	prevsrv_stop();
+	for (int i = 0; i < PREVIEW_CACHE; ++i) {
+		free(prevcache[i].pv.buf);
+		free(prevcache[i].pv.ents);
+		free(prevcache[i].pv.names);
+	}
+	free(prevwork.buf);
+	free(prevwork.ents);
+	free(prevwork.names);
+	free(prevfbuf);
+	free(prevdnames);
+}
+
+/* Stop working ahead */
+static void prefetch_cancel(void)
+{
+	pthread_mutex_lock(&preview_mutex);
+	prefgen = 0;
+	pthread_mutex_unlock(&preview_mutex);
+}
+
+/* Queue the hovered dir and the neighbours of the hovered entry to work ahead on */
+static void prefetch_queue(const char *path)
+{
+	int i, n;
+
+	prefcount = prefidx = 0;
+
+	if (pdents[cur].flags & DIR_OR_DIRLNK) {
+		prefetches[prefcount].warm = TRUE;
+		mkpath(path, pdents[cur].name, prefetches[prefcount++].path);
+	}
+
+	for (i = 1; i <= PREVIEW_PREFETCH; ++i)
+		for (n = cur + i; n >= cur - i; n -= i << 1) /* Next, then previous */
+			if (n >= 0 && n < ndents) {
+				prefetches[prefcount].warm = FALSE;
+				mkpath(path, pdents[n].name, prefetches[prefcount++].path);
+			}
+
+	prefgen = prevgen;
+	prefqueued = TRUE;
+}
+
+/* Drop the pending preview, the pane is gone or shows another file */
+static void preview_cancel(void)
+{
+	pthread_mutex_lock(&preview_mutex);
+	++prevgen;
+	prevpending = prevwait = FALSE;
+	pthread_mutex_unlock(&preview_mutex);
+}
+
+/* Print the row of a dir entry in the colors of the listing */
+static void preview_drawent(const struct entry *ent, const char *row, int y)
+{
+	char ind = '\0';
+	int attrs = 0;
+	uchar_t color_pair = get_color_pair_name_ind(ent, &ind, &attrs);
+
+	if (g_state.oldcolor) {
+		if (ent->flags & DIR_OR_DIRLNK)
+			attrs |= COLOR_PAIR(cfg.curctx + 1) | A_BOLD;
+	} else {
+		if (ent->flags & FILE_MISSING)
+			color_pair = C_MIS;
+		if (color_pair && fcolors[color_pair])
+			attrs |= COLOR_PAIR(color_pair);
+	}
+
+	if (attrs)
+		attron(attrs);
+	mvaddstr(y, PREVIEW_COL, row);
+	if (attrs)
+		attroff(attrs);
+	if (ind)
+		addch(ind);
+}
+
+/* Settings of the listing a dir preview is sorted with */
+static void preview_sort(prevsort_t *ps)
+{
+	ps->cfg = cfg;
+	ps->namecmp = namecmpfn;
+	ps->list = (listpath != NULL);
 }
 
-static inline void markhovered(void)
+/* Options of the preview of the hovered file */
+static uint_t preview_opts(void)
 {
-	if (cfg.showdetail && ndents) { /* Bold forward arrowhead */
-		tocursor();
-		addch('>' | A_BOLD);
-	}
+	return cfg.prevtail | (cfg.showhidden << 1) | (cfg.reverse << 2) | (cfg.version << 3)
+	       | (cfg.timeorder << 4) | (cfg.sizeorder << 5) | (cfg.blkorder << 6)
+	       | (cfg.apparentsz << 7) | (cfg.extnorder << 8) | (cfg.ownerorder << 9)
+	       | (cfg.timetype << 10);
 }
 
-#define PREVIEW_BORDER_COL (xcols / 2)
-#define PREVIEW_COL        (PREVIEW_BORDER_COL + 2)
-#define PREVIEW_WIDTH      (xcols - PREVIEW_COL - 1)
-#define MIN_PREVIEW_COLS   40
-#define PREVIEW_MAX_LINE   4096
-
-/* Check if a file is likely text by reading initial bytes */
-static bool is_text_file(const char *fpath)
+static void preview_draw(const preview_t *pv)
 {
-	int fd = open(fpath, O_RDONLY);
-	if (fd == -1)
-		return FALSE;
-
-	unsigned char buf[512];
-	ssize_t n = read(fd, buf, sizeof(buf));
-	close(fd);
-
-	if (n <= 0)
-		return FALSE;
+	const char *row = pv->buf;
+	int i;
 
-	/* Reject known binary magic signatures */
-	static const struct {
-		const unsigned char bytes[8];
-		unsigned char len;
-	} magics[] = {
-		{ { '%',  'P',  'D',  'F'              }, 4 }, /* PDF */
-		{ { 0x89, 'P',  'N',  'G'              }, 4 }, /* PNG */
-		{ { 'G',  'I',  'F',  '8'              }, 4 }, /* GIF */
-		{ { 0xFF, 0xD8, 0xFF                   }, 3 }, /* JPEG */
-		{ { 'P',  'K',  0x03, 0x04             }, 4 }, /* ZIP */
-		{ { 0x7F, 'E',  'L',  'F'              }, 4 }, /* ELF */
-		{ { 0x1F, 0x8B                         }, 2 }, /* Gzip */
-		{ { 'B',  'M'                          }, 2 }, /* BMP */
-		{ { 'R',  'I',  'F',  'F'              }, 4 }, /* RIFF */
-		{ { 'O',  'g',  'g',  'S'              }, 4 }, /* OGG */
-		{ { 'f',  'L',  'a',  'C'              }, 4 }, /* FLAC */
-		{ { 'I',  'D',  '3'                    }, 3 }, /* MP3 ID3 */
-		{ { 0xFE, 0xED, 0xFA                   }, 3 }, /* Mach-O */
-		{ { 0xFD, '7',  'z',  'X',  'Z',  0x00 }, 6 }, /* XZ */
-		{ { '7',  'z',  0xBC, 0xAF, 0x27, 0x1C }, 6 }, /* 7z */
-		{ { 'S',  'Q',  'L',  'i',  't',  'e'  }, 6 }, /* SQLite */
-	};
+	for (i = 1; i < xlines - 2; ++i) {
+		move(i, PREVIEW_COL);
+		clrtoeol();
+	}
 
-	for (size_t i = 0; i < sizeof(magics) / sizeof(magics[0]); ++i) {
-		if (n >= magics[i].len
-		    && !memcmp(buf, magics[i].bytes, magics[i].len))
-			return FALSE;
+	for (i = 0; i < pv->rows; ++i) {
+		if (i && i <= pv->nents)
+			preview_drawent(&pv->ents[i - 1], row, i + 1);
+		else
+			mvaddstr(i + 1, PREVIEW_COL, row);
+		row += xstrlen(row) + 1;
 	}
 
-	/* MP3 sync word (needs mask check) */
-	if (n >= 2 && buf[0] == 0xFF && (buf[1] & 0xE0) == 0xE0)
-		return FALSE;
+	if (pv->binsize >= 0 && i + 1 < xlines - 2)
+		mvprintw(i + 1, PREVIEW_COL, "[binary %s]", coolsize(pv->binsize));
+}
 
-	/* Check for NUL bytes and non-text control characters */
-	for (ssize_t i = 0; i < n; ++i) {
-		unsigned char c = buf[i];
-		if (c == '\0')
-			return FALSE;
-		/* Reject most control chars except common text ones */
-		if (c < 0x20 && c != '\n' && c != '\r' && c != '\t'
-		    && c != '\f' && c != '\033') /* ESC for ANSI */
-			return FALSE;
+/* Show the preview if the preview thread is done, returns FALSE till then */
+static bool preview_show(void)
+{
+	bool done;
+
+	pthread_mutex_lock(&preview_mutex);
+	done = (prevdone == prevgen);
+	if (done) {
+		prevwait = FALSE;
+		preview_draw(&prevcache[prevslot].pv);
 	}
+	pthread_mutex_unlock(&preview_mutex);
 
-	return TRUE;
+	return done;
 }
 
 /*
  * Draw the preview pane for the currently hovered file
  * If the plugin .npreview is found, it is used.
  * Otherwise, the built-in previewer is used.
+ * The contents are rendered by the preview thread and show up
+ * while waiting for keys, moving on cancels a stale preview.
  */
 static void preview_pane(const char *path)
 {
-	if (!ndents || !cfg.preview)
-		return;
-
+	char fpath[PATH_MAX];
 	int previewcol = PREVIEW_BORDER_COL;
 	int previewwidth = PREVIEW_WIDTH;
 
-	if (previewwidth < MIN_PREVIEW_COLS)
+	if (!ndents || !cfg.preview || previewwidth < MIN_PREVIEW_COLS) {
+		preview_cancel();
 		return;
+	}
 
 	/* Draw vertical border */
 	for (int i = 0; i < xlines - 1; ++i) {
@@ -8026,186 +13000,49 @@ static void preview_pane(const char *path)
 		addch(ACS_VLINE | A_DIM);
 	}
 
-	char fpath[PATH_MAX];
 	mkpath(path, pdents[cur].name, fpath);
 
 	/* Auto-detect .npreview plugin */
 	if (!previewer) {
-		previewer = malloc(xstrlen(plgpath) + xstrlen(utils[UTIL_NPREVIEW]) + 1);
-		if (previewer) {
-			mkpath(plgpath, utils[UTIL_NPREVIEW], previewer);
-			if (access(previewer, X_OK)) {
-				free(previewer);
-				previewer = NULL;
-			}
-		}
-	}
-
-	if (previewer) {
-		int pipefd[2];
-		if (pipe(pipefd) == -1)
-			return;
-
-		pid_t pid = fork();
-		if (pid == 0) {
-			close(pipefd[0]);
-			dup2(pipefd[1], STDOUT_FILENO);
-			dup2(pipefd[1], STDERR_FILENO);
-			close(pipefd[1]);
-
-			char widthbuf[16], heightbuf[16];
-			snprintf(widthbuf, sizeof(widthbuf), "%d", previewwidth);
-			snprintf(heightbuf, sizeof(heightbuf), "%d", xlines - 2);
+		char *prog = malloc(xstrlen(plgpath) + xstrlen(utils[UTIL_NPREVIEW]) + 1);
 
-			execlp(previewer, previewer, fpath,
-			       widthbuf, heightbuf,
-			       (char *)NULL);
-			_exit(EXIT_FAILURE);
+		if (prog) {
+			mkpath(plgpath, utils[UTIL_NPREVIEW], prog);
+			if (access(prog, X_OK))
+				free(prog);
+			else /* Set only when found, the preview thread reads it */
+				previewer = prog;
 		}
-		close(pipefd[1]);
-
-		if (pid > 0) {
-			FILE *fp = fdopen(pipefd[0], "r");
-			if (fp) {
-				char line[PREVIEW_MAX_LINE];
-				int row = 1;
-				int maxrows = xlines - 2;
-
-				while (row < maxrows && fgets(line, sizeof(line), fp)) {
-					size_t len = xstrlen(line);
-					if (len > 0 && line[len - 1] == '\n')
-						line[--len] = '\0';
-					if (len > 0 && line[len - 1] == '\r')
-						line[--len] = '\0';
-
-					/* Replace tabs with spaces */
-					for (size_t i = 0; i < len; ++i)
-						if (line[i] == '\t')
-							line[i] = ' ';
-
-					/* Wrap long lines across multiple rows */
-					int off = 0;
-					do {
-						char save = '\0';
-						if ((int)(len - off) > previewwidth) {
-							save = line[off + previewwidth];
-							line[off + previewwidth] = '\0';
-						}
-						mvaddstr(row, PREVIEW_COL, line + off);
-						if (save)
-							line[off + previewwidth] = save;
-						++row;
-						off += previewwidth;
-					} while (off < (int)len && row < maxrows);
-				}
-				fclose(fp);
-			} else {
-				close(pipefd[0]);
-			}
-			waitpid(pid, NULL, 0);
-		} else
-			close(pipefd[0]);
-		return;
 	}
 
-	struct stat sb;
-	if (lstat(fpath, &sb) == -1)
-		return;
-
-	/* For directories, show entry count */
-	if (S_ISDIR(sb.st_mode)) {
-		DIR *dirp = opendir(fpath);
-		if (!dirp)
-			return;
-
-		int count = 0;
-		struct dirent *dp;
-		char namebuf[PATH_MAX];
-		int maxlines = xlines - 4; /* Leave header and status lines */
+	if (!preview_start()) { /* Render in place without the thread */
+		prevsort_t sort;
 
-		mvaddstr(1, PREVIEW_COL, "[directory]");
-
-		while ((dp = readdir(dirp)) && count < maxlines) {
-			if (dp->d_name[0] == '.' && (!dp->d_name[1]
-			    || (dp->d_name[1] == '.' && !dp->d_name[2])))
-				continue;
-			snprintf(namebuf, sizeof(namebuf), "%.*s",
-				 previewwidth, dp->d_name);
-			mvaddstr(2 + count, PREVIEW_COL, namebuf);
-			++count;
-		}
-		closedir(dirp);
+		prevsrv = -1;
+		preview_sort(&sort);
+		preview_render(previewer, fpath, previewwidth, xlines - 2, preview_opts(), &sort,
+			       prevgen, FALSE, &prevwork);
+		preview_draw(&prevwork);
 		return;
 	}
 
-	/* For symlinks, resolve and show target */
-	if (S_ISLNK(sb.st_mode)) {
-		char target[PATH_MAX];
-		ssize_t len = readlink(fpath, target, sizeof(target) - 1);
-		if (len > 0) {
-			target[len] = '\0';
-			mvprintw(1, PREVIEW_COL, "-> %.*s", previewwidth - 3, target);
-		}
-		/* Resolve symlink for further preview */
-		if (stat(fpath, &sb) == -1)
-			return;
-		if (!S_ISREG(sb.st_mode))
-			return;
-	}
-
-	/* For regular files, show content preview if text */
-	if (S_ISREG(sb.st_mode)) {
-		if (sb.st_size == 0) {
-			mvaddstr(1, PREVIEW_COL, "[empty file]");
-			return;
-		}
-
-		if (!is_text_file(fpath)) {
-			char szbuf[32];
-			mvprintw(1, PREVIEW_COL, "[binary %s]",
-				 coolsize(sb.st_size));
-			(void)szbuf;
-			return;
-		}
+	pthread_mutex_lock(&preview_mutex);
+	/* Show the cached preview till the preview thread checks it's current */
+	int slot = prevcache_find(fpath, previewwidth, xlines - 2, preview_opts());
 
-		FILE *fp = fopen(fpath, "r");
-		if (!fp)
-			return;
+	if (slot >= 0)
+		preview_draw(&prevcache[slot].pv);
 
-		char line[PREVIEW_MAX_LINE];
-		int row = 1;
-		int maxrows = xlines - 2; /* Leave top and bottom lines */
-
-		while (row < maxrows && fgets(line, sizeof(line), fp)) {
-			/* Strip trailing newline */
-			size_t len = xstrlen(line);
-			if (len > 0 && line[len - 1] == '\n')
-				line[--len] = '\0';
-			if (len > 0 && line[len - 1] == '\r')
-				line[--len] = '\0';
-
-			/* Replace tabs with spaces for consistent display */
-			for (size_t i = 0; i < len; ++i)
-				if (line[i] == '\t')
-					line[i] = ' ';
-
-			/* Wrap long lines across multiple rows */
-			int off = 0;
-			do {
-				char save = '\0';
-				if ((int)(len - off) > previewwidth) {
-					save = line[off + previewwidth];
-					line[off + previewwidth] = '\0';
-				}
-				mvaddstr(row, PREVIEW_COL, line + off);
-				if (save)
-					line[off + previewwidth] = save;
-				++row;
-				off += previewwidth;
-			} while (off < (int)len && row < maxrows);
-		}
-		fclose(fp);
-	}
+	++prevgen;
+	xstrsncpy(prevreq, fpath, PATH_MAX);
+	prevreqw = previewwidth;
+	prevreqh = xlines - 2;
+	prevreqopts = preview_opts();
+	preview_sort(&prevreqsort);
+	prevpending = prevwait = TRUE;
+	prefetch_queue(path);
+	pthread_cond_signal(&preview_cond);
+	pthread_mutex_unlock(&preview_mutex);
 }
 
 static int adjust_cols(int n)
@@ -8215,51 +13052,149 @@ static int adjust_cols(int n)
 	n -= (g_state.oldcolor ? 0 : ICON_SIZE + ICON_PADDING_LEFT_LEN + ICON_PADDING_RIGHT_LEN);
 #endif
 	if (cfg.showdetail) {
-		/* Fallback to light mode if less than 35 columns */
-		if (n < 36)
+		int details = 32;
+#ifndef NOUG
+		if (g_state.uidgid)
+			details += ownerw + 1;
+#endif
+		/* Fallback to light mode if less than 4 columns left for the name */
+		if (n < details + 4)
 			cfg.showdetail ^= 1;
 		else /* 2 more accounted for below */
-			n -= 32;
+			n -= details;
 	}
 
 	/* 2 columns for preceding space and indicator */
 	return (n - 2);
 }
 
-static void draw_line(int ncols)
+static void draw_row(int idx, int ncols)
 {
-	bool dir = FALSE;
-
-	ncols = adjust_cols(ncols);
-
-	if (g_state.oldcolor && (pdents[last].flags & DIR_OR_DIRLNK)) {
+	if (g_state.oldcolor && (pdents[idx].flags & DIR_OR_DIRLNK)) {
 		attron(COLOR_PAIR(cfg.curctx + 1) | A_BOLD);
-		dir = TRUE;
+		g_state.dircolor = 1;
 	}
 
-	move(2 + last - curscroll, 0);
-	macos_icons_hack();
-	printent(last, ncols, FALSE);
+	printent(idx, ncols, idx == cur);
 
-	if (g_state.oldcolor && (pdents[cur].flags & DIR_OR_DIRLNK)) {
-		if (!dir)  {/* First file is not a directory */
-			attron(COLOR_PAIR(cfg.curctx + 1) | A_BOLD);
-			dir = TRUE;
-		}
-	} else if (dir) { /* Second file is not a directory */
+	/* Must reset e.g. no files in dir */
+	if (g_state.dircolor) {
 		attroff(COLOR_PAIR(cfg.curctx + 1) | A_BOLD);
-		dir = FALSE;
+		g_state.dircolor = 0;
 	}
+}
 
-	move(2 + cur - curscroll, 0);
-	macos_icons_hack();
-	printent(cur, ncols, TRUE);
+static inline void saverow(rowstate_t *row, int idx)
+{
+	row->id = pdents[idx].id;
+	row->flags = pdents[idx].flags;
+	row->hover = (idx == cur);
+}
 
-	/* Must reset e.g. no files in dir */
-	if (dir)
-		attroff(COLOR_PAIR(cfg.curctx + 1) | A_BOLD);
+static inline bool rowchanged(const rowstate_t *row, int idx)
+{
+	return row->id != pdents[idx].id || row->flags != pdents[idx].flags
+		|| row->hover != (idx == cur);
+}
+
+/* Id of the entry shown in the preview pane, -1 if there's no preview */
+static inline int previewid(void)
+{
+	return (cfg.preview && ndents && PREVIEW_WIDTH >= MIN_PREVIEW_COLS) ? (int)pdents[cur].id : -1;
+}
+
+/*
+ * Redraw only the listing rows that show something else than at the last
+ * redraw and the preview pane if the hovered entry changed. The header is
+ * left alone. Returns FALSE if the whole screen has to be redrawn.
+ */
+static bool draw_rows(char *path, int ncols)
+{
+	int i, j, len, onscreen;
+	bool all = FALSE;
+
+	if (!scr.nrows || scr.lines != xlines || scr.cols != xcols
+	    || scr.ncols != ncols || g_state.showlines)
+		return FALSE;
+
+#ifdef DIM_FILTERED
+	char * const fltr = g_ctx[cfg.curctx].c_fltr;
+
+	/* Matching characters are dimmed in string and fuzzy filter modes */
+	if (strcmp(scr.fltr, fltr)) {
+		all = (scr.fltr[0] != RFILTER) || (fltr[0] != RFILTER);
+		xstrsncpy(scr.fltr, fltr, REGEX_MAX);
+	}
+#endif
+
+	DPRINTF_S(__func__);
+
+	/* Enforce scroll/cursor invariants */
+	move_cursor(cur, 1);
+
+	onscreen = MIN(ONSCREEN + curscroll, ndents);
+	len = scanselforpath(path, FALSE);
+
+	/* Scroll indicators */
+	mvhline(1, 0, ' ', ncols);
+	if (curscroll > 0) {
+#ifdef ICONS_ENABLED
+		addstr(ICON_ARROW_UP);
+#else
+		addch('^');
+#endif
+	}
+
+	move(xlines - 2, 0);
+	clrtoeol();
+	if (onscreen < ndents) {
+#ifdef ICONS_ENABLED
+		addstr(ICON_ARROW_DOWN);
+#else
+		addch('v');
+#endif
+	}
+
+	int entcols = adjust_cols(ncols);
+
+	for (j = 0; j < scr.nrows; ++j) {
+		i = curscroll + j;
+		if (i >= onscreen) {
+			if (scr.rows[j].id == UINT_MAX) /* The rest were blank too */
+				break;
+			mvhline(j + 2, 0, ' ', ncols);
+			scr.rows[j].id = UINT_MAX;
+			continue;
+		}
+
+		if (len)
+			findmarkentry(len, &pdents[i]);
+
+		if (!all && !rowchanged(&scr.rows[j], i))
+			continue;
+
+		mvhline(j + 2, 0, ' ', ncols);
+		if (scr.preview < 0) /* Don't clear the preview */
+			macos_icons_hack();
+		draw_row(i, entcols);
+		saverow(&scr.rows[j], i);
+	}
 
 	markhovered();
+
+	i = previewid();
+	if (i != scr.preview) {
+		if (scr.preview >= 0) /* Clear the previous preview */
+			for (j = 0; j < xlines - 1; ++j) {
+				move(j, PREVIEW_BORDER_COL);
+				clrtoeol();
+			}
+		scr.preview = i;
+		preview_pane(path);
+	} else if (i >= 0) /* Restore the border cleared with the last line */
+		mvaddch(xlines - 2, PREVIEW_BORDER_COL, ACS_VLINE | A_DIM);
+
+	return TRUE;
 }
 
 static void redraw(char *path)
@@ -8279,15 +13214,15 @@ static void redraw(char *path)
 	if (g_state.move) {
 		g_state.move = 0;
 
-		if (ndents && (last_curscroll == curscroll)
-		    && !cfg.preview)
-			return draw_line(ncols);
+		if (draw_rows(path, ncols))
+			return;
 	}
 
 	DPRINTF_S(__func__);
 
 	/* Clear screen */
 	erase();
+	scr.nrows = 0;
 
 	/* Enforce scroll/cursor invariants */
 	move_cursor(cur, 1);
@@ -8366,14 +13301,26 @@ static void redraw(char *path)
 #endif
 	}
 
-	if (g_state.oldcolor) {
-		attron(COLOR_PAIR(cfg.curctx + 1) | A_BOLD);
-		g_state.dircolor = 1;
-	}
-
 	int onscreen = MIN(ONSCREEN + curscroll, ndents);
 	int len = scanselforpath(path, FALSE);
 
+	if (ONSCREEN > scr.rowcap) {
+		scr.rows = xrealloc(scr.rows, ONSCREEN * sizeof(rowstate_t));
+		scr.rowcap = scr.rows ? ONSCREEN : 0;
+	}
+
+	if (scr.rows) {
+		scr.nrows = MAX(ONSCREEN, 0);
+		scr.lines = xlines;
+		scr.cols = xcols;
+		scr.ncols = ncols;
+		for (i = 0; i < scr.nrows; ++i)
+			scr.rows[i].id = UINT_MAX;
+#ifdef DIM_FILTERED
+		xstrsncpy(scr.fltr, g_ctx[cfg.curctx].c_fltr, REGEX_MAX);
+#endif
+	}
+
 	ncols = adjust_cols(ncols);
 
 	/* Print listing */
@@ -8383,13 +13330,9 @@ static void redraw(char *path)
 		if (len)
 			findmarkentry(len, &pdents[i]);
 
-		printent(i, ncols, i == cur);
-	}
-
-	/* Must reset e.g. no files in dir */
-	if (g_state.dircolor) {
-		attroff(COLOR_PAIR(cfg.curctx + 1) | A_BOLD);
-		g_state.dircolor = 0;
+		draw_row(i, ncols);
+		if (scr.nrows)
+			saverow(&scr.rows[i - curscroll], i);
 	}
 
 	/* Go to last entry */
@@ -8404,8 +13347,8 @@ static void redraw(char *path)
 
 	markhovered();
 
-	if (cfg.preview)
-		preview_pane(path);
+	scr.preview = previewid();
+	preview_pane(path);
 }
 
 static bool cdprep(char *lastdir, char *lastname, char *path, char *newpath)
@@ -8595,7 +13538,20 @@ begin:
 		if ((presel != FILTER) || !filterset()) {
 			redraw(path);
 			statusbar(path);
+			lastframe = monotonic_ns();
+		}
+
+#ifdef DEBUG
+		if (keyns) {
+			ullong_t ms;
+
+			refresh();
+			ms = (monotonic_ns() - keyns) / 1000000;
+			for (r = 0; r < LATENCY_BUCKETS - 1 && ms >= (1ULL << r); ++r);
+			++latency[r];
+			keyns = 0;
 		}
+#endif
 
 #ifdef BENCH
 		/* Lod and exit for performance profiling e.g. to run 'time nnn -T d /' */
@@ -8959,7 +13915,11 @@ nochange:
 		case SEL_YOUNG:
 			if (ndents) {
 				g_state.move = 1;
+#ifdef DEBUG
+				keyns = monotonic_ns();
+#endif
 				handle_screen_move(sel);
+				coalesce_moves();
 			}
 			break;
 		case SEL_JUMP:
@@ -9096,6 +14056,7 @@ nochange:
 		case SEL_HIDDEN: // fallthrough
 		case SEL_DETAIL: // fallthrough
 		case SEL_PREVIEW: // fallthrough
+		case SEL_PREVTAIL: // fallthrough
 		case SEL_SORT:
 			switch (sel) {
 			case SEL_MFLTR:
@@ -9124,6 +14085,10 @@ nochange:
 			case SEL_PREVIEW:
 				cfg.preview ^= 1;
 				continue;
+			case SEL_PREVTAIL:
+				cfg.prevtail ^= 1;
+				scr.preview = -1; /* Preview again */
+				continue;
 			default: /* SEL_SORT */
 				r = set_sort_flags(get_input(messages[MSG_ORDER]));
 				if (!r) {
@@ -9230,6 +14195,9 @@ nochange:
 		case SEL_SEL:
 			if (!ndents)
 				goto nochange;
+#ifdef DEBUG
+			keyns = monotonic_ns();
+#endif
 
 			startselection();
 			if (g_state.rangesel)
@@ -9241,7 +14209,7 @@ nochange:
 			if (pdents[cur].flags & FILE_SELECTED) {
 				++nselected;
 				appendfpath(newpath, mkpath(path, pdents[cur].name, newpath));
-				writesel(pselbuf, selbufpos - 1); /* Truncate NULL from end */
+				writesel();
 			} else {
 				--nselected;
 				rmfromselbuf(mkpath(path, pdents[cur].name, g_sel));
@@ -9368,7 +14336,7 @@ nochange:
 			}
 
 			(nselected == 1 && (sel == SEL_CP || sel == SEL_MV))
-				? mkpath(path, xbasename(pselbuf), newpath)
+				? mkpath(path, selfirstname(), newpath)
 				: (newpath[0] = '\0');
 
 			endselection(TRUE);
@@ -9382,12 +14350,6 @@ nochange:
 				presel = FILTER;
 			clearfilter();
 
-#ifndef NOX11
-			/* Show notification on operation complete */
-			if (cfg.x11)
-				plugscript(utils[UTIL_NTFY], F_NOWAIT | F_NOTRACE);
-#endif
-
 			if (newpath[0] && !access(newpath, F_OK))
 				xstrsncpy(lastname, xbasename(newpath), NAME_MAX+1);
 			else
@@ -9402,6 +14364,7 @@ nochange:
 		{
 			int ret = 'n';
 			size_t len;
+			bool job;
 
 			if (!ndents && (sel == SEL_OPENWITH || sel == SEL_RENAME))
 				break;
@@ -9454,7 +14417,7 @@ nochange:
 				if (r == 'f' || r == 'd')
 					tmp = xreadline(tmp, messages[MSG_NEW_PATH]);
 				else if (r == 's' || r == 'h')
-					tmp = xreadline((nselected == 1 && cfg.prefersel) ? xbasename(pselbuf) : NULL,
+					tmp = xreadline((nselected == 1 && cfg.prefersel) ? selfirstname() : NULL,
 						messages[nselected <= 1 ? MSG_NEW_PATH : MSG_LINK_PREFIX]);
 				else
 					tmp = NULL;
@@ -9482,13 +14445,16 @@ nochange:
 					}
 				}
 
-				(r == 's') ? archive_selection(get_archive_cmd(tmp), tmp)
-					   : spawn(get_archive_cmd(tmp), tmp, pdents[cur].name,
-						   NULL, F_CLI | F_CONFIRM);
+				if (r == 's')
+					job = archive_selection(get_archive_cmd(tmp), tmp);
+				else if (!(job = job_spawn("archive", tmp, NULL, get_archive_cmd(tmp),
+							   tmp, pdents[cur].name)))
+					spawn(get_archive_cmd(tmp), tmp, pdents[cur].name,
+					      NULL, F_CLI | F_CONFIRM);
 
-				if (tmp && (access(tmp, F_OK) == 0)) { /* File created */
+				if (job || access(tmp, F_OK) == 0) { /* File created or a job makes it */
 					if (r == 's')
-						clearselection(); /* Archive operation complete */
+						clearselection(); /* Archived or copied for the job */
 
 					/* Check if any entry is created in the current directory */
 					tmp = get_cwd_entry(path, tmp, &len);
@@ -9733,10 +14699,29 @@ nochange:
 			statusbar(path);
 			goto nochange;
 #endif
+		case SEL_JOBS:
+			if (!jobs_manage()) {
+				presel = MSGWAIT;
+				goto nochange;
+			}
+			continue;
 		case SEL_EXPORT:
 			export_file_list();
 			cfg.filtermode ?  presel = FILTER : statusbar(path);
 			goto nochange;
+#ifndef NOFIND
+		case SEL_FIND:
+			tmp = fidx_search(path);
+			if (!tmp) {
+				cfg.filtermode ?  presel = FILTER : statusbar(path);
+				goto nochange;
+			}
+
+			set_smart_ctx(0, tmp, &path, NULL, &lastname, &lastdir);
+			lastname[0] = '\0';
+			setdirwatch();
+			goto begin;
+#endif
 		case SEL_TIMETYPE:
 			if (!set_time_type(&presel))
 				goto nochange;
@@ -9779,6 +14764,10 @@ nochange:
 					break; // fallthrough
 			}
 
+			/* Copies and removals stop, commands go on */
+			if (njobs && !g_state.forcequit && !xconfirm(get_input(messages[MSG_QUIT_JOBS])))
+				break;
+
 			/* CD on Quit */
 			tmp = getenv("NNN_TMPFILE");
 			if ((sel == SEL_QUITCD) || tmp) {
@@ -10098,7 +15087,11 @@ static void usage(void)
 		" -S      persistent session\n"
 #endif
 		" -t secs timeout to lock\n"
+#ifndef NOUG
+		" -T key  sort order [a/d/e/o/r/s/t/v]\n"
+#else
 		" -T key  sort order [a/d/e/r/s/t/v]\n"
+#endif
 		" -u      use selection (no prompt)\n"
 #ifndef NOUG
 		" -U      show user and group\n"
@@ -10239,6 +15232,7 @@ static void cleanup(void)
 	free(dir_dispatched_bmp);
 	free(bookmark);
 	free(plug);
+	preview_stop();
 	free(previewer);
 	if (lastcmdpos != INVALID_POS)
 		for (uchar_t pos = 0; pos <= lastcmdpos; ++pos)
@@ -10249,7 +15243,11 @@ static void cleanup(void)
 #endif
 	if (g_state.pluginit)
 		unlink(g_pipepath);
+#ifdef MAGIC
+	magic_stop();
+#endif
 #ifdef DEBUG
+	log_latency();
 	disabledbg();
 #endif
 }
@@ -10662,6 +15660,14 @@ int main(int argc, char *argv[])
 	}
 #endif
 
+	/* Cap the frame rate while moving around */
+	const char *fps = getenv(env_cfg[NNN_FPS]);
+
+	if (fps) {
+		opt = atoi(fps);
+		frame_ns = (opt > 0) ? 1000000000 / MIN(opt, FPS_MAX) : 0;
+	}
+
 	/* Configure trash preference */
 	trashcmd = getenv(env_cfg[NNN_TRASH]);
 	if (trashcmd) {
@@ -10777,7 +15783,7 @@ int main(int argc, char *argv[])
 	if (g_state.picker) {
 		if (selbufpos) {
 			fd = selpath ? open(selpath, O_WRONLY | O_CREAT | O_TRUNC, 0600) : STDOUT_FILENO;
-			if ((fd == -1) || (seltofile(fd, NULL, sepnul ? "\0" : NEWLINE) != (size_t)(selbufpos)))
+			if ((fd == -1) || !seltofile(fd, NULL, sepnul ? "\0" : NEWLINE))
 				xerror();
 
 			if (fd > 1)
@@ -10798,6 +15804,7 @@ int main(int argc, char *argv[])
 
 	/* Free the selection buffer */
 	free(pselbuf);
+	free(pselidx);
 
 #ifdef LINUX_INOTIFY
 	/* Shutdown inotify */
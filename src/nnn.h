@@ -111,9 +111,14 @@ enum action {
 	SEL_PROMPT,
 	SEL_LOCK,
 	SEL_SESSIONS,
+	SEL_JOBS,
 	SEL_EXPORT,
+#ifndef NOFIND
+	SEL_FIND,
+#endif
 	SEL_TIMETYPE,
 	SEL_PREVIEW,
+	SEL_PREVTAIL,
 	SEL_QUITCTX,
 	SEL_QUITCD,
 	SEL_QUIT,
@@ -273,12 +278,20 @@ static struct key bindings[] = {
 	{ '0',            SEL_LOCK },
 	/* Manage sessions */
 	{ 's',            SEL_SESSIONS },
+	/* Background jobs */
+	{ 'i',            SEL_JOBS },
 	/* Export list */
 	{ '>',            SEL_EXPORT },
+#ifndef NOFIND
+	/* Find file names below current dir */
+	{ 'F',            SEL_FIND },
+#endif
 	/* Set time type */
 	{ 'T',            SEL_TIMETYPE },
 	/* Toggle preview pane */
 	{ 'P',            SEL_PREVIEW },
+	/* Toggle preview of file end */
+	{ 'L',            SEL_PREVTAIL },
 	/* Quit a context */
 	{ 'q',            SEL_QUITCTX },
 	/* Change dir on quit */